@@ -0,0 +1,94 @@
+/* Minimal Arduino core for building the library on a desktop host.
+
+   Time is virtual: delay() and delayMicroseconds() advance a clock instead of
+   sleeping, and micros() and millis() read it. Device stand-ins may advance
+   it too, so latencies come out as they would on the wire while replays and
+   benchmarks run at full host speed. Serial writes to stdout. */
+
+#ifndef ARDUINO_HOST_H
+#define ARDUINO_HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HEX 16
+#define DEC 10
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define LOW 0x0
+#define HIGH 0x1
+
+#define noInterrupts()   ((void) 0)
+#define interrupts()     ((void) 0)
+
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long micros();
+unsigned long millis();
+void pinMode(uint8_t pin, uint8_t mode);
+
+//! Current virtual time in microseconds, without the 32-bit wrap of micros().
+uint64_t host_clock_us();
+//! Advances virtual time, e.g. for work a device stand-in performs.
+void host_clock_advance(uint64_t us);
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t value) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size);
+
+	size_t print(const char *text);
+	size_t print(char value);
+	size_t print(unsigned char value, int base = DEC);
+	size_t print(int value, int base = DEC);
+	size_t print(unsigned int value, int base = DEC);
+	size_t print(long value, int base = DEC);
+	size_t print(unsigned long value, int base = DEC);
+
+	size_t println();
+	size_t println(const char *text);
+	size_t println(char value);
+	size_t println(unsigned char value, int base = DEC);
+	size_t println(int value, int base = DEC);
+	size_t println(unsigned int value, int base = DEC);
+	size_t println(long value, int base = DEC);
+	size_t println(unsigned long value, int base = DEC);
+
+private:
+	size_t printNumber(unsigned long value, int base);
+};
+
+class Stream : public Print
+{
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+};
+
+//! Stream that writes to a stdio stream and never has input.
+class FilePrint : public Stream
+{
+public:
+	FilePrint(FILE *file) : file(file) {}
+	void begin(unsigned long baud) { (void) baud; }
+	int available() { return 0; }
+	int read() { return -1; }
+	int peek() { return -1; }
+	size_t write(uint8_t value);
+	size_t write(const uint8_t *buffer, size_t size);
+
+private:
+	FILE *file;
+};
+
+extern FilePrint Serial;
+
+#endif
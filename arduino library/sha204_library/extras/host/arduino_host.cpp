@@ -0,0 +1,152 @@
+#include "Arduino.h"
+
+static uint64_t host_time_us;
+
+uint64_t host_clock_us()
+{
+	return host_time_us;
+}
+
+void host_clock_advance(uint64_t us)
+{
+	host_time_us += us;
+}
+
+void delay(unsigned long ms)
+{
+	host_time_us += (uint64_t) ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	host_time_us += us;
+}
+
+unsigned long micros()
+{
+	return (uint32_t) host_time_us;
+}
+
+unsigned long millis()
+{
+	return (uint32_t) (host_time_us / 1000);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	(void) pin;
+	(void) mode;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i++)
+		write(buffer[i]);
+	return size;
+}
+
+size_t Print::printNumber(unsigned long value, int base)
+{
+	char text[8 * sizeof(value) + 1];
+	char *digit = &text[sizeof(text) - 1];
+
+	if (base < 2)
+		base = DEC;
+	*digit = '\0';
+	do {
+		unsigned long remainder = value % base;
+		*--digit = remainder < 10 ? '0' + remainder : 'A' + remainder - 10;
+		value /= base;
+	} while (value);
+	return print(digit);
+}
+
+size_t Print::print(const char *text)
+{
+	return write((const uint8_t *) text, strlen(text));
+}
+
+size_t Print::print(char value)
+{
+	return write((uint8_t) value);
+}
+
+size_t Print::print(unsigned char value, int base)
+{
+	return printNumber(value, base);
+}
+
+size_t Print::print(int value, int base)
+{
+	return print((long) value, base);
+}
+
+size_t Print::print(unsigned int value, int base)
+{
+	return printNumber(value, base);
+}
+
+size_t Print::print(long value, int base)
+{
+	if (base == DEC && value < 0)
+		return print('-') + printNumber(-(unsigned long) value, DEC);
+	return printNumber((unsigned long) value, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+	return printNumber(value, base);
+}
+
+size_t Print::println()
+{
+	return print('\n');
+}
+
+size_t Print::println(const char *text)
+{
+	return print(text) + println();
+}
+
+size_t Print::println(char value)
+{
+	return print(value) + println();
+}
+
+size_t Print::println(unsigned char value, int base)
+{
+	return print(value, base) + println();
+}
+
+size_t Print::println(int value, int base)
+{
+	return print(value, base) + println();
+}
+
+size_t Print::println(unsigned int value, int base)
+{
+	return print(value, base) + println();
+}
+
+size_t Print::println(long value, int base)
+{
+	return print(value, base) + println();
+}
+
+size_t Print::println(unsigned long value, int base)
+{
+	return print(value, base) + println();
+}
+
+size_t FilePrint::write(uint8_t value)
+{
+	return fputc(value, file) == EOF ? 0 : 1;
+}
+
+size_t FilePrint::write(const uint8_t *buffer, size_t size)
+{
+	return fwrite(buffer, 1, size, file);
+}
+
+FilePrint Serial(stdout);
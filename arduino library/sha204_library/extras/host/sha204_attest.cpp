@@ -0,0 +1,158 @@
+/* Measures the firmware attestation pipeline of sha204Attestor.
+
+   Build from the library directory and run:
+
+     g++ -O2 -DSHA204_SWI_HOST -Iextras/host -I. *.cpp extras/host/arduino_host.cpp \
+         extras/host/sha204_emulator_device.cpp extras/host/sha204_attest.cpp -o sha204_attest
+     ./sha204_attest [image_bytes] [chunk_us]
+
+   The hash rows time sha204Sha256 on the host CPU for several update sizes:
+   hash,update_bytes,megabytes,ns_per_byte,mb_per_s
+
+   The pipeline rows attest 16 images against an emulated device, once one
+   image after the other and once with the next image added before the current
+   one is attested, so that it is hashed while Nonce and MAC execute. Reading
+   and hashing a chunk of SHA204_ATTEST_CHUNK bytes is charged chunk_us of
+   virtual time, the cost on the target; the hash row of the benchmark example
+   measures it. Every MAC is checked against one computed in software.
+   pipeline,mode,image_bytes,chunk_us,virtual_ms_per_image,images_per_s,mismatches */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+#include "sha204_emulator_device.h"
+
+#define IMAGES               (16)
+#define KEY_ID               (0)
+
+static sha204EmulatorDevice device;
+static atsha204Class sha204(0);
+static uint8_t *images[IMAGES];
+static uint32_t image_size = 4096;
+static unsigned long chunk_us = 1000;
+static volatile uint8_t sink;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void benchmark_hash(uint16_t update_bytes, uint32_t total)
+{
+	static uint8_t buffer[4096];
+	sha204Sha256 hash;
+	uint8_t digest[32];
+	uint32_t done;
+
+	memset(buffer, 0xA5, sizeof(buffer));
+	uint64_t start_ns = now_ns();
+	for (done = 0; done < total; done += update_bytes)
+		hash.update(buffer, update_bytes);
+	hash.finish(digest);
+	sink = digest[0];
+	double ns = (double) (now_ns() - start_ns);
+	printf("hash,%u,%u,%.2f,%.1f\n", update_bytes, total >> 20, ns / total, total / ns * 1000.0);
+}
+
+// Reads from an image in RAM and charges the time the target would need.
+static uint16_t read_image(void *context, uint32_t offset, uint8_t *buffer, uint16_t length)
+{
+	memcpy(buffer, (uint8_t *) context + offset, length);
+	delayMicroseconds(chunk_us);
+	return length;
+}
+
+// The MAC the device computes with SHA204_ATTEST_MAC_MODE over the digest of an image.
+static void expected_mac(const uint8_t *image, uint8_t *mac)
+{
+	uint8_t message[88];
+	uint8_t digest[32];
+	sha204Sha256 hash;
+	uint32_t offset;
+
+	for (offset = 0; offset < image_size; offset += SHA204_ATTEST_CHUNK)
+		hash.update(&image[offset], image_size - offset < SHA204_ATTEST_CHUNK ? image_size - offset : SHA204_ATTEST_CHUNK);
+	hash.finish(digest);
+
+	memset(message, 0, sizeof(message));
+	memcpy(message, &device.data[KEY_ID * SHA204_EMULATOR_SLOT_SIZE], 32);
+	memcpy(&message[32], digest, 32);
+	message[64] = SHA204_MAC;
+	message[65] = SHA204_ATTEST_MAC_MODE;
+	message[66] = KEY_ID;
+	message[79] = device.config[ADDRESS_SN8];
+	message[84] = device.config[0];
+	message[85] = device.config[1];
+	hash.init();
+	hash.update(message, sizeof(message));
+	hash.finish(mac);
+}
+
+static void benchmark_pipeline(const char *mode, uint8_t ahead)
+{
+	sha204Attestor attestor(sha204, KEY_ID);
+	uint8_t mac[32], expected[32];
+	unsigned long mismatches = 0;
+	uint8_t i, added = 0;
+
+	uint64_t start_us = host_clock_us();
+	for (i = 0; i < IMAGES; i++)
+	{
+		while (added < IMAGES && added <= i + ahead)
+		{
+			attestor.add(read_image, images[added], image_size);
+			added++;
+		}
+		if (attestor.attest(NULL, mac) != SHA204_SUCCESS)
+			mismatches++;
+		else
+		{
+			expected_mac(images[i], expected);
+			mismatches += memcmp(mac, expected, sizeof(mac)) != 0;
+		}
+	}
+	double ms = (host_clock_us() - start_us) / 1000.0 / IMAGES;
+	printf("pipeline,%s,%u,%lu,%.1f,%.2f,%lu\n", mode, image_size, chunk_us, ms, 1000.0 / ms, mismatches);
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t i;
+	uint32_t j;
+
+	if (argc > 1)
+		image_size = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		chunk_us = strtoul(argv[2], NULL, 0);
+	if (!image_size) {
+		fprintf(stderr, "usage: %s [image_bytes] [chunk_us]\n", argv[0]);
+		return 2;
+	}
+
+	printf("hash,update_bytes,megabytes,ns_per_byte,mb_per_s\n");
+	benchmark_hash(SHA204_ATTEST_CHUNK, 64UL << 20);
+	benchmark_hash(1024, 64UL << 20);
+	benchmark_hash(4096, 64UL << 20);
+
+	for (i = 0; i < IMAGES; i++)
+	{
+		images[i] = (uint8_t *) malloc(image_size);
+		for (j = 0; j < image_size; j++)
+			images[i][j] = (uint8_t) (j * 31 + i);
+	}
+	// MAC needs a locked data zone.
+	memset(device.data, 0x3C, SHA204_EMULATOR_SLOT_SIZE);
+	device.config[86] = device.config[87] = 0x00;
+	device.setTiming(SHA204_EMULATOR_TIMING_TYPICAL);
+	sha204.setHostDevice(&device);
+
+	printf("pipeline,mode,image_bytes,chunk_us,virtual_ms_per_image,images_per_s,mismatches\n");
+	benchmark_pipeline("sequential", 0);
+	benchmark_pipeline("overlapped", 1);
+	return 0;
+}
@@ -0,0 +1,327 @@
+/* Measures the software cost of the library on a desktop host.
+
+   Build from the library directory and run:
+
+     g++ -O2 -DSHA204_SWI_HOST -Iextras/host -I. *.cpp extras/host/arduino_host.cpp \
+         extras/host/sha204_emulator_device.cpp extras/host/sha204_benchmark.cpp -o sha204_benchmark
+     ./sha204_benchmark [iterations] [crc_ns]
+
+   Commands run against sha204EmulatorDevice. Results are printed as comma
+   separated lines: benchmark,iterations,ns_per_op,virtual_us_per_op
+   ns_per_op is host CPU time per operation. virtual_us_per_op is the time the
+   operation would take on the bus, including execution delays, polling and
+   re-synchronization. The execute_ rows include the cost of the stand-in,
+   which the stand_in_ row measures on its own. The sequence_ rows charge
+   crc_ns of virtual time per CRC byte, the cost on the target, so that the
+   CRCs authenticate() computes while the device executes show up as saved
+   time. The default of 10000 ns is an estimate for a 16 MHz AVR; the crc row
+   of the benchmark example measures it. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+#include "sha204_emulator_device.h"
+
+static sha204EmulatorDevice device;
+static atsha204Class sha204(0);
+static uint8_t tx_buffer[SHA204_CMD_SIZE_MAX];
+static uint8_t rx_buffer[SHA204_RSP_SIZE_MAX];
+static uint8_t data[32];
+static volatile uint8_t sink;
+
+typedef struct
+{
+	const char *name;
+	uint8_t op_code;
+	uint8_t param1;
+	uint16_t param2;
+	uint8_t datalen;
+} benchmark_command_t;
+
+static const benchmark_command_t benchmark_commands[] = {
+	{"execute_devrev", SHA204_DEVREV, 0, 0, 0},
+	{"execute_read_4", SHA204_READ, SHA204_ZONE_CONFIG, 4, 0},
+	{"execute_read_32", SHA204_READ, SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG, 8, 0},
+	{"execute_write_4", SHA204_WRITE, SHA204_ZONE_CONFIG, 5, 4},
+	{"execute_random", SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, 0, 0},
+	{"execute_nonce_passthrough", SHA204_NONCE, NONCE_MODE_PASSTHROUGH, 0, 32},
+	{"execute_parse_error", 0x00, 0, 0, 0},
+};
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *name, unsigned long iterations, uint64_t start_ns, uint64_t start_us)
+{
+	uint64_t ns = now_ns() - start_ns;
+	uint64_t us = host_clock_us() - start_us;
+
+	printf("%s,%lu,%.1f,%.1f\n", name, iterations,
+			(double) ns / iterations, (double) us / iterations);
+}
+
+static void benchmark_crc(unsigned long iterations, uint8_t length)
+{
+	char name[16];
+	uint8_t packet[SHA204_CMD_SIZE_MAX];
+	uint8_t crc[SHA204_CRC_SIZE];
+	unsigned long i;
+
+	memset(packet, 0x5A, sizeof(packet));
+	snprintf(name, sizeof(name), "crc_%u", length);
+	uint64_t start_ns = now_ns(), start_us = host_clock_us();
+	for (i = 0; i < iterations; i++) {
+		packet[0] = (uint8_t) i;
+		sha204.sha204c_calculate_crc(length - SHA204_CRC_SIZE, packet, crc);
+		sink = crc[0];
+	}
+	report(name, iterations, start_ns, start_us);
+}
+
+static void benchmark_check_crc(unsigned long iterations, uint8_t length)
+{
+	char name[24];
+	uint8_t response[SHA204_RSP_SIZE_MAX];
+	uint16_t crc;
+	unsigned long i;
+
+	memset(response, 0xA5, sizeof(response));
+	response[SHA204_BUFFER_POS_COUNT] = length;
+	crc = sha204EmulatorDevice::crc(response, length - SHA204_CRC_SIZE);
+	response[length - 2] = (uint8_t) crc;
+	response[length - 1] = (uint8_t) (crc >> 8);
+	snprintf(name, sizeof(name), "check_crc_%u", length);
+	uint64_t start_ns = now_ns(), start_us = host_clock_us();
+	for (i = 0; i < iterations; i++)
+		sink = sha204.sha204c_check_crc(response);
+	report(name, iterations, start_ns, start_us);
+	if (sink != SHA204_SUCCESS)
+		fprintf(stderr, "%s: CRC check failed\n", name);
+}
+
+static uint8_t execute(const benchmark_command_t *command)
+{
+	return sha204.sha204m_execute(command->op_code, command->param1, command->param2,
+			command->datalen, data, 0, NULL, 0, NULL,
+			sizeof(tx_buffer), tx_buffer, sizeof(rx_buffer), rx_buffer);
+}
+
+static void benchmark_execute(unsigned long iterations, const benchmark_command_t *command, uint8_t timing)
+{
+	uint8_t expected = command->op_code ? SHA204_SUCCESS : SHA204_PARSE_ERROR;
+	unsigned long i, failures = 0;
+
+	device.setTiming(timing);
+	sha204.sha204c_wakeup(rx_buffer);
+	uint64_t start_ns = now_ns(), start_us = host_clock_us();
+	for (i = 0; i < iterations; i++)
+		if (execute(command) != expected)
+			failures++;
+	report(command->name, iterations, start_ns, start_us);
+	if (failures)
+		fprintf(stderr, "%s: %lu failures\n", command->name, failures);
+}
+
+// Receiving into a buffer of the exact response size and of the maximum size, as the
+// rx_size rows of the benchmark example do. Build with -DSHA204_RX_FULL_SIZE for the
+// receiver that waits for the start pulse timeout after a short response.
+static void benchmark_rx_size(unsigned long iterations, const benchmark_command_t *command, uint8_t rx_size)
+{
+	char name[40];
+	unsigned long i;
+
+	device.setTiming(SHA204_EMULATOR_TIMING_INSTANT);
+	execute(command);
+	snprintf(name, sizeof(name), "rx_size_%s_%u", command->name + sizeof("execute_") - 1, rx_size);
+	uint64_t start_ns = now_ns(), start_us = host_clock_us();
+	for (i = 0; i < iterations; i++)
+		sink = sha204.sha204c_send_and_receive(tx_buffer, rx_size, rx_buffer, 0, NONCE_EXEC_MAX);
+	report(name, iterations, start_ns, start_us);
+}
+
+// The stand-in alone, fed with the packets of a DevRev command.
+static void benchmark_stand_in(unsigned long iterations)
+{
+	const uint8_t flag_cmd = SHA204_SWI_FLAG_CMD, flag_tx = SHA204_SWI_FLAG_TX;
+	unsigned long i;
+
+	device.setTiming(SHA204_EMULATOR_TIMING_INSTANT);
+	execute(&benchmark_commands[0]);
+	uint64_t start_ns = now_ns(), start_us = host_clock_us();
+	for (i = 0; i < iterations; i++) {
+		device.send(1, &flag_cmd);
+		device.send(tx_buffer[SHA204_BUFFER_POS_COUNT], tx_buffer);
+		device.send(1, &flag_tx);
+		sink = device.receive(sizeof(rx_buffer), rx_buffer);
+	}
+	report("stand_in_devrev", iterations, start_ns, start_us);
+}
+
+// Polling until a Random command completes in its typical execution time.
+static void benchmark_poll(unsigned long iterations)
+{
+	benchmark_command_t command = benchmark_commands[4];
+
+	command.name = "poll_random_typical";
+	benchmark_execute(iterations, &command, SHA204_EMULATOR_TIMING_TYPICAL);
+	command.name = "poll_random_max";
+	benchmark_execute(iterations, &command, SHA204_EMULATOR_TIMING_MAX);
+}
+
+// Re-synchronization and bail-out when the device does not answer at all.
+static void benchmark_dead_device(unsigned long iterations)
+{
+	unsigned long i;
+
+	sha204.setHostDevice(NULL);
+	uint64_t start_ns = now_ns(), start_us = host_clock_us();
+	for (i = 0; i < iterations; i++)
+		sink = execute(&benchmark_commands[0]);
+	report("dead_device_devrev", iterations, start_ns, start_us);
+	sha204.setHostDevice(&device);
+}
+
+static void benchmark_wakeup(unsigned long iterations)
+{
+	unsigned long i;
+
+	uint64_t start_ns = now_ns(), start_us = host_clock_us();
+	for (i = 0; i < iterations; i++) {
+		sha204.sha204p_sleep();
+		sink = sha204.sha204c_wakeup(rx_buffer);
+	}
+	report("sleep_wakeup", iterations, start_ns, start_us);
+}
+
+// A Nonce, Random and Read session, once as separate calls and once as one
+// authenticate() transaction that assembles each packet during the previous execution.
+static void benchmark_sequence(unsigned long iterations)
+{
+	const sha204_auth_step_t steps[] = {
+		{SHA204_NONCE, NONCE_MODE_PASSTHROUGH, 0, NONCE_NUMIN_SIZE_PASSTHROUGH, data, 0, NULL, 0, NULL, NULL},
+		{SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, 0, 0, NULL, 0, NULL, 0, NULL, NULL},
+		{SHA204_READ, SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG, 0, 0, NULL, 0, NULL, 0, NULL, rx_buffer},
+	};
+	sha204_auth_result_t result;
+	unsigned long i, failures = 0;
+	size_t j;
+
+	device.setTiming(SHA204_EMULATOR_TIMING_TYPICAL);
+	uint64_t start_ns = now_ns(), start_us = host_clock_us();
+	for (i = 0; i < iterations; i++) {
+		uint8_t ret_code = sha204.sha204c_wakeup(rx_buffer);
+		for (j = 0; j < sizeof(steps) / sizeof(steps[0]) && ret_code == SHA204_SUCCESS; j++)
+			ret_code = sha204.sha204m_execute(steps[j].op_code, steps[j].param1, steps[j].param2,
+					steps[j].datalen1, steps[j].data1, 0, NULL, 0, NULL,
+					sizeof(tx_buffer), tx_buffer, sizeof(rx_buffer), rx_buffer);
+		sha204.sha204p_sleep();
+		if (ret_code != SHA204_SUCCESS)
+			failures++;
+	}
+	report("sequence_separate", iterations, start_ns, start_us);
+
+	start_ns = now_ns();
+	start_us = host_clock_us();
+	for (i = 0; i < iterations; i++)
+		if (sha204.authenticate(steps, sizeof(steps) / sizeof(steps[0]), &result) != SHA204_SUCCESS)
+			failures++;
+	report("sequence_authenticate", iterations, start_ns, start_us);
+	if (failures)
+		fprintf(stderr, "sequence: %lu failures\n", failures);
+}
+
+static uint8_t zone_sink(void *context, uint16_t address, const uint8_t *bytes, uint8_t length)
+{
+	(void) context;
+	(void) address;
+	sink ^= bytes[length - 1];
+	return 0;
+}
+
+// Reads the whole data zone, once with loops over sha204m_read as a sketch would
+// write them and once with readZone(), which hands each response to a sink.
+static void benchmark_read_zone(unsigned long iterations)
+{
+	const uint16_t zone_size = (SHA204_KEY_ID_MAX + 1) * SHA204_ZONE_ACCESS_32;
+	uint8_t zone[zone_size];
+	sha204_stream_result_t result;
+	unsigned long i, failures = 0;
+	uint16_t address;
+	uint8_t ret_code, size;
+
+	device.config[ADDRESS_LOCKVALUE] = device.config[ADDRESS_LOCKCONFIG] = 0x00;
+	device.setTiming(SHA204_EMULATOR_TIMING_TYPICAL);
+	for (size = SHA204_ZONE_ACCESS_4; size; size = (size == SHA204_ZONE_ACCESS_4) ? SHA204_ZONE_ACCESS_32 : 0) {
+		uint64_t start_ns = now_ns(), start_us = host_clock_us();
+		for (i = 0; i < iterations; i++) {
+			ret_code = sha204.sha204c_wakeup(rx_buffer);
+			for (address = 0; address < zone_size && ret_code == SHA204_SUCCESS; address += size) {
+				memset(rx_buffer, 0, sizeof(rx_buffer));
+				ret_code = sha204.sha204m_read(tx_buffer, rx_buffer,
+						size == SHA204_ZONE_ACCESS_32 ? SHA204_ZONE_DATA | SHA204_ZONE_COUNT_FLAG : SHA204_ZONE_DATA, address);
+				memcpy(&zone[address], &rx_buffer[SHA204_BUFFER_POS_DATA], size);
+			}
+			sha204.sha204p_sleep();
+			if (ret_code != SHA204_SUCCESS)
+				failures++;
+			sink ^= zone[zone_size - 1];
+		}
+		report(size == SHA204_ZONE_ACCESS_32 ? "read_zone_loop_32" : "read_zone_loop_4", iterations, start_ns, start_us);
+	}
+
+	uint64_t start_ns = now_ns(), start_us = host_clock_us();
+	for (i = 0; i < iterations; i++)
+		if (sha204.readZone(SHA204_ZONE_DATA, 0, zone_size, zone_sink, NULL, &result) != SHA204_SUCCESS)
+			failures++;
+	report("read_zone_stream", iterations, start_ns, start_us);
+	if (failures)
+		fprintf(stderr, "read_zone: %lu failures\n", failures);
+	device.config[ADDRESS_LOCKVALUE] = device.config[ADDRESS_LOCKCONFIG] = 0x55;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000;
+	uint16_t crc_ns = argc > 2 ? (uint16_t) strtoul(argv[2], NULL, 0) : 10000;
+	size_t i;
+
+	if (!iterations) {
+		fprintf(stderr, "usage: %s [iterations] [crc_ns]\n", argv[0]);
+		return 2;
+	}
+	memset(data, 0x3C, sizeof(data));
+	device.setWatchdog(0);
+	sha204.setHostDevice(&device);
+
+	printf("benchmark,iterations,ns_per_op,virtual_us_per_op\n");
+	benchmark_crc(iterations, SHA204_CMD_SIZE_MIN);
+	benchmark_crc(iterations, NONCE_COUNT_LONG);
+	benchmark_crc(iterations, SHA204_CMD_SIZE_MAX);
+	benchmark_check_crc(iterations, SHA204_RSP_SIZE_MIN);
+	benchmark_check_crc(iterations, SHA204_RSP_SIZE_VAL);
+	benchmark_check_crc(iterations, SHA204_RSP_SIZE_MAX);
+	benchmark_stand_in(iterations);
+	for (i = 0; i < sizeof(benchmark_commands) / sizeof(benchmark_commands[0]); i++)
+		benchmark_execute(iterations, &benchmark_commands[i], SHA204_EMULATOR_TIMING_INSTANT);
+	benchmark_rx_size(iterations, &benchmark_commands[0], DEVREV_RSP_SIZE);
+	benchmark_rx_size(iterations, &benchmark_commands[0], SHA204_RSP_SIZE_MAX);
+	benchmark_rx_size(iterations, &benchmark_commands[5], NONCE_RSP_SIZE_SHORT);
+	benchmark_rx_size(iterations, &benchmark_commands[5], SHA204_RSP_SIZE_MAX);
+	benchmark_rx_size(iterations, &benchmark_commands[6], SHA204_RSP_SIZE_MIN);
+	benchmark_rx_size(iterations, &benchmark_commands[6], SHA204_RSP_SIZE_MAX);
+	benchmark_poll(iterations / 10 + 1);
+	benchmark_wakeup(iterations / 10 + 1);
+	atsha204Class::setHostCrcCost(crc_ns);
+	benchmark_sequence(iterations / 10 + 1);
+	atsha204Class::setHostCrcCost(0);
+	benchmark_read_zone(iterations / 100 + 1);
+	benchmark_dead_device(iterations / 100 + 1);
+	return 0;
+}
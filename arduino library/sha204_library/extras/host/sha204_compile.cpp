@@ -0,0 +1,348 @@
+/* Compiles the per-device images of a production run into one indexed file.
+
+   Build from the library directory:
+
+     g++ -O2 -pthread -DSHA204_SWI_HOST -Iextras/host -I. *.cpp extras/host/arduino_host.cpp \
+         extras/host/sha204_compile.cpp -o sha204_compile
+
+   Compile:
+
+     ./sha204_compile [-j threads] [-d target:parent]... template.bin serials.txt image.bin
+
+   template.bin holds the state every device gets: the 88 configuration bytes
+   as they will be read before the configuration lock, the 16 slots and the
+   64 OTP bytes. Bytes 0 to 15 give RevNum and the bytes around the serial
+   number; bytes 84 to 87 the lock word. serials.txt lists one serial number
+   per line as 18 hex digits, SN[0] first. Each -d puts a key into slot target
+   that is derived from the key in slot parent of the template the way
+   DeriveKey derives it after a pass-through Nonce with the padded serial
+   number, as sha204e_configure_diversify_key() does on the device. Devices
+   are split over the threads, -j defaults to the number of processors.
+
+   Look up one device:
+
+     ./sha204_compile -l image.bin serial
+
+   The file starts with a header of 48 bytes: "SHA204IM", version, number of
+   derived keys, record size and number of records (little endian), then the
+   target and parent slot of each derived key. The template follows, then one
+   record per device, sorted by serial number so that a lookup is a binary
+   search: serial number (9 bytes), configuration and data summary
+   (little endian) and the derived keys in the order of the header.
+
+   For a device, the provisioning firmware sets up a sha204_image_t with bytes
+   16 to 83 of the template, the template slots with the derived keys in
+   place, the OTP bytes of the template and the summaries of the record, and
+   passes SHA204_PROVISION_SUMMARIES. The device rejects a lock whose summary
+   does not match what it holds. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#define IMAGE_MAGIC          "SHA204IM"
+#define IMAGE_VERSION        ((uint8_t) 1)
+#define HEADER_SIZE          (48)
+#define SERIAL_SIZE          (9)
+#define KEY_SIZE             (32)
+#define SLOTS                (SHA204_KEY_ID_MAX + 1)
+#define DATA_SIZE            (SLOTS * KEY_SIZE)
+#define TEMPLATE_SIZE        (SHA204_CONFIG_SIZE + DATA_SIZE + SHA204_PROVISION_OTP_SIZE)
+#define RECORD_SIZE(keys)    (SERIAL_SIZE + 2 * SHA204_CRC_SIZE + (keys) * KEY_SIZE)
+#define THREADS_MAX          (64)
+
+static uint8_t image_template[TEMPLATE_SIZE];
+static uint8_t *config = image_template;
+static uint8_t *data = &image_template[SHA204_CONFIG_SIZE];
+static uint8_t *otp = &image_template[SHA204_CONFIG_SIZE + DATA_SIZE];
+
+static uint8_t targets[SLOTS], parents[SLOTS];
+static uint8_t key_count;
+static uint16_t data_prefix_crc;    // summary of the slots in front of the first derived key
+static uint8_t first_target;
+
+static uint8_t *serials;
+static uint8_t *records;
+static size_t count;
+
+static unsigned long now_us()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+
+static void put16(uint8_t *p, uint16_t value)
+{
+	p[0] = (uint8_t) value;
+	p[1] = (uint8_t) (value >> 8);
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static int parse_serial(const char *text, uint8_t *serial)
+{
+	unsigned byte;
+	int i;
+
+	for (i = 0; i < SERIAL_SIZE; i++, text += 2)
+		if (sscanf(text, "%2x", &byte) != 1)
+			return 0;
+		else
+			serial[i] = (uint8_t) byte;
+	return 1;
+}
+
+static void print_hex(const uint8_t *bytes, size_t size)
+{
+	while (size--)
+		printf("%02X", *bytes++);
+}
+
+static int compare_serials(const void *a, const void *b)
+{
+	return memcmp(a, b, SERIAL_SIZE);
+}
+
+// Key = SHA-256(parent key, opcode, mode, target key, SN[8], SN[0:1], 25 zeros, TempKey),
+// with TempKey set by a pass-through Nonce with the serial number padded with zeros.
+static void derive_key(const uint8_t *serial, uint8_t target, const uint8_t *parent, uint8_t *key)
+{
+	uint8_t message[3 * KEY_SIZE];
+	sha204Sha256 hash;
+
+	memset(message, 0, sizeof(message));
+	memcpy(message, parent, KEY_SIZE);
+	message[KEY_SIZE] = SHA204_DERIVE_KEY;
+	message[KEY_SIZE + 1] = DERIVE_KEY_RANDOM_FLAG;
+	message[KEY_SIZE + 2] = target;
+	message[KEY_SIZE + 4] = serial[8];
+	message[KEY_SIZE + 5] = serial[0];
+	message[KEY_SIZE + 6] = serial[1];
+	memcpy(&message[2 * KEY_SIZE], serial, SERIAL_SIZE);
+	hash.update(message, sizeof(message));
+	hash.finish(key);
+}
+
+// Fills the record of one device. Only the serial number bytes of the
+// configuration and the derived slots of the data zone differ between devices.
+static void compile(const uint8_t *serial, uint8_t *record)
+{
+	uint8_t keys[SLOTS][KEY_SIZE];
+	uint8_t head[ADDRESS_I2CADD];
+	const uint8_t *slot;
+	uint16_t crc;
+	uint8_t i, k;
+
+	memcpy(head, config, sizeof(head));
+	memcpy(&head[ADDRESS_SN03], serial, 4);
+	memcpy(&head[ADDRESS_SN47], &serial[4], 5);
+	crc = atsha204Class::sha204c_update_crc(sizeof(head), head, 0);
+	crc = atsha204Class::sha204c_update_crc(SHA204_CONFIG_SIZE - sizeof(head), &config[sizeof(head)], crc);
+	put16(&record[SERIAL_SIZE], crc);
+
+	for (k = 0; k < key_count; k++)
+		derive_key(serial, targets[k], &data[parents[k] * KEY_SIZE], keys[k]);
+
+	crc = data_prefix_crc;
+	for (i = first_target; i < SLOTS; i++) {
+		slot = &data[i * KEY_SIZE];
+		for (k = 0; k < key_count; k++)
+			if (targets[k] == i)
+				slot = keys[k];
+		crc = atsha204Class::sha204c_update_crc(KEY_SIZE, slot, crc);
+	}
+	crc = atsha204Class::sha204c_update_crc(KEY_SIZE, otp, crc);
+	crc = atsha204Class::sha204c_update_crc(KEY_SIZE, &otp[KEY_SIZE], crc);
+	put16(&record[SERIAL_SIZE + SHA204_CRC_SIZE], crc);
+
+	memcpy(record, serial, SERIAL_SIZE);
+	memcpy(&record[RECORD_SIZE(0)], keys, key_count * KEY_SIZE);
+}
+
+static void *compile_range(void *arg)
+{
+	size_t *range = (size_t *) arg;
+	size_t i;
+
+	for (i = range[0]; i < range[1]; i++)
+		compile(&serials[i * SERIAL_SIZE], &records[i * RECORD_SIZE(key_count)]);
+	return NULL;
+}
+
+static int lookup(const char *path, const char *text)
+{
+	uint8_t header[HEADER_SIZE], record[RECORD_SIZE(SLOTS)], serial[SERIAL_SIZE];
+	uint32_t low = 0, high, middle;
+	uint16_t record_size;
+	uint8_t k;
+	int order;
+	FILE *file = fopen(path, "rb");
+
+	if (!parse_serial(text, serial)) {
+		fprintf(stderr, "bad serial number %s\n", text);
+		return 1;
+	}
+	if (!file || fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, IMAGE_MAGIC, 8)
+			|| header[8] != IMAGE_VERSION || header[9] > SLOTS) {
+		fprintf(stderr, "%s is not an image file\n", path);
+		return 1;
+	}
+	record_size = get16(&header[10]);
+	high = get16(&header[12]) | ((uint32_t) get16(&header[14]) << 16);
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (fseek(file, HEADER_SIZE + TEMPLATE_SIZE + (long) middle * record_size, SEEK_SET)
+				|| fread(record, 1, record_size, file) != record_size)
+			break;
+		order = memcmp(serial, record, SERIAL_SIZE);
+		if (!order) {
+			printf("config_summary=%04X data_summary=%04X\n",
+					get16(&record[SERIAL_SIZE]), get16(&record[SERIAL_SIZE + SHA204_CRC_SIZE]));
+			for (k = 0; k < header[9]; k++) {
+				printf("slot%u=", header[16 + k]);
+				print_hex(&record[RECORD_SIZE(k)], KEY_SIZE);
+				printf("\n");
+			}
+			fclose(file);
+			return 0;
+		}
+		if (order < 0)
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	fclose(file);
+	fprintf(stderr, "%s is not in %s\n", text, path);
+	return 1;
+}
+
+static int usage()
+{
+	fprintf(stderr, "usage: sha204_compile [-j threads] [-d target:parent]... template.bin serials.txt image.bin\n"
+			"       sha204_compile -l image.bin serial\n");
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t threads[THREADS_MAX];
+	size_t ranges[THREADS_MAX][2];
+	uint8_t header[HEADER_SIZE];
+	unsigned target, parent, thread_count = (unsigned) sysconf(_SC_NPROCESSORS_ONLN);
+	size_t capacity = 0, i;
+	char line[80];
+	unsigned long start_us;
+	FILE *file;
+	int option;
+
+	while ((option = getopt(argc, argv, "j:d:l")) != -1) {
+		switch (option) {
+		case 'j':
+			thread_count = (unsigned) atoi(optarg);
+			break;
+		case 'd':
+			if (sscanf(optarg, "%u:%u", &target, &parent) != 2 || target >= SLOTS || parent >= SLOTS
+					|| key_count == SLOTS)
+				return usage();
+			targets[key_count] = (uint8_t) target;
+			parents[key_count++] = (uint8_t) parent;
+			break;
+		case 'l':
+			return (argc - optind == 2) ? lookup(argv[optind], argv[optind + 1]) : usage();
+		default:
+			return usage();
+		}
+	}
+	if (argc - optind != 3)
+		return usage();
+	if (thread_count < 1)
+		thread_count = 1;
+	if (thread_count > THREADS_MAX)
+		thread_count = THREADS_MAX;
+
+	file = fopen(argv[optind], "rb");
+	if (!file || fread(image_template, 1, sizeof(image_template), file) != sizeof(image_template)) {
+		fprintf(stderr, "%s: expected %u bytes\n", argv[optind], TEMPLATE_SIZE);
+		return 1;
+	}
+	fclose(file);
+
+	file = fopen(argv[optind + 1], "r");
+	if (!file) {
+		perror(argv[optind + 1]);
+		return 1;
+	}
+	while (fgets(line, sizeof(line), file)) {
+		if (line[0] == '\n' || line[0] == '\r' || line[0] == '#')
+			continue;
+		if (count == capacity) {
+			capacity = capacity ? 2 * capacity : 1024;
+			serials = (uint8_t *) realloc(serials, capacity * SERIAL_SIZE);
+		}
+		if (!parse_serial(line, &serials[count * SERIAL_SIZE])) {
+			fprintf(stderr, "bad serial number %s", line);
+			return 1;
+		}
+		count++;
+	}
+	fclose(file);
+	qsort(serials, count, SERIAL_SIZE, compare_serials);
+	for (i = 1; i < count; i++)
+		if (!memcmp(&serials[(i - 1) * SERIAL_SIZE], &serials[i * SERIAL_SIZE], SERIAL_SIZE)) {
+			fprintf(stderr, "serial number listed twice: ");
+			print_hex(&serials[i * SERIAL_SIZE], SERIAL_SIZE);
+			fprintf(stderr, "\n");
+			return 1;
+		}
+
+	start_us = now_us();
+	first_target = SLOTS;
+	for (i = 0; i < key_count; i++)
+		if (targets[i] < first_target)
+			first_target = targets[i];
+	data_prefix_crc = atsha204Class::sha204c_update_crc(first_target * KEY_SIZE, data, 0);
+
+	records = (uint8_t *) malloc(count * RECORD_SIZE(key_count) + 1);
+	if (thread_count > count)
+		thread_count = count ? (unsigned) count : 1;
+	for (i = 0; i < thread_count; i++) {
+		ranges[i][0] = count * i / thread_count;
+		ranges[i][1] = count * (i + 1) / thread_count;
+		pthread_create(&threads[i], NULL, compile_range, ranges[i]);
+	}
+	for (i = 0; i < thread_count; i++)
+		pthread_join(threads[i], NULL);
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, IMAGE_MAGIC, 8);
+	header[8] = IMAGE_VERSION;
+	header[9] = key_count;
+	put16(&header[10], RECORD_SIZE(key_count));
+	put16(&header[12], (uint16_t) count);
+	put16(&header[14], (uint16_t) (count >> 16));
+	memcpy(&header[16], targets, SLOTS);
+	memcpy(&header[32], parents, SLOTS);
+
+	file = fopen(argv[optind + 2], "wb");
+	if (!file || fwrite(header, 1, sizeof(header), file) != sizeof(header)
+			|| fwrite(image_template, 1, sizeof(image_template), file) != sizeof(image_template)
+			|| fwrite(records, RECORD_SIZE(key_count), count, file) != count || fclose(file)) {
+		perror(argv[optind + 2]);
+		return 1;
+	}
+	fprintf(stderr, "%lu devices, %u threads, %.1f ms\n", (unsigned long) count, thread_count,
+			(now_us() - start_us) / 1000.0);
+	return 0;
+}
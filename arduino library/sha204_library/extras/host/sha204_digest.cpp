@@ -0,0 +1,142 @@
+/* Measures how many GenDig and DeriveKey digests the emulator computes per second.
+
+   Build from the library directory and run:
+
+     g++ -O2 -DSHA204_SWI_HOST -Iextras/host -I. *.cpp extras/host/arduino_host.cpp \
+         extras/host/sha204_emulator_device.cpp extras/host/sha204_digest.cpp -o sha204_digest
+     ./sha204_digest [iterations]
+
+   Commands go straight to the execute() of the emulator, without the bus, so
+   the rows compare the digests rather than the library. Slot 13 holds the
+   parent key of the diversified examples. gendig runs GenDig with the
+   DeriveKey command as other data, derive_key a DeriveKey that creates slot 1
+   from slot 13, and verify the Nonce, GenDig and CheckMac a host runs per MAC.
+   Every row runs once with the midstate cache off and once with it on, and the
+   resulting TempKey or key is compared. Results are printed as comma separated
+   lines: operation,cache,ops_per_s,hits,speedup */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+#include "sha204_emulator_device.h"
+
+#define PARENT_SLOT          (13)
+#define TARGET_SLOT          (1)
+
+class sha204DigestDevice : public sha204EmulatorDevice
+{
+public:
+	void run(const uint8_t *command) { execute(command); }
+};
+
+static uint8_t gendig[GENDIG_COUNT_DATA];
+static uint8_t derive_key[DERIVE_KEY_COUNT_SMALL];
+static uint8_t nonce[NONCE_COUNT_SHORT];
+static uint8_t checkmac[CHECKMAC_COUNT];
+
+static void build()
+{
+	gendig[SHA204_COUNT_IDX] = GENDIG_COUNT_DATA;
+	gendig[SHA204_OPCODE_IDX] = SHA204_GENDIG;
+	gendig[GENDIG_ZONE_IDX] = GENDIG_ZONE_DATA;
+	gendig[GENDIG_KEYID_IDX] = PARENT_SLOT;
+	gendig[GENDIG_DATA_IDX] = SHA204_DERIVE_KEY;
+	gendig[GENDIG_DATA_IDX + 1] = DERIVE_KEY_RANDOM_FLAG;
+	gendig[GENDIG_DATA_IDX + 2] = TARGET_SLOT;
+
+	derive_key[SHA204_COUNT_IDX] = DERIVE_KEY_COUNT_SMALL;
+	derive_key[SHA204_OPCODE_IDX] = SHA204_DERIVE_KEY;
+	derive_key[DERIVE_KEY_RANDOM_IDX] = DERIVE_KEY_RANDOM_FLAG;
+	derive_key[DERIVE_KEY_TARGETKEY_IDX] = TARGET_SLOT;
+
+	nonce[SHA204_COUNT_IDX] = NONCE_COUNT_SHORT;
+	nonce[SHA204_OPCODE_IDX] = SHA204_NONCE;
+	nonce[NONCE_MODE_IDX] = NONCE_MODE_NO_SEED_UPDATE;
+
+	checkmac[SHA204_COUNT_IDX] = CHECKMAC_COUNT;
+	checkmac[SHA204_OPCODE_IDX] = SHA204_CHECKMAC;
+	checkmac[CHECKMAC_MODE_IDX] = CHECKMAC_MODE_BLOCK1_TEMPKEY;
+	checkmac[CHECKMAC_KEYID_IDX] = 0;
+}
+
+static void setup(sha204DigestDevice &device, bool cache)
+{
+	size_t i;
+
+	device.setTiming(SHA204_EMULATOR_TIMING_INSTANT);
+	device.setMidstateCache(cache);
+	device.config[ADDRESS_LOCKCONFIG] = 0x00;
+	device.config[ADDRESS_LOCKVALUE] = 0x00;
+	// Slot 1 takes keys DeriveKey creates from its WriteKey, slot 13.
+	device.config[ADDRESS_SLOTCONFIG + 2 * TARGET_SLOT + 1] = 0x30 | PARENT_SLOT;
+	for (i = 0; i < sizeof(device.data); i++)
+		device.data[i] = (uint8_t) (i * 3);
+}
+
+// Runs one operation, returns the digest it left behind in digest.
+static void step(sha204DigestDevice &device, const char *operation, unsigned long i, uint8_t *digest)
+{
+	if (!strcmp(operation, "verify")) {
+		nonce[NONCE_INPUT_IDX] = (uint8_t) i;
+		nonce[NONCE_INPUT_IDX + 1] = (uint8_t) (i >> 8);
+		device.run(nonce);
+		device.run(gendig);
+		memcpy(digest, device.temp_key, 32);
+		device.run(checkmac);
+		return;
+	}
+	device.temp_key[0] = (uint8_t) i;
+	device.temp_key[1] = (uint8_t) (i >> 8);
+	device.temp_key_valid = true;
+	device.temp_key_source = 1;
+	if (!strcmp(operation, "gendig")) {
+		device.run(gendig);
+		memcpy(digest, device.temp_key, 32);
+	}
+	else {
+		device.run(derive_key);
+		memcpy(digest, &device.data[TARGET_SLOT * SHA204_EMULATOR_SLOT_SIZE], 32);
+	}
+}
+
+static double measure(const char *operation, bool cache, unsigned long iterations, uint8_t *digest,
+		unsigned long *hits)
+{
+	sha204DigestDevice device;
+	unsigned long i;
+	clock_t start;
+	double seconds;
+
+	setup(device, cache);
+	start = clock();
+	for (i = 0; i < iterations; i++)
+		step(device, operation, i, digest);
+	seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+	*hits = device.midstateHits();
+	return seconds > 0 ? iterations / seconds : 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *operations[] = { "gendig", "derive_key", "verify" };
+	unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+	uint8_t plain[32], cached[32];
+	unsigned long hits;
+	double off, on;
+	size_t i;
+
+	build();
+	printf("operation,cache,ops_per_s,hits,speedup\n");
+	for (i = 0; i < sizeof(operations) / sizeof(operations[0]); i++) {
+		off = measure(operations[i], false, iterations, plain, &hits);
+		printf("%s,off,%.0f,%lu,1.00\n", operations[i], off, hits);
+		on = measure(operations[i], true, iterations, cached, &hits);
+		printf("%s,on,%.0f,%lu,%.2f\n", operations[i], on, hits, off > 0 ? on / off : 0);
+		if (memcmp(plain, cached, sizeof(plain)))
+			fprintf(stderr, "%s: digests differ\n", operations[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,670 @@
+#include "sha204_emulator_device.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#define LOCK_VALUE_UNLOCKED   ((uint8_t) 0x55)
+#define CONFIG_LOCK_VALUE     (86)   //!< config byte that locks data and OTP zones
+#define CONFIG_LOCK_CONFIG    (87)   //!< config byte that locks the configuration zone
+#define CONFIG_SLOT_CONFIG    (20)   //!< first of the 16-bit slot configurations
+#define CONFIG_SN8            (12)   //!< SN[8]
+
+// Slot configuration bits used by DeriveKey
+#define SLOT_WRITE_KEY(config)      (((config) >> 8) & 0x0F)
+#define SLOT_DERIVE_KEY             (0x2000)   //!< WriteConfig: DeriveKey may write the slot
+#define SLOT_DERIVE_KEY_CREATE      (0x1000)   //!< WriteConfig: parent is WriteKey, not the slot itself
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t *state, const uint8_t *block)
+{
+	uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+	uint8_t i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = (uint32_t) block[4 * i] << 24 | (uint32_t) block[4 * i + 1] << 16
+				| (uint32_t) block[4 * i + 2] << 8 | block[4 * i + 3];
+	for (i = 16; i < 64; i++)
+		w[i] = (ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7]
+				+ (ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+	for (i = 0; i < 64; i++) {
+		t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// Hashes the last length bytes of a message of total bytes into state and writes the digest.
+static void sha256_finish(uint32_t *state, const uint8_t *message, size_t length, size_t total, uint8_t *digest)
+{
+	uint8_t block[64];
+	size_t i, rest;
+
+	for (i = 0; i + 64 <= length; i += 64)
+		sha256_block(state, &message[i]);
+	rest = length - i;
+	memset(block, 0, sizeof(block));
+	memcpy(block, &message[i], rest);
+	block[rest] = 0x80;
+	if (rest >= 56) {
+		sha256_block(state, block);
+		memset(block, 0, sizeof(block));
+	}
+	for (i = 0; i < 8; i++)
+		block[63 - i] = (uint8_t) ((uint64_t) total * 8 >> (8 * i));
+	sha256_block(state, block);
+
+	for (i = 0; i < 32; i++)
+		digest[i] = (uint8_t) (state[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+// SHA-256 of a message, as computed by the engine of the device.
+static void sha256(const uint8_t *message, size_t length, uint8_t *digest)
+{
+	uint32_t state[8];
+
+	memcpy(state, sha256_iv, sizeof(state));
+	sha256_finish(state, message, length, length, digest);
+}
+
+// Typical and maximum execution times in us from the data sheet.
+static void sha204_emulator_times(uint8_t op_code, uint32_t *typical, uint32_t *maximum)
+{
+	switch (op_code) {
+	case SHA204_CHECKMAC:     *typical = 12000; *maximum = 38000; break;
+	case SHA204_DERIVE_KEY:   *typical = 14000; *maximum = 62000; break;
+	case SHA204_DEVREV:       *typical =   400; *maximum =  2000; break;
+	case SHA204_GENDIG:       *typical = 11000; *maximum = 43000; break;
+	case SHA204_HMAC:         *typical = 27000; *maximum = 69000; break;
+	case SHA204_LOCK:         *typical =  5000; *maximum = 24000; break;
+	case SHA204_MAC:          *typical = 12000; *maximum = 35000; break;
+	case SHA204_NONCE:        *typical = 22000; *maximum = 60000; break;
+	case SHA204_PAUSE:        *typical =   400; *maximum =  2000; break;
+	case SHA204_RANDOM:       *typical = 11000; *maximum = 50000; break;
+	case SHA204_READ:         *typical =   400; *maximum =  4000; break;
+	case SHA204_UPDATE_EXTRA: *typical =  4000; *maximum =  6000; break;
+	case SHA204_WRITE:        *typical =  4000; *maximum = 42000; break;
+	default:                  *typical =     0; *maximum =     0; break;
+	}
+}
+
+// Typical execution times in us of the ATSHA204A where they are shorter.
+static void sha204_emulator_times_a(uint8_t op_code, uint32_t *typical)
+{
+	switch (op_code) {
+	case SHA204_CHECKMAC:     *typical =  5000; break;
+	case SHA204_DERIVE_KEY:   *typical =  2000; break;
+	case SHA204_GENDIG:       *typical =  5000; break;
+	case SHA204_HMAC:         *typical = 13000; break;
+	case SHA204_MAC:          *typical =  5000; break;
+	case SHA204_NONCE:        *typical =  7000; break;
+	case SHA204_RANDOM:       *typical =  1000; break;
+	}
+}
+
+sha204EmulatorDevice::sha204EmulatorDevice()
+{
+	uint8_t i;
+
+	// Serial number, revision and I2C settings as shipped; every slot unlocked.
+	static const uint8_t header[16] = {
+		0x01, 0x23, 0x8C, 0x4A, 0x00, 0x09, 0x04, 0x00,
+		0xB7, 0x3C, 0x52, 0xF0, 0xEE, 0x55, 0xC8, 0x00
+	};
+	memset(config, 0, sizeof(config));
+	memcpy(config, header, sizeof(header));
+	for (i = 0; i < SHA204_EMULATOR_SLOTS; i++) {
+		config[20 + 2 * i] = 0x80;
+		config[21 + 2 * i] = 0x80;
+	}
+	memset(&config[52], 0xFF, 16);
+	config[CONFIG_LOCK_VALUE] = LOCK_VALUE_UNLOCKED;
+	config[CONFIG_LOCK_CONFIG] = LOCK_VALUE_UNLOCKED;
+	memset(data, 0xFF, sizeof(data));
+	memset(otp, 0xFF, sizeof(otp));
+	memset(temp_key, 0, sizeof(temp_key));
+	temp_key_valid = false;
+	temp_key_source = 0;
+
+	response_count = 0;
+	ready_at = wake_at = 0;
+	awake = expect_command = false;
+	timing = SHA204_EMULATOR_TIMING_TYPICAL;
+	watchdog_us = SHA204_EMULATOR_WATCHDOG;
+	random_state = 0x12345678;
+	command_count = 0;
+	memset(midstates, 0, sizeof(midstates));
+	midstate_cache = true;
+	midstate_hits = 0;
+}
+
+uint16_t sha204EmulatorDevice::crc(const uint8_t *data, size_t length, uint16_t crc_register)
+{
+	size_t i;
+	uint8_t bit_mask;
+
+	for (i = 0; i < length; i++)
+		for (bit_mask = 1; bit_mask; bit_mask <<= 1) {
+			uint8_t data_bit = (data[i] & bit_mask) ? 1 : 0;
+			uint8_t crc_bit = crc_register >> 15;
+			crc_register <<= 1;
+			if (data_bit ^ crc_bit)
+				crc_register ^= 0x8005;
+		}
+	return crc_register;
+}
+
+bool sha204EmulatorDevice::isAwake()
+{
+	if (awake && watchdog_us && host_clock_us() - wake_at >= watchdog_us) {
+		// The watchdog puts the device to sleep, which clears TempKey.
+		awake = false;
+		temp_key_valid = false;
+	}
+	return awake;
+}
+
+// The device answers a wake pulse with the wake status. This stand-in does so
+// even when already awake, which keeps the watchdog running from the first wake.
+void sha204EmulatorDevice::wake()
+{
+	if (!isAwake()) {
+		awake = true;
+		wake_at = host_clock_us();
+	}
+	expect_command = false;
+	respondStatus(SHA204_STATUS_BYTE_WAKEUP);
+	ready_at = host_clock_us();
+}
+
+// Like the device, the stand-in ignores flags and commands while it is asleep
+// or still executing a command, so a command sent too early is lost.
+uint8_t sha204EmulatorDevice::send(uint8_t count, const uint8_t *buffer)
+{
+	if (!isAwake() || host_clock_us() < ready_at)
+		return SWI_FUNCTION_RETCODE_SUCCESS;
+
+	if (expect_command) {
+		expect_command = false;
+		command_count++;
+		if (count < SHA204_CMD_SIZE_MIN || buffer[SHA204_BUFFER_POS_COUNT] != count
+				|| crc(buffer, count - SHA204_CRC_SIZE) != (buffer[count - 2] | buffer[count - 1] << 8)) {
+			respondStatus(SHA204_STATUS_BYTE_COMM);
+			ready_at = host_clock_us();
+			return SWI_FUNCTION_RETCODE_SUCCESS;
+		}
+		execute(buffer);
+		return SWI_FUNCTION_RETCODE_SUCCESS;
+	}
+
+	if (count != 1)
+		return SWI_FUNCTION_RETCODE_SUCCESS;
+	switch (buffer[0]) {
+	case SHA204_SWI_FLAG_CMD:
+		expect_command = true;
+		break;
+
+	case SHA204_SWI_FLAG_SLEEP:
+		awake = false;
+		temp_key_valid = false;
+		break;
+
+	case SHA204_SWI_FLAG_IDLE:
+		// Idle keeps TempKey.
+		awake = false;
+		break;
+	}
+	return SWI_FUNCTION_RETCODE_SUCCESS;
+}
+
+uint8_t sha204EmulatorDevice::receive(uint8_t count, uint8_t *buffer)
+{
+	if (!isAwake() || !response_count || host_clock_us() < ready_at)
+		return SWI_FUNCTION_RETCODE_TIMEOUT;
+
+	memcpy(buffer, response, response_count < count ? response_count : count);
+	return SWI_FUNCTION_RETCODE_SUCCESS;
+}
+
+void sha204EmulatorDevice::respond(const uint8_t *data, uint8_t length)
+{
+	uint16_t crc_register;
+
+	response_count = length + SHA204_RSP_SIZE_MIN - 1;
+	response[SHA204_BUFFER_POS_COUNT] = response_count;
+	memcpy(&response[1], data, length);
+	crc_register = crc(response, length + 1);
+	response[length + 1] = (uint8_t) crc_register;
+	response[length + 2] = (uint8_t) (crc_register >> 8);
+}
+
+void sha204EmulatorDevice::respondStatus(uint8_t status)
+{
+	respond(&status, 1);
+}
+
+void sha204EmulatorDevice::busyFor(uint8_t op_code)
+{
+	uint32_t typical, maximum, us = 0;
+
+	sha204_emulator_times(op_code, &typical, &maximum);
+	if (timing == SHA204_EMULATOR_TIMING_TYPICAL_A)
+		sha204_emulator_times_a(op_code, &typical);
+	if (timing == SHA204_EMULATOR_TIMING_TYPICAL || timing == SHA204_EMULATOR_TIMING_TYPICAL_A)
+		us = typical + typical / 10;
+	else if (timing == SHA204_EMULATOR_TIMING_MAX)
+		us = maximum;
+	ready_at = host_clock_us() + us;
+}
+
+// xorshift32; the device has a real random number generator.
+void sha204EmulatorDevice::random(uint8_t *buffer, uint8_t length)
+{
+	uint8_t i;
+
+	for (i = 0; i < length; i++) {
+		random_state ^= random_state << 13;
+		random_state ^= random_state >> 17;
+		random_state ^= random_state << 5;
+		buffer[i] = (uint8_t) random_state;
+	}
+}
+
+void sha204EmulatorDevice::execute(const uint8_t *command)
+{
+	uint8_t op_code = command[SHA204_OPCODE_IDX];
+	uint8_t buffer[32];
+
+	// A device answers a command only after its execution time,
+	// so the previous response disappears right away.
+	busyFor(op_code);
+
+	switch (op_code) {
+	case SHA204_DEVREV:
+		// the RevNum word of the configuration zone
+		respond(&config[4], 4);
+		break;
+
+	case SHA204_RANDOM:
+		if (config[CONFIG_LOCK_CONFIG] == LOCK_VALUE_UNLOCKED) {
+			// An unlocked device returns a fixed pattern.
+			memset(buffer, 0xFF, sizeof(buffer));
+			buffer[2] = buffer[3] = 0x00;
+		}
+		else
+			random(buffer, sizeof(buffer));
+		respond(buffer, sizeof(buffer));
+		break;
+
+	case SHA204_NONCE:
+		executeNonce(command);
+		break;
+
+	case SHA204_READ:
+		executeRead(command);
+		break;
+
+	case SHA204_WRITE:
+		executeWrite(command);
+		break;
+
+	case SHA204_LOCK:
+		executeLock(command);
+		break;
+
+	case SHA204_PAUSE:
+		respondStatus(SHA204_SUCCESS);
+		break;
+
+	case SHA204_GENDIG: case SHA204_MAC: case SHA204_CHECKMAC: case SHA204_DERIVE_KEY:
+		if (config[CONFIG_LOCK_VALUE] == LOCK_VALUE_UNLOCKED)
+			// Keys are used only once the data zone is locked.
+			respondStatus(SHA204_STATUS_BYTE_EXEC);
+		else if (op_code == SHA204_GENDIG)
+			executeGenDig(command);
+		else if (op_code == SHA204_MAC)
+			executeMac(command);
+		else if (op_code == SHA204_CHECKMAC)
+			executeCheckMac(command);
+		else
+			executeDeriveKey(command);
+		break;
+
+	case SHA204_HMAC: case SHA204_UPDATE_EXTRA:
+		respondStatus(SHA204_STATUS_BYTE_EXEC);
+		break;
+
+	default:
+		respondStatus(SHA204_STATUS_BYTE_PARSE);
+		break;
+	}
+}
+
+// Returns the zone bytes an access refers to, or NULL if it is out of range.
+uint8_t *sha204EmulatorDevice::zoneAddress(uint8_t zone, uint16_t address, uint8_t length)
+{
+	size_t offset;
+
+	// Addresses are word addresses. 32-byte accesses address whole blocks.
+	offset = (length == SHA204_ZONE_ACCESS_32) ? (address >> 3) * 32 : (size_t) address * 4;
+	switch (zone & SHA204_ZONE_MASK) {
+	case SHA204_ZONE_CONFIG:
+		return offset + length <= sizeof(config) ? &config[offset] : NULL;
+	case SHA204_ZONE_OTP:
+		return offset + length <= sizeof(otp) ? &otp[offset] : NULL;
+	case SHA204_ZONE_DATA:
+		return offset + length <= sizeof(data) ? &data[offset] : NULL;
+	}
+	return NULL;
+}
+
+void sha204EmulatorDevice::executeRead(const uint8_t *command)
+{
+	uint8_t zone = command[READ_ZONE_IDX];
+	uint8_t length = (zone & SHA204_ZONE_COUNT_FLAG) ? SHA204_ZONE_ACCESS_32 : SHA204_ZONE_ACCESS_4;
+	uint8_t *bytes = zoneAddress(zone, command[READ_ADDR_IDX] | command[READ_ADDR_IDX + 1] << 8, length);
+
+	if (!bytes || command[SHA204_BUFFER_POS_COUNT] != READ_COUNT)
+		respondStatus(SHA204_STATUS_BYTE_PARSE);
+	else if ((zone & SHA204_ZONE_MASK) != SHA204_ZONE_CONFIG && config[CONFIG_LOCK_VALUE] == LOCK_VALUE_UNLOCKED)
+		// Data and OTP can be read only after they have been locked.
+		respondStatus(SHA204_STATUS_BYTE_EXEC);
+	else
+		respond(bytes, length);
+}
+
+void sha204EmulatorDevice::executeWrite(const uint8_t *command)
+{
+	uint8_t zone = command[WRITE_ZONE_IDX];
+	uint8_t length = (zone & SHA204_ZONE_COUNT_FLAG) ? SHA204_ZONE_ACCESS_32 : SHA204_ZONE_ACCESS_4;
+	uint16_t address = command[WRITE_ADDR_IDX] | command[WRITE_ADDR_IDX + 1] << 8;
+	uint8_t *bytes = zoneAddress(zone, address, length);
+
+	if (!bytes || command[SHA204_BUFFER_POS_COUNT] < SHA204_CMD_SIZE_MIN + length)
+		respondStatus(SHA204_STATUS_BYTE_PARSE);
+	else if ((zone & SHA204_ZONE_MASK) == SHA204_ZONE_CONFIG
+			? config[CONFIG_LOCK_CONFIG] != LOCK_VALUE_UNLOCKED
+			: config[CONFIG_LOCK_VALUE] != LOCK_VALUE_UNLOCKED)
+		// Writes to locked zones need encryption, which is not emulated.
+		respondStatus(SHA204_STATUS_BYTE_EXEC);
+	else if ((zone & SHA204_ZONE_MASK) == SHA204_ZONE_CONFIG && (address * 4 < 16 || address * 4 >= 84))
+		// Serial number, revision and lock bytes are read-only.
+		respondStatus(SHA204_STATUS_BYTE_EXEC);
+	else {
+		memcpy(bytes, &command[WRITE_VALUE_IDX], length);
+		respondStatus(SHA204_SUCCESS);
+	}
+}
+
+void sha204EmulatorDevice::executeLock(const uint8_t *command)
+{
+	uint8_t zone = command[LOCK_ZONE_IDX];
+	uint16_t summary = command[LOCK_SUMMARY_IDX] | command[LOCK_SUMMARY_IDX + 1] << 8;
+	uint8_t lock_byte = (zone & LOCK_ZONE_NO_CONFIG) ? CONFIG_LOCK_VALUE : CONFIG_LOCK_CONFIG;
+	uint16_t zone_crc;
+
+	if ((zone & ~LOCK_ZONE_MASK) || command[SHA204_BUFFER_POS_COUNT] != LOCK_COUNT) {
+		respondStatus(SHA204_STATUS_BYTE_PARSE);
+		return;
+	}
+	if (config[lock_byte] != LOCK_VALUE_UNLOCKED
+			|| ((zone & LOCK_ZONE_NO_CONFIG) && config[CONFIG_LOCK_CONFIG] == LOCK_VALUE_UNLOCKED)) {
+		respondStatus(SHA204_STATUS_BYTE_EXEC);
+		return;
+	}
+	if (zone & LOCK_ZONE_NO_CONFIG)
+		zone_crc = crc(otp, sizeof(otp), crc(data, sizeof(data)));
+	else
+		zone_crc = crc(config, sizeof(config));
+	if (!(zone & LOCK_ZONE_NO_CRC) && zone_crc != summary) {
+		respondStatus(SHA204_STATUS_BYTE_EXEC);
+		return;
+	}
+	config[lock_byte] = 0x00;
+	respondStatus(SHA204_SUCCESS);
+}
+
+void sha204EmulatorDevice::executeNonce(const uint8_t *command)
+{
+	uint8_t mode = command[NONCE_MODE_IDX] & NONCE_MODE_MASK;
+	uint8_t count = command[SHA204_BUFFER_POS_COUNT];
+	uint8_t buffer[32];
+	uint8_t message[55];
+
+	if (mode == NONCE_MODE_PASSTHROUGH) {
+		if (count != NONCE_COUNT_LONG) {
+			respondStatus(SHA204_STATUS_BYTE_PARSE);
+			return;
+		}
+		memcpy(temp_key, &command[NONCE_INPUT_IDX], sizeof(temp_key));
+		temp_key_valid = true;
+		temp_key_source = 1;
+		respondStatus(SHA204_SUCCESS);
+		return;
+	}
+	if (mode == NONCE_MODE_INVALID || count != NONCE_COUNT_SHORT) {
+		respondStatus(SHA204_STATUS_BYTE_PARSE);
+		return;
+	}
+	random(buffer, sizeof(buffer));
+
+	// TempKey = SHA-256(RandOut, NumIn, opcode, mode, 0)
+	memcpy(message, buffer, 32);
+	memcpy(&message[32], &command[NONCE_INPUT_IDX], NONCE_NUMIN_SIZE);
+	message[52] = SHA204_NONCE;
+	message[53] = command[NONCE_MODE_IDX];
+	message[54] = 0x00;
+	sha256(message, 55, temp_key);
+	temp_key_valid = true;
+	temp_key_source = 0;
+	respond(buffer, sizeof(buffer));
+}
+
+// Appends SN[8] and SN[0:1] and the zero padding that GenDig and DeriveKey hash.
+void sha204EmulatorDevice::serialTail(uint8_t *message)
+{
+	message[0] = config[CONFIG_SN8];
+	message[1] = config[0];
+	message[2] = config[1];
+	memset(&message[3], 0, 25);
+}
+
+// TempKey = SHA-256(key, opcode, param1, param2 or other data, SN[8], SN[0:1], 25 zeros, TempKey)
+void sha204EmulatorDevice::executeGenDig(const uint8_t *command)
+{
+	uint8_t zone = command[GENDIG_ZONE_IDX];
+	uint8_t key_id = command[GENDIG_KEYID_IDX];
+	uint8_t count = command[SHA204_BUFFER_POS_COUNT];
+	uint8_t message[96];
+	const uint8_t *key = NULL;
+
+	if (zone == GENDIG_ZONE_DATA && key_id < SHA204_EMULATOR_SLOTS)
+		key = &data[key_id * SHA204_EMULATOR_SLOT_SIZE];
+	else if (zone == GENDIG_ZONE_OTP && key_id < SHA204_EMULATOR_OTP_SIZE / 32)
+		key = &otp[key_id * 32];
+	if (!key || (count != GENDIG_COUNT && count != GENDIG_COUNT_DATA) || command[GENDIG_KEYID_IDX + 1]) {
+		respondStatus(SHA204_STATUS_BYTE_PARSE);
+		return;
+	}
+	if (!temp_key_valid) {
+		respondStatus(SHA204_STATUS_BYTE_EXEC);
+		return;
+	}
+
+	memcpy(message, key, 32);
+	memcpy(&message[32], count == GENDIG_COUNT_DATA ? &command[GENDIG_DATA_IDX] : command + SHA204_OPCODE_IDX, 4);
+	serialTail(&message[36]);
+	memcpy(&message[64], temp_key, 32);
+	sha256Keyed(message, zone == GENDIG_ZONE_DATA ? key_id : SHA204_EMULATOR_NO_MIDSTATE, temp_key);
+	respondStatus(SHA204_SUCCESS);
+}
+
+// Checks the TempKey a command wants to use. Returns false after loading an error response.
+bool sha204EmulatorDevice::checkTempKey(uint8_t mode)
+{
+	if (!temp_key_valid || ((mode & MAC_MODE_SOURCE_FLAG_MATCH) ? 1 : 0) != temp_key_source) {
+		respondStatus(SHA204_STATUS_BYTE_EXEC);
+		return false;
+	}
+	return true;
+}
+
+// Response = SHA-256(key or TempKey, challenge or TempKey, opcode, mode, key id,
+// OTP[0:10] or zeros, SN[8], SN[4:7] or zeros, SN[0:1], SN[2:3] or zeros)
+void sha204EmulatorDevice::executeMac(const uint8_t *command)
+{
+	uint8_t mode = command[MAC_MODE_IDX];
+	uint8_t key_id = command[MAC_KEYID_IDX];
+	uint8_t count = command[SHA204_BUFFER_POS_COUNT];
+	uint8_t message[88];
+	uint8_t digest[32];
+	bool use_temp_key = mode & (MAC_MODE_BLOCK1_TEMPKEY | MAC_MODE_BLOCK2_TEMPKEY);
+
+	if ((mode & ~MAC_MODE_MASK) || key_id >= SHA204_EMULATOR_SLOTS || command[MAC_KEYID_IDX + 1]
+			|| count != ((mode & MAC_MODE_BLOCK2_TEMPKEY) ? MAC_COUNT_SHORT : MAC_COUNT_LONG)) {
+		respondStatus(SHA204_STATUS_BYTE_PARSE);
+		return;
+	}
+	if (use_temp_key && !checkTempKey(mode))
+		return;
+
+	memcpy(message, (mode & MAC_MODE_BLOCK1_TEMPKEY) ? temp_key : &data[key_id * SHA204_EMULATOR_SLOT_SIZE], 32);
+	memcpy(&message[32], (mode & MAC_MODE_BLOCK2_TEMPKEY) ? temp_key : &command[MAC_CHALLENGE_IDX], 32);
+	messageTail(&message[64], command + SHA204_OPCODE_IDX,
+			mode & (MAC_MODE_INCLUDE_OTP_88 | MAC_MODE_INCLUDE_OTP_64),
+			(mode & MAC_MODE_INCLUDE_OTP_88) != 0, (mode & MAC_MODE_INCLUDE_SN) != 0);
+	sha256(message, sizeof(message), digest);
+	if (use_temp_key)
+		temp_key_valid = false;
+	respond(digest, sizeof(digest));
+}
+
+// Fills the 24 bytes that follow the two key blocks of MAC and CheckMac.
+void sha204EmulatorDevice::messageTail(uint8_t *message, const uint8_t *header, bool otp_64, bool otp_88, bool serial)
+{
+	memcpy(message, header, 4);
+	memset(&message[4], 0, 11);
+	if (otp_64 || otp_88)
+		memcpy(&message[4], otp, 8);
+	if (otp_88)
+		memcpy(&message[12], &otp[8], 3);
+	message[15] = config[CONFIG_SN8];
+	memset(&message[16], 0, 4);
+	if (serial)
+		memcpy(&message[16], &config[8], 4);
+	message[20] = config[0];
+	message[21] = config[1];
+	message[22] = serial ? config[2] : 0;
+	message[23] = serial ? config[3] : 0;
+}
+
+// Computes the MAC a client would have returned and compares it with the client response.
+void sha204EmulatorDevice::executeCheckMac(const uint8_t *command)
+{
+	uint8_t mode = command[CHECKMAC_MODE_IDX];
+	uint8_t key_id = command[CHECKMAC_KEYID_IDX];
+	const uint8_t *other_data = &command[CHECKMAC_DATA_IDX];
+	uint8_t message[88];
+	uint8_t digest[32];
+	bool use_temp_key = mode & (CHECKMAC_MODE_BLOCK1_TEMPKEY | CHECKMAC_MODE_BLOCK2_TEMPKEY);
+
+	if ((mode & ~CHECKMAC_MODE_MASK) || key_id >= SHA204_EMULATOR_SLOTS || command[CHECKMAC_KEYID_IDX + 1]
+			|| command[SHA204_BUFFER_POS_COUNT] != CHECKMAC_COUNT) {
+		respondStatus(SHA204_STATUS_BYTE_PARSE);
+		return;
+	}
+	if (use_temp_key && !checkTempKey(mode))
+		return;
+
+	// CheckMac hashes the other data where MAC hashes its own header and the serial number bytes.
+	memcpy(message, (mode & CHECKMAC_MODE_BLOCK1_TEMPKEY) ? temp_key : &data[key_id * SHA204_EMULATOR_SLOT_SIZE], 32);
+	memcpy(&message[32], (mode & CHECKMAC_MODE_BLOCK2_TEMPKEY) ? temp_key : &command[CHECKMAC_CLIENT_CHALLENGE_IDX], 32);
+	messageTail(&message[64], other_data, (mode & CHECKMAC_MODE_INCLUDE_OTP_64) != 0, false, false);
+	memcpy(&message[76], &other_data[4], 3);
+	memcpy(&message[80], &other_data[7], 4);
+	memcpy(&message[86], &other_data[11], 2);
+	sha256(message, sizeof(message), digest);
+	if (use_temp_key)
+		temp_key_valid = false;
+	respondStatus(memcmp(digest, &command[CHECKMAC_CLIENT_RESPONSE_IDX], sizeof(digest)) ? SHA204_STATUS_BYTE_MISCOMPARE : SHA204_SUCCESS);
+}
+
+// SHA-256 of a 96-byte GenDig or DeriveKey message. Its first block holds the key, the
+// command header and serial number bytes only, so the state after it is kept per slot
+// and command and reused as long as the block is the same. Comparing the block instead
+// of tracking writes keeps the cache right when a test changes the zones directly.
+void sha204EmulatorDevice::sha256Keyed(const uint8_t *message, uint8_t index, uint8_t *digest)
+{
+	Midstate *midstate;
+	uint32_t state[8];
+
+	if (!midstate_cache || index == SHA204_EMULATOR_NO_MIDSTATE) {
+		sha256(message, 96, digest);
+		return;
+	}
+	midstate = &midstates[index];
+	if (midstate->valid && !memcmp(midstate->block, message, sizeof(midstate->block)))
+		midstate_hits++;
+	else {
+		memcpy(midstate->state, sha256_iv, sizeof(midstate->state));
+		sha256_block(midstate->state, message);
+		memcpy(midstate->block, message, sizeof(midstate->block));
+		midstate->valid = true;
+	}
+	memcpy(state, midstate->state, sizeof(state));
+	sha256_finish(state, &message[64], 32, 96, digest);
+}
+
+// Key = SHA-256(parent key, opcode, mode, target key, SN[8], SN[0:1], 25 zeros, TempKey).
+// The parent is the target slot itself, or its WriteKey if the slot is set up to create keys.
+// The MAC of an authorized DeriveKey is not checked.
+void sha204EmulatorDevice::executeDeriveKey(const uint8_t *command)
+{
+	uint8_t mode = command[DERIVE_KEY_RANDOM_IDX];
+	uint8_t target = command[DERIVE_KEY_TARGETKEY_IDX];
+	uint8_t count = command[SHA204_BUFFER_POS_COUNT];
+	uint8_t message[96];
+	uint16_t slot_config;
+	uint8_t parent;
+
+	if ((mode & ~DERIVE_KEY_RANDOM_FLAG) || target >= SHA204_EMULATOR_SLOTS || command[DERIVE_KEY_TARGETKEY_IDX + 1]
+			|| (count != DERIVE_KEY_COUNT_SMALL && count != DERIVE_KEY_COUNT_LARGE)) {
+		respondStatus(SHA204_STATUS_BYTE_PARSE);
+		return;
+	}
+	slot_config = config[CONFIG_SLOT_CONFIG + 2 * target] | config[CONFIG_SLOT_CONFIG + 2 * target + 1] << 8;
+	if (!(slot_config & SLOT_DERIVE_KEY)) {
+		respondStatus(SHA204_STATUS_BYTE_EXEC);
+		return;
+	}
+	if (!checkTempKey(mode))
+		return;
+
+	parent = (slot_config & SLOT_DERIVE_KEY_CREATE) ? SLOT_WRITE_KEY(slot_config) : target;
+	memcpy(message, &data[parent * SHA204_EMULATOR_SLOT_SIZE], 32);
+	memcpy(&message[32], command + SHA204_OPCODE_IDX, 4);
+	serialTail(&message[36]);
+	memcpy(&message[64], temp_key, 32);
+	sha256Keyed(message, SHA204_EMULATOR_SLOTS + target, &data[target * SHA204_EMULATOR_SLOT_SIZE]);
+	temp_key_valid = false;
+	respondStatus(SHA204_SUCCESS);
+}
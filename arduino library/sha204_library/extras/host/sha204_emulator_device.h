@@ -0,0 +1,112 @@
+/* In-process device stand-in that executes commands
+
+   The emulator keeps configuration, data and OTP zones and answers DevRev,
+   Random, Nonce, Read, Write, Lock and Pause like a device would, including
+   count byte, CRC, status codes, execution time and the watchdog. Once the
+   data zone is locked, GenDig, MAC, CheckMac and DeriveKey compute the
+   digests of the data sheet, so MACs of two emulators can be checked against
+   each other. HMAC and UpdateExtra answer with an execution error. Responses
+   become available after the execution time selected with setTiming(), in
+   the virtual time of the host Arduino core. Until then, flags and commands
+   are ignored as they are by a device that is still executing.
+
+   Derived classes can override execute() or inspect the response members to
+   alter what the library sees. */
+
+#ifndef SHA204_EMULATOR_DEVICE_H
+#define SHA204_EMULATOR_DEVICE_H
+
+#include "Arduino.h"
+#include "sha204_library.h"
+
+#define SHA204_EMULATOR_SLOTS          (16)         //!< number of data slots
+#define SHA204_EMULATOR_SLOT_SIZE      (32)         //!< size of a data slot in bytes
+#define SHA204_EMULATOR_OTP_SIZE       (64)         //!< size of the OTP zone in bytes
+#define SHA204_EMULATOR_WATCHDOG       (1300000UL)  //!< typical watchdog period in us
+#define SHA204_EMULATOR_MIDSTATES      (2 * SHA204_EMULATOR_SLOTS)  //!< GenDig and DeriveKey states kept per slot
+#define SHA204_EMULATOR_NO_MIDSTATE    ((uint8_t) 0xFF)  //!< hash without the cache
+
+#define SHA204_EMULATOR_TIMING_INSTANT ((uint8_t) 0) //!< responses are ready right after the command
+#define SHA204_EMULATOR_TIMING_TYPICAL ((uint8_t) 1) //!< typical execution times plus 10 %
+#define SHA204_EMULATOR_TIMING_MAX     ((uint8_t) 2) //!< maximum execution times
+#define SHA204_EMULATOR_TIMING_TYPICAL_A ((uint8_t) 3) //!< typical execution times of the ATSHA204A plus 10 %
+
+class sha204EmulatorDevice : public sha204HostDevice
+{
+public:
+	sha204EmulatorDevice();
+
+	void setTiming(uint8_t timing) { this->timing = timing; }
+	//! Sets the watchdog period in us. 0 disables the watchdog.
+	void setWatchdog(uint32_t period_us) { watchdog_us = period_us; }
+	bool isAwake();
+	unsigned long commandCount() { return command_count; }
+	//! Turns reusing the SHA-256 state after the first block of GenDig and DeriveKey on or off.
+	void setMidstateCache(bool enabled) { midstate_cache = enabled; }
+	//! GenDig and DeriveKey digests that started from a kept state
+	unsigned long midstateHits() { return midstate_hits; }
+
+	//! CRC used by the device, computed over any length.
+	static uint16_t crc(const uint8_t *data, size_t length, uint16_t crc_register = 0);
+
+	void wake();
+	uint8_t send(uint8_t count, const uint8_t *buffer);
+	uint8_t receive(uint8_t count, uint8_t *buffer);
+
+	uint8_t config[SHA204_CONFIG_SIZE];
+	uint8_t data[SHA204_EMULATOR_SLOTS * SHA204_EMULATOR_SLOT_SIZE];
+	uint8_t otp[SHA204_EMULATOR_OTP_SIZE];
+	uint8_t temp_key[32];
+	bool temp_key_valid;
+	uint8_t temp_key_source;   //!< SourceFlag: 1 after a pass-through nonce, 0 after a random one
+
+protected:
+	//! Executes a command packet whose count byte and CRC have been checked.
+	virtual void execute(const uint8_t *command);
+	//! Loads the output buffer with a response carrying data.
+	void respond(const uint8_t *data, uint8_t length);
+	//! Loads the output buffer with a status response.
+	void respondStatus(uint8_t status);
+	//! Makes the response available after the execution time of op_code.
+	void busyFor(uint8_t op_code);
+	void random(uint8_t *buffer, uint8_t length);
+
+	uint8_t response[SHA204_RSP_SIZE_MAX];
+	uint8_t response_count;
+	uint64_t ready_at;
+	uint64_t wake_at;
+	bool awake;
+	bool expect_command;
+	uint8_t timing;
+	uint32_t watchdog_us;
+	uint32_t random_state;
+	unsigned long command_count;
+
+private:
+	//! SHA-256 state after the first block of a message
+	struct Midstate
+	{
+		uint8_t block[64];
+		uint32_t state[8];
+		bool valid;
+	};
+	Midstate midstates[SHA204_EMULATOR_MIDSTATES];
+	bool midstate_cache;
+	unsigned long midstate_hits;
+	void sha256Keyed(const uint8_t *message, uint8_t index, uint8_t *digest);
+
+	uint8_t *zoneAddress(uint8_t zone, uint16_t address, uint8_t length);
+	void executeRead(const uint8_t *command);
+	void executeWrite(const uint8_t *command);
+	void executeLock(const uint8_t *command);
+	void executeNonce(const uint8_t *command);
+	void executeGenDig(const uint8_t *command);
+	void executeMac(const uint8_t *command);
+	void executeCheckMac(const uint8_t *command);
+	void executeDeriveKey(const uint8_t *command);
+	bool checkTempKey(uint8_t mode);
+	void serialTail(uint8_t *message);
+	void messageTail(uint8_t *message, const uint8_t *header, bool otp_64, bool otp_88, bool serial);
+};
+
+#endif
@@ -0,0 +1,124 @@
+#include "sha204_fault_device.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+static const char *const sha204_fault_names[SHA204_FAULTS] = {
+	"flip_command", "flip_response", "drop_response", "count_ff", "busy", "watchdog", "dead"
+};
+
+sha204FaultDevice::sha204FaultDevice()
+{
+	noise_state = 0x9E3779B9;
+	command_follows = false;
+	memset(injected_count, 0, sizeof(injected_count));
+	clear();
+}
+
+const char *sha204FaultDevice::name(uint8_t fault)
+{
+	return fault < SHA204_FAULTS ? sha204_fault_names[fault] : "none";
+}
+
+void sha204FaultDevice::inject(uint8_t fault, uint8_t count)
+{
+	if (fault < SHA204_FAULTS)
+		pending[fault] = count;
+}
+
+void sha204FaultDevice::setNoise(uint8_t fault, double probability)
+{
+	if (fault < SHA204_FAULTS)
+		noise[fault] = probability;
+}
+
+void sha204FaultDevice::clear()
+{
+	uint8_t fault;
+
+	for (fault = 0; fault < SHA204_FAULTS; fault++) {
+		pending[fault] = 0;
+		noise[fault] = 0.0;
+	}
+}
+
+// xorshift32, separate from the emulated random number generator
+// so that noise does not change the data the device returns.
+uint32_t sha204FaultDevice::noiseRandom()
+{
+	noise_state ^= noise_state << 13;
+	noise_state ^= noise_state >> 17;
+	noise_state ^= noise_state << 5;
+	return noise_state;
+}
+
+bool sha204FaultDevice::trigger(uint8_t fault)
+{
+	if (pending[fault])
+		pending[fault]--;
+	else if (noise[fault] <= 0.0 || noiseRandom() >= noise[fault] * 4294967296.0)
+		return false;
+	injected_count[fault]++;
+	return true;
+}
+
+uint8_t sha204FaultDevice::send(uint8_t count, const uint8_t *buffer)
+{
+	uint8_t packet[SHA204_CMD_SIZE_MAX];
+
+	if (command_follows) {
+		command_follows = false;
+		if (count <= sizeof(packet) && trigger(SHA204_FAULT_FLIP_COMMAND)) {
+			memcpy(packet, buffer, count);
+			packet[noiseRandom() % count] ^= 1 << (noiseRandom() & 7);
+			return sha204EmulatorDevice::send(count, packet);
+		}
+		return sha204EmulatorDevice::send(count, buffer);
+	}
+
+	if (count == 1 && buffer[0] == SHA204_SWI_FLAG_CMD) {
+		command_follows = isAwake();
+		if (command_follows && trigger(SHA204_FAULT_WATCHDOG)) {
+			// The device falls asleep and ignores the command.
+			awake = false;
+			temp_key_valid = false;
+			command_follows = false;
+		}
+	}
+	return sha204EmulatorDevice::send(count, buffer);
+}
+
+void sha204FaultDevice::execute(const uint8_t *command)
+{
+	sha204EmulatorDevice::execute(command);
+	if (trigger(SHA204_FAULT_BUSY))
+		ready_at += (uint64_t) SHA204_COMMAND_EXEC_MAX * 1000 + SHA204_RESPONSE_TIMEOUT;
+}
+
+uint8_t sha204FaultDevice::receive(uint8_t count, uint8_t *buffer)
+{
+	uint8_t status, length, index;
+
+	// Only polls the device would answer count, so that a dead device
+	// costs the library a response it would otherwise have received.
+	if (isAwake() && response_count && host_clock_us() >= ready_at && trigger(SHA204_FAULT_DEAD))
+		return SWI_FUNCTION_RETCODE_TIMEOUT;
+
+	status = sha204EmulatorDevice::receive(count, buffer);
+	if (status != SWI_FUNCTION_RETCODE_SUCCESS)
+		return status;
+	length = response_count < count ? response_count : count;
+
+	if (trigger(SHA204_FAULT_COUNT_FF)) {
+		memset(buffer, 0xFF, count);
+		return SWI_FUNCTION_RETCODE_SUCCESS;
+	}
+	if (trigger(SHA204_FAULT_FLIP_RESPONSE))
+		buffer[noiseRandom() % length] ^= 1 << (noiseRandom() & 7);
+	if (trigger(SHA204_FAULT_DROP_RESPONSE)) {
+		// The receiver times out waiting for the last byte.
+		index = noiseRandom() % length;
+		memmove(&buffer[index], &buffer[index + 1], length - index - 1);
+		buffer[length - 1] = 0;
+		return SWI_FUNCTION_RETCODE_RX_FAIL;
+	}
+	return SWI_FUNCTION_RETCODE_SUCCESS;
+}
@@ -0,0 +1,53 @@
+/* Emulated device with a scripted fault injector
+
+   Faults are injected either into the next occasions they apply to, with
+   inject(), or at random with a given probability per occasion, with
+   setNoise(). The occasion of a fault is given next to its code. */
+
+#ifndef SHA204_FAULT_DEVICE_H
+#define SHA204_FAULT_DEVICE_H
+
+#include "sha204_emulator_device.h"
+
+#define SHA204_FAULT_FLIP_COMMAND    ((uint8_t) 0)   //!< command packet: one bit flips on the way to the device
+#define SHA204_FAULT_FLIP_RESPONSE   ((uint8_t) 1)   //!< response: one bit flips on the way to the host
+#define SHA204_FAULT_DROP_RESPONSE   ((uint8_t) 2)   //!< response: one byte is lost
+#define SHA204_FAULT_COUNT_FF        ((uint8_t) 3)   //!< response: reads as 0xFF, as when out of sync
+#define SHA204_FAULT_BUSY            ((uint8_t) 4)   //!< command: device stays busy past the maximum execution time
+#define SHA204_FAULT_WATCHDOG        ((uint8_t) 5)   //!< command flag: watchdog expires right before the command
+#define SHA204_FAULT_DEAD            ((uint8_t) 6)   //!< response: device does not answer although the response is ready
+#define SHA204_FAULTS                (7)
+
+class sha204FaultDevice : public sha204EmulatorDevice
+{
+public:
+	sha204FaultDevice();
+
+	//! Injects fault into its next count occasions.
+	void inject(uint8_t fault, uint8_t count = 1);
+	//! Injects fault with probability at every occasion. 0 turns the noise off.
+	void setNoise(uint8_t fault, double probability);
+	//! Cancels all pending faults and noise.
+	void clear();
+	//! Number of times fault has been injected.
+	unsigned long injected(uint8_t fault) { return injected_count[fault]; }
+	static const char *name(uint8_t fault);
+
+	uint8_t send(uint8_t count, const uint8_t *buffer);
+	uint8_t receive(uint8_t count, uint8_t *buffer);
+
+protected:
+	void execute(const uint8_t *command);
+
+private:
+	bool trigger(uint8_t fault);
+	uint32_t noiseRandom();
+
+	uint8_t pending[SHA204_FAULTS];
+	double noise[SHA204_FAULTS];
+	unsigned long injected_count[SHA204_FAULTS];
+	uint32_t noise_state;
+	bool command_follows;
+};
+
+#endif
@@ -0,0 +1,141 @@
+/* Measures how the library recovers from bus and device faults.
+
+   Build from the library directory and run:
+
+     g++ -O2 -DSHA204_SWI_HOST -Iextras/host -I. *.cpp extras/host/arduino_host.cpp \
+         extras/host/sha204_emulator_device.cpp extras/host/sha204_fault_device.cpp \
+         extras/host/sha204_faults.cpp -o sha204_faults
+     ./sha204_faults [iterations]
+
+   Every iteration wakes the device and reads the first 32 bytes of the
+   configuration zone with one fault injected. An iteration succeeds if the
+   library returns SHA204_SUCCESS with the correct bytes; correct bytes with an
+   error code count as failures, wrong bytes with SHA204_SUCCESS as corrupt.
+   The dead rows drop the first polls that would have found the response
+   ready: one, three or all of them. The noise_ rows inject command flips,
+   response flips and dropped response bytes at random with the given
+   probability per packet. In the deadline_abort rows a Random with a 5 ms
+   deadline comes first, and the read has to find the device ready for it.
+   The fast_ rows use a retry policy that re-synchronizes by waking the device
+   right away and gives up after 40 ms with SHA204_DEADLINE.
+
+   Results are printed as comma separated lines:
+   fault,iterations,success_rate,corrupt,p50_us,p99_us,max_us,injected
+   Latencies are bus time in virtual us from sending the command to the return
+   of sha204m_execute(). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+#include "sha204_fault_device.h"
+
+static sha204FaultDevice device;
+static atsha204Class sha204(0);
+static const sha204_retry_policy_t fast_policy = {1, 1, SHA204_RESYNC_WAKE, 0, 5, 0, 40};
+static const sha204_retry_policy_t abort_policy = {1, 1, SHA204_RESYNC_WAKE, 0, 5, 0, 5};
+
+static int compare_latency(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+// Runs iterations reads with fault injected once, or with noise if probability is not 0.
+// With abort set, each read follows a Random that gives up on a 5 ms deadline.
+static void run(const char *name, unsigned long iterations, uint8_t fault, uint8_t count, double probability,
+		bool abort = false)
+{
+	uint8_t tx_buffer[READ_COUNT];
+	uint8_t rx_buffer[READ_32_RSP_SIZE];
+	uint32_t *latency = (uint32_t *) malloc(iterations * sizeof(*latency));
+	unsigned long i, successes = 0, corrupt = 0, injected = 0;
+
+	if (!latency)
+		return;
+	for (i = 0; i < iterations; i++) {
+		uint8_t f, ret_code;
+		bool correct;
+
+		device.clear();
+		sha204.sha204p_sleep();
+		sha204.sha204c_wakeup(rx_buffer);
+
+		for (f = 0; f < SHA204_FAULTS; f++)
+			injected -= device.injected(f);
+		if (probability > 0.0) {
+			device.setNoise(SHA204_FAULT_FLIP_COMMAND, probability);
+			device.setNoise(SHA204_FAULT_FLIP_RESPONSE, probability);
+			device.setNoise(SHA204_FAULT_DROP_RESPONSE, probability);
+		}
+		else if (fault < SHA204_FAULTS)
+			device.inject(fault, count);
+
+		if (abort) {
+			const sha204_retry_policy_t *policy = sha204.getRetryPolicy();
+
+			sha204.setRetryPolicy(&abort_policy);
+			sha204.sha204m_random(tx_buffer, rx_buffer, RANDOM_NO_SEED_UPDATE);
+			sha204.setRetryPolicy(policy);
+		}
+
+		uint64_t start = host_clock_us();
+		ret_code = sha204.sha204m_read(tx_buffer, rx_buffer, SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG, 0);
+		latency[i] = (uint32_t) (host_clock_us() - start);
+
+		for (f = 0; f < SHA204_FAULTS; f++)
+			injected += device.injected(f);
+		correct = rx_buffer[SHA204_BUFFER_POS_COUNT] == READ_32_RSP_SIZE
+				&& !memcmp(&rx_buffer[SHA204_BUFFER_POS_DATA], device.config, SHA204_ZONE_ACCESS_32);
+		if (ret_code == SHA204_SUCCESS && correct)
+			successes++;
+		else if (ret_code == SHA204_SUCCESS)
+			corrupt++;
+	}
+
+	qsort(latency, iterations, sizeof(*latency), compare_latency);
+	printf("%s,%lu,%.4f,%lu,%lu,%lu,%lu,%lu\n", name, iterations, (double) successes / iterations, corrupt,
+			(unsigned long) latency[(iterations - 1) * 50 / 100], (unsigned long) latency[(iterations - 1) * 99 / 100],
+			(unsigned long) latency[iterations - 1], injected);
+	free(latency);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000;
+	uint8_t fault;
+
+	if (!iterations) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 2;
+	}
+	device.setTiming(SHA204_EMULATOR_TIMING_TYPICAL);
+	device.setWatchdog(0);
+	sha204.setHostDevice(&device);
+
+	printf("fault,iterations,success_rate,corrupt,p50_us,p99_us,max_us,injected\n");
+	run("none", iterations, SHA204_FAULTS, 0, 0.0);
+	for (fault = 0; fault < SHA204_FAULTS; fault++)
+		run(sha204FaultDevice::name(fault), iterations, fault, 1, 0.0);
+	run("busy_twice", iterations, SHA204_FAULT_BUSY, 2, 0.0);
+	run("dead_3", iterations, SHA204_FAULT_DEAD, 3, 0.0);
+	run("dead_permanent", iterations / 10 + 1, SHA204_FAULT_DEAD, 255, 0.0);
+	run("deadline_abort", iterations, SHA204_FAULTS, 0, 0.0, true);
+	run("noise_0.01", iterations, SHA204_FAULTS, 0, 0.01);
+	run("noise_0.05", iterations, SHA204_FAULTS, 0, 0.05);
+	run("noise_0.20", iterations, SHA204_FAULTS, 0, 0.20);
+
+	sha204.setRetryPolicy(&fast_policy);
+	for (fault = 0; fault < SHA204_FAULTS; fault++) {
+		char name[32];
+		snprintf(name, sizeof(name), "fast_%s", sha204FaultDevice::name(fault));
+		run(name, iterations, fault, 1, 0.0);
+	}
+	run("fast_busy_twice", iterations, SHA204_FAULT_BUSY, 2, 0.0);
+	run("fast_dead_3", iterations, SHA204_FAULT_DEAD, 3, 0.0);
+	run("fast_dead_permanent", iterations / 10 + 1, SHA204_FAULT_DEAD, 255, 0.0);
+	run("fast_deadline_abort", iterations, SHA204_FAULTS, 0, 0.0, true);
+	run("fast_noise_0.05", iterations, SHA204_FAULTS, 0, 0.05);
+	return 0;
+}
@@ -0,0 +1,124 @@
+/* Measures the time sha204Provisioner needs per device on a desktop host.
+
+   Build from the library directory and run:
+
+     g++ -O2 -DSHA204_SWI_HOST -Iextras/host -I. *.cpp extras/host/arduino_host.cpp \
+         extras/host/sha204_emulator_device.cpp extras/host/sha204_provision.cpp -o sha204_provision
+     ./sha204_provision
+
+   Every scenario starts from a new sha204EmulatorDevice with typical timing.
+   The image reconfigures all slots, writes all slots and OTP, and locks both
+   zones. The baseline writes every configuration word with its own 4-byte
+   write, locks the configuration with sha204e_lock_config_zone(), which reads
+   the zone back for the summary, and locks the data zone without a summary.
+   Results are printed as comma separated lines:
+   scenario,ret_code,commands,reads,writes,locks,unchanged_words,ms
+   ms is virtual bus time from the wake pulse to the last response. */
+
+#include <stdio.h>
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+#include "sha204_emulator_device.h"
+
+static uint8_t config[SHA204_PROVISION_CONFIG_SIZE];
+static uint8_t data[SHA204_PROVISION_SLOT_COUNT * SHA204_ZONE_ACCESS_32];
+static uint8_t otp[SHA204_PROVISION_OTP_SIZE];
+
+static const sha204_image_t image = {
+	config, data, 0xFFFF, otp, SHA204_PROVISION_LOCK_CONFIG | SHA204_PROVISION_LOCK_DATA, 0, 0
+};
+
+// Slots 0 to 7 hold secret keys that are never written again, slots 8 to 15 public data.
+static void make_image()
+{
+	sha204EmulatorDevice blank;
+	size_t i;
+
+	memcpy(config, &blank.config[SHA204_PROVISION_CONFIG_START], sizeof(config));
+	for (i = 0; i < SHA204_PROVISION_SLOT_COUNT; i++) {
+		config[ADDRESS_SLOTCONFIG - SHA204_PROVISION_CONFIG_START + 2 * i] = i < 8 ? 0x8F : 0x00;
+		config[ADDRESS_SLOTCONFIG - SHA204_PROVISION_CONFIG_START + 2 * i + 1] = i < 8 ? 0x80 : 0x00;
+	}
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (uint8_t) (i * 7 + 1);
+	for (i = 0; i < sizeof(otp); i++)
+		otp[i] = (uint8_t) i;
+}
+
+static bool matches(sha204EmulatorDevice &device)
+{
+	return !memcmp(&device.config[SHA204_PROVISION_CONFIG_START], config, sizeof(config))
+			&& !memcmp(device.data, data, sizeof(data)) && !memcmp(device.otp, otp, sizeof(otp))
+			&& device.config[ADDRESS_LOCKCONFIG] == 0x00 && device.config[ADDRESS_LOCKVALUE] == 0x00;
+}
+
+static void report(const char *name, uint8_t ret_code, unsigned long commands, unsigned reads,
+		unsigned writes, unsigned locks, unsigned unchanged, unsigned long us)
+{
+	printf("%s,0x%02X,%lu,%u,%u,%u,%u,%.1f\n", name, ret_code, commands, reads, writes, locks, unchanged, us / 1000.0);
+}
+
+static void run(const char *name, sha204EmulatorDevice &device)
+{
+	atsha204Class sha204(0);
+	sha204Provisioner provisioner(sha204);
+	sha204_provision_result_t result;
+	unsigned long commands = device.commandCount();
+
+	device.setTiming(SHA204_EMULATOR_TIMING_TYPICAL);
+	sha204.setHostDevice(&device);
+	provisioner.provision(&image, &result);
+	report(name, result.ret_code, device.commandCount() - commands, result.reads, result.writes,
+			result.locks, result.unchanged, result.total_us);
+	if (result.ret_code == SHA204_SUCCESS && !matches(device))
+		fprintf(stderr, "%s: device does not match the image\n", name);
+}
+
+static void baseline()
+{
+	sha204EmulatorDevice device;
+	atsha204Class sha204(0);
+	uint8_t command[WRITE_COUNT_LONG];
+	uint8_t response[READ_32_RSP_SIZE];
+	uint16_t address;
+	uint8_t ret_code;
+	unsigned long start_us;
+
+	device.setTiming(SHA204_EMULATOR_TIMING_TYPICAL);
+	sha204.setHostDevice(&device);
+	start_us = host_clock_us();
+	ret_code = sha204.sha204c_wakeup(response);
+	for (address = 0; address < sizeof(config) && ret_code == SHA204_SUCCESS; address += SHA204_ZONE_ACCESS_4)
+		ret_code = sha204.sha204m_write(command, response, SHA204_ZONE_CONFIG,
+				SHA204_PROVISION_CONFIG_START + address, &config[address], NULL);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = sha204.sha204e_lock_config_zone();
+	for (address = 0; address < sizeof(data) && ret_code == SHA204_SUCCESS; address += SHA204_ZONE_ACCESS_32)
+		ret_code = sha204.sha204m_write(command, response, SHA204_ZONE_DATA | SHA204_ZONE_COUNT_FLAG,
+				address, &data[address], NULL);
+	for (address = 0; address < sizeof(otp) && ret_code == SHA204_SUCCESS; address += SHA204_ZONE_ACCESS_32)
+		ret_code = sha204.sha204m_write(command, response, SHA204_ZONE_OTP | SHA204_ZONE_COUNT_FLAG,
+				address, &otp[address], NULL);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = sha204.sha204m_lock(command, response, LOCK_ZONE_NO_CONFIG | LOCK_ZONE_NO_CRC, 0);
+	unsigned long us = host_clock_us() - start_us;
+	sha204.sha204p_sleep();
+	report("baseline_word_writes", ret_code, device.commandCount(), 0, 0, 0, 0, us);
+}
+
+int main()
+{
+	sha204EmulatorDevice blank, resumed;
+
+	make_image();
+	printf("scenario,ret_code,commands,reads,writes,locks,unchanged_words,ms\n");
+	baseline();
+	run("provision_blank", blank);
+	run("provision_again", blank);
+
+	// A device whose configuration was written by an earlier run that stopped before the lock.
+	memcpy(&resumed.config[SHA204_PROVISION_CONFIG_START], config, sizeof(config));
+	run("provision_resumed", resumed);
+	return 0;
+}
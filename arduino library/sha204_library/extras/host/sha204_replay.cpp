@@ -0,0 +1,126 @@
+/* Replays a packet capture through the library on a desktop host.
+
+   Record a capture on the target with SHA204_CAPTURE defined, write it out with
+   captureExport() and save the bytes to a file. Then build from the library
+   directory and run:
+
+     g++ -O2 -DSHA204_SWI_HOST -Iextras/host -I. *.cpp extras/host/arduino_host.cpp \
+         extras/host/sha204_replay_device.cpp extras/host/sha204_replay.cpp -o sha204_replay
+     ./sha204_replay capture.bin
+
+   Every captured command is rebuilt with sha204m_execute() and sent through the
+   communication layer, including CRC calculation and the retry logic, while the
+   captured responses stand in for the device. One line is printed per command:
+   index,op_code,ret_code,latency_us (virtual time). The exit code is 1 if any
+   rebuilt packet or the sequence of bus events differs from the capture. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+#include "sha204_replay_device.h"
+
+static uint8_t *read_file(const char *name, size_t *size)
+{
+	FILE *file = fopen(name, "rb");
+	uint8_t *data = NULL;
+	long length;
+
+	if (!file)
+		return NULL;
+	if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+		data = (uint8_t *) malloc(length ? length : 1);
+		if (data && fread(data, 1, length, file) != (size_t) length) {
+			free(data);
+			data = NULL;
+		}
+		*size = length;
+	}
+	fclose(file);
+	return data;
+}
+
+int main(int argc, char **argv)
+{
+	sha204ReplayDevice device;
+	atsha204Class sha204(0);
+	uint8_t tx_buffer[SHA204_CMD_SIZE_MAX];
+	uint8_t rx_buffer[SHA204_RSP_SIZE_MAX];
+	const sha204_capture_record_t *record;
+	unsigned long commands = 0, unexpected = 0;
+	uint8_t *capture;
+	size_t size;
+	clock_t wall_start;
+	uint64_t virtual_start;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s capture.bin\n", argv[0]);
+		return 2;
+	}
+	capture = read_file(argv[1], &size);
+	if (!capture || !device.load(capture, size)) {
+		fprintf(stderr, "%s: not a readable capture export\n", argv[1]);
+		return 2;
+	}
+	sha204.setHostDevice(&device);
+
+	printf("index,op_code,ret_code,latency_us\n");
+	wall_start = clock();
+	virtual_start = host_clock_us();
+	while ((record = device.peek()) != NULL) {
+		size_t index = device.recordIndex();
+		uint64_t start = host_clock_us();
+		uint8_t ret_code;
+
+		switch (record->type) {
+		case SHA204_CAPTURE_WAKE:
+			(void) sha204.sha204c_wakeup(rx_buffer);
+			break;
+
+		case SHA204_CAPTURE_TX:
+			if (record->length < SHA204_CMD_SIZE_MIN || record->length > sizeof(tx_buffer)
+					|| record->data[SHA204_BUFFER_POS_COUNT] != record->length) {
+				device.skip();
+				unexpected++;
+				break;
+			}
+			ret_code = sha204.sha204m_execute(record->data[SHA204_OPCODE_IDX], record->data[SHA204_PARAM1_IDX],
+					record->data[SHA204_PARAM2_IDX] | (record->data[SHA204_PARAM2_IDX + 1] << 8),
+					record->length - SHA204_CMD_SIZE_MIN, (uint8_t *) &record->data[SHA204_DATA_IDX],
+					0, NULL, 0, NULL, sizeof(tx_buffer), tx_buffer, sizeof(rx_buffer), rx_buffer);
+			commands++;
+			printf("%lu,0x%02X,0x%02X,%lu\n", (unsigned long) index, record->data[SHA204_OPCODE_IDX], ret_code,
+					(unsigned long) (host_clock_us() - start));
+			break;
+
+		case SHA204_CAPTURE_SLEEP:
+			(void) sha204.sha204p_sleep();
+			break;
+
+		case SHA204_CAPTURE_IDLE:
+			(void) sha204.sha204p_idle();
+			break;
+
+		default:
+			// Responses and re-synchronizations are consumed by the commands above.
+			device.skip();
+			unexpected++;
+			break;
+		}
+		if (device.recordIndex() == index) {
+			// The library did not consume the record. Move on to avoid looping.
+			device.skip();
+			unexpected++;
+		}
+	}
+
+	fprintf(stderr, "records: %lu, commands: %lu, mismatches: %lu, unexpected records: %lu\n",
+			(unsigned long) device.recordCount(), commands, device.mismatches(), unexpected);
+	fprintf(stderr, "virtual time: %lu us, host time: %lu us\n",
+			(unsigned long) (host_clock_us() - virtual_start),
+			(unsigned long) ((clock() - wall_start) * 1000000.0 / CLOCKS_PER_SEC));
+	free(capture);
+	return device.mismatches() || unexpected ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include "sha204_replay_device.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+sha204ReplayDevice::sha204ReplayDevice()
+{
+	records = NULL;
+	record_count = position = 0;
+	mismatch_count = 0;
+	expect_command = false;
+}
+
+bool sha204ReplayDevice::load(const uint8_t *capture, size_t size)
+{
+	size_t index, capacity = 0;
+
+	free(records);
+	records = NULL;
+	record_count = position = 0;
+	mismatch_count = 0;
+	expect_command = false;
+
+	if (size < 5 || memcmp(capture, "S204", 4) || capture[4] != SHA204_CAPTURE_VERSION)
+		return false;
+
+	for (index = 5; index < size; ) {
+		sha204_capture_record_t *record;
+
+		if (size - index < SHA204_CAPTURE_HEADER_SIZE
+				|| size - index - SHA204_CAPTURE_HEADER_SIZE < capture[index + 6])
+			return false;
+		if (record_count == capacity) {
+			capacity = capacity ? 2 * capacity : 64;
+			records = (sha204_capture_record_t *) realloc(records, capacity * sizeof(*records));
+			if (!records)
+				return false;
+		}
+		record = &records[record_count++];
+		record->type = capture[index];
+		record->time = capture[index + 1] | (uint32_t) capture[index + 2] << 8
+				| (uint32_t) capture[index + 3] << 16 | (uint32_t) capture[index + 4] << 24;
+		record->status = capture[index + 5];
+		record->length = capture[index + 6];
+		record->data = &capture[index + SHA204_CAPTURE_HEADER_SIZE];
+		index += SHA204_CAPTURE_HEADER_SIZE + record->length;
+	}
+	return true;
+}
+
+const sha204_capture_record_t *sha204ReplayDevice::peek()
+{
+	return done() ? NULL : &records[position];
+}
+
+void sha204ReplayDevice::skip()
+{
+	if (!done())
+		position++;
+}
+
+// Consumes the next record if it has the given type. Re-synchronization
+// records only mark a delay and are passed over.
+const sha204_capture_record_t *sha204ReplayDevice::next(uint8_t type)
+{
+	while (!done() && records[position].type == SHA204_CAPTURE_RESYNC && type != SHA204_CAPTURE_RESYNC)
+		position++;
+	if (done() || records[position].type != type) {
+		mismatch_count++;
+		return NULL;
+	}
+	return &records[position++];
+}
+
+void sha204ReplayDevice::wake()
+{
+	expect_command = false;
+	(void) next(SHA204_CAPTURE_WAKE);
+}
+
+uint8_t sha204ReplayDevice::send(uint8_t count, const uint8_t *buffer)
+{
+	const sha204_capture_record_t *record;
+
+	if (expect_command) {
+		expect_command = false;
+		record = next(SHA204_CAPTURE_TX);
+		if (!record)
+			return SWI_FUNCTION_RETCODE_SUCCESS;
+		if (record->length != count || memcmp(record->data, buffer, count))
+			mismatch_count++;
+		return record->status;
+	}
+
+	if (count != 1)
+		mismatch_count++;
+	else if (buffer[0] == SHA204_SWI_FLAG_CMD)
+		expect_command = true;
+	else if (buffer[0] == SHA204_SWI_FLAG_SLEEP)
+		(void) next(SHA204_CAPTURE_SLEEP);
+	else if (buffer[0] == SHA204_SWI_FLAG_IDLE)
+		(void) next(SHA204_CAPTURE_IDLE);
+	return SWI_FUNCTION_RETCODE_SUCCESS;
+}
+
+uint8_t sha204ReplayDevice::receive(uint8_t count, uint8_t *buffer)
+{
+	const sha204_capture_record_t *record = next(SHA204_CAPTURE_RX);
+
+	if (!record)
+		return SWI_FUNCTION_RETCODE_TIMEOUT;
+
+	switch (record->status) {
+	case SHA204_RX_NO_RESPONSE:
+		return SWI_FUNCTION_RETCODE_TIMEOUT;
+
+	case SHA204_RX_FAIL:
+		// Any code other than success, timeout and receive failure
+		// makes sha204p_receive_response() return SHA204_RX_FAIL.
+		return SWI_FUNCTION_RETCODE_BUSY;
+
+	default:
+		memset(buffer, 0, count);
+		memcpy(buffer, record->data, record->length < count ? record->length : count);
+		return SWI_FUNCTION_RETCODE_SUCCESS;
+	}
+}
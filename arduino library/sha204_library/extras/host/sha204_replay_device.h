@@ -0,0 +1,54 @@
+/* Device stand-in that answers from a packet capture
+
+   The capture is an export written by atsha204Class::captureExport(). The
+   stand-in serves the captured responses in order and compares every command
+   packet the library sends with the captured one. Differences are counted as
+   mismatches, so a replay doubles as a regression check of the marshaling and
+   communication layers. */
+
+#ifndef SHA204_REPLAY_DEVICE_H
+#define SHA204_REPLAY_DEVICE_H
+
+#include "Arduino.h"
+#include "sha204_library.h"
+
+typedef struct
+{
+	uint8_t type;
+	uint32_t time;
+	uint8_t status;
+	uint8_t length;
+	const uint8_t *data;
+} sha204_capture_record_t;
+
+class sha204ReplayDevice : public sha204HostDevice
+{
+public:
+	sha204ReplayDevice();
+
+	//! Parses an export. The memory has to stay valid while replaying.
+	bool load(const uint8_t *capture, size_t size);
+	//! Returns the next record without consuming it, or NULL at the end.
+	const sha204_capture_record_t *peek();
+	//! Consumes the next record.
+	void skip();
+	bool done() { return position == record_count; }
+	size_t recordCount() { return record_count; }
+	size_t recordIndex() { return position; }
+	unsigned long mismatches() { return mismatch_count; }
+
+	void wake();
+	uint8_t send(uint8_t count, const uint8_t *buffer);
+	uint8_t receive(uint8_t count, uint8_t *buffer);
+
+private:
+	const sha204_capture_record_t *next(uint8_t type);
+
+	sha204_capture_record_t *records;
+	size_t record_count;
+	size_t position;
+	unsigned long mismatch_count;
+	bool expect_command;
+};
+
+#endif
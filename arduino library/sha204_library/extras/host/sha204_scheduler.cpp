@@ -0,0 +1,124 @@
+/* Measures the queueing delay of every priority class of sha204Scheduler.
+
+   Build from the library directory and run:
+
+     g++ -O2 -DSHA204_SWI_HOST -Iextras/host -I. *.cpp extras/host/arduino_host.cpp \
+         extras/host/sha204_emulator_device.cpp extras/host/sha204_scheduler.cpp -o sha204_scheduler
+     ./sha204_scheduler [duration_ms] [high_interval_ms]
+
+   One emulated device with typical execution times is shared by three kinds of
+   work, as in the scheduler example. A Nonce and MAC job of high priority
+   arrives every high_interval_ms (150 by default), a serial number read of
+   normal priority every second, and the queue is kept full of low priority
+   Random jobs, leaving room for the other two. The jobs run for duration_ms of
+   virtual time (60000 by default).
+
+   Results are printed as comma separated lines:
+   class,interval_ms,runs,failed,expired,wait_avg_ms,wait_max_ms
+   wait is the time from submitting a job to the start of its transaction, as
+   counted by the scheduler. interval_ms is 0 for the low priority jobs, which
+   are submitted again as soon as they are done. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+#include "sha204_emulator_device.h"
+
+#define LOW_JOBS             (SHA204_SCHED_QUEUE - 2)
+#define NORMAL_INTERVAL      (1000)
+
+static sha204EmulatorDevice device;
+static atsha204Class sha204(0);
+static sha204Scheduler scheduler(sha204);
+
+static uint8_t challenge[NONCE_NUMIN_SIZE_PASSTHROUGH];
+static uint8_t mac_response[MAC_RSP_SIZE];
+static uint8_t serial_response[READ_32_RSP_SIZE];
+static uint8_t random_response[RANDOM_RSP_SIZE];
+
+static const sha204_auth_step_t mac_steps[] = {
+	{SHA204_NONCE, NONCE_MODE_PASSTHROUGH, 0, NONCE_NUMIN_SIZE_PASSTHROUGH, challenge, 0, NULL, 0, NULL, NULL},
+	{SHA204_MAC, SHA204_ATTEST_MAC_MODE, 0, 0, NULL, 0, NULL, 0, NULL, mac_response},
+};
+static const sha204_auth_step_t serial_steps[] = {
+	{SHA204_READ, SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG, 0, 0, NULL, 0, NULL, 0, NULL, serial_response},
+};
+static const sha204_auth_step_t random_steps[] = {
+	{SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, 0, 0, NULL, 0, NULL, 0, NULL, random_response},
+};
+
+static sha204_job_t high_job = {mac_steps, 2, SHA204_PRIORITY_HIGH, 0, 0, 0, NULL, NULL, SHA204_JOB_FREE, 0, {0, 0, 0, 0, {0}}};
+static sha204_job_t normal_job = {serial_steps, 1, SHA204_PRIORITY_NORMAL, 1, 0, 0, NULL, NULL, SHA204_JOB_FREE, 0, {0, 0, 0, 0, {0}}};
+static sha204_job_t low_jobs[LOW_JOBS];
+
+static unsigned long high_interval = 150;
+static unsigned long start, next_high, next_normal;
+
+// Submits the high and normal priority jobs that are due. It also runs as the wait
+// hook of the device, so that jobs arrive while a transaction executes and wait for it.
+static void arrive(void *context)
+{
+	(void) context;
+	if (millis() - start >= next_high - start && high_job.state == SHA204_JOB_FREE) {
+		challenge[0]++;
+		scheduler.submit(&high_job);
+		next_high += high_interval;
+	}
+	if (millis() - start >= next_normal - start && normal_job.state == SHA204_JOB_FREE) {
+		scheduler.submit(&normal_job);
+		next_normal += NORMAL_INTERVAL;
+	}
+}
+
+static void report(const char *name, uint8_t priority, unsigned long interval)
+{
+	const sha204_sched_stats_t *stats = scheduler.getStats(priority);
+
+	printf("%s,%lu,%u,%u,%u,%.1f,%u\n", name, interval, stats->runs, stats->failed, stats->expired,
+			stats->runs ? (double) stats->wait_total / stats->runs : 0.0, stats->wait_max);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long duration = argc > 1 ? strtoul(argv[1], NULL, 0) : 60000;
+	uint8_t i;
+
+	if (argc > 2)
+		high_interval = strtoul(argv[2], NULL, 0);
+	if (!duration || !high_interval) {
+		fprintf(stderr, "usage: %s [duration_ms] [high_interval_ms]\n", argv[0]);
+		return 2;
+	}
+	// MAC needs a locked data zone.
+	memset(device.data, 0x3C, SHA204_EMULATOR_SLOT_SIZE);
+	device.config[86] = device.config[87] = 0x00;
+	device.setTiming(SHA204_EMULATOR_TIMING_TYPICAL);
+	sha204.setHostDevice(&device);
+
+	for (i = 0; i < LOW_JOBS; i++) {
+		memset(&low_jobs[i], 0, sizeof(low_jobs[i]));
+		low_jobs[i].steps = random_steps;
+		low_jobs[i].step_count = 1;
+		low_jobs[i].priority = SHA204_PRIORITY_LOW;
+		low_jobs[i].owner = 2;
+	}
+
+	start = next_high = next_normal = millis();
+	sha204.setWaitHook(arrive, NULL);
+	while (millis() - start < duration) {
+		arrive(NULL);
+		for (i = 0; i < LOW_JOBS; i++)
+			if (low_jobs[i].state == SHA204_JOB_FREE)
+				scheduler.submit(&low_jobs[i]);
+		scheduler.poll();
+	}
+	sha204.setWaitHook(NULL, NULL);
+
+	printf("class,interval_ms,runs,failed,expired,wait_avg_ms,wait_max_ms\n");
+	report("high", SHA204_PRIORITY_HIGH, high_interval);
+	report("normal", SHA204_PRIORITY_NORMAL, NORMAL_INTERVAL);
+	report("low", SHA204_PRIORITY_LOW, 0);
+	return 0;
+}
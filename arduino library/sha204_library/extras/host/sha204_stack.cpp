@@ -0,0 +1,94 @@
+/* Measures the peak stack use of library calls on a desktop host.
+
+   Build from the library directory and run:
+
+     g++ -O2 -DSHA204_SWI_HOST -Iextras/host -I. *.cpp extras/host/arduino_host.cpp \
+         extras/host/sha204_emulator_device.cpp extras/host/sha204_stack.cpp -o sha204_stack
+     ./sha204_stack
+
+   Before each call the stack below the caller is filled with a pattern, and
+   afterwards the bytes that were overwritten are counted. Calls run against
+   sha204EmulatorDevice. Host frames are larger than AVR frames because of
+   64-bit registers and alignment, so compare rows with each other rather than
+   with the RAM of a target. Results are printed as comma separated lines:
+   call,stack_bytes,ret_code */
+
+#include <stdio.h>
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+#include "sha204_emulator_device.h"
+
+#define PROBE_SIZE           (8192)
+#define PATTERN              ((uint8_t) 0xC5)
+
+static sha204EmulatorDevice device;
+static atsha204Class sha204(0);
+
+static __attribute__((noinline)) void paint()
+{
+	volatile uint8_t area[PROBE_SIZE];
+	size_t i;
+
+	for (i = 0; i < sizeof(area); i++)
+		area[i] = PATTERN;
+}
+
+// Returns the number of bytes below the caller that no longer hold the pattern.
+// Reading what paint() and the call left behind is the point.
+#pragma GCC diagnostic ignored "-Wuninitialized"
+static __attribute__((noinline)) size_t scan()
+{
+	volatile uint8_t area[PROBE_SIZE];
+	size_t i;
+
+	for (i = 0; i < sizeof(area) && area[i] == PATTERN; i++)
+		;
+	return sizeof(area) - i;
+}
+
+static __attribute__((noinline)) uint8_t lock_config_zone()
+{
+	return sha204.sha204e_lock_config_zone();
+}
+
+static __attribute__((noinline)) uint8_t read_config_zone()
+{
+	uint8_t config_data[SHA204_CONFIG_SIZE];
+
+	return sha204.sha204e_read_config_zone(config_data);
+}
+
+static __attribute__((noinline)) uint8_t read_serial()
+{
+	uint8_t serial[9];
+
+	return sha204.getSerialNumber(serial);
+}
+
+static void measure(const char *name, uint8_t (*call)())
+{
+	uint8_t response[SHA204_RSP_SIZE_MIN];
+	uint8_t ret_code;
+	size_t used;
+
+	sha204.sha204c_wakeup(response);
+	paint();
+	ret_code = call();
+	used = scan();
+	sha204.sha204p_sleep();
+	printf("%s,%zu,0x%02X\n", name, used, ret_code);
+}
+
+int main()
+{
+	device.setTiming(SHA204_EMULATOR_TIMING_INSTANT);
+	sha204.setHostDevice(&device);
+
+	printf("call,stack_bytes,ret_code\n");
+	measure("getSerialNumber", read_serial);
+	measure("sha204e_read_config_zone", read_config_zone);
+	measure("sha204e_lock_config_zone_unlocked", lock_config_zone);
+	measure("sha204e_lock_config_zone_locked", lock_config_zone);
+	return 0;
+}
@@ -0,0 +1,490 @@
+/* Measures how many diversified key authentications per second a host serves.
+
+   Build from the library directory and run:
+
+     g++ -O2 -DSHA204_SWI_HOST -Iextras/host -I. *.cpp extras/host/arduino_host.cpp \
+         extras/host/sha204_emulator_device.cpp extras/host/sha204_throughput.cpp -o sha204_throughput
+     ./sha204_throughput [seconds] [clients]
+
+   The host runs the loop of atsha204_diversified_host_example against an
+   emulated device, once as before sha204AuthEngine (Random when a serial
+   number arrives, Nonce, GenDig and CheckMac when the MAC arrives) and once
+   with the engine. Clients share one serial line at 57600 baud, like the
+   examples. Each client has its own emulated device with a key derived from
+   its serial number, answers a challenge after the time a MAC takes on the
+   bus, and starts over as soon as it has its result. Bytes reach the host
+   through a 64-byte receive buffer, as on an AVR; bytes arriving while it is
+   full are lost and counted as overruns.
+
+   Results are printed as comma separated lines:
+   mode,clients,auths_per_s,passed,failed,timeouts,primed,unprimed,ahead,overruns
+   over the given seconds of virtual time for 1 to the given number of clients. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+#include "sha204_emulator_device.h"
+
+#define BYTE_US              (10 * 1000000UL / 57600)   //!< start, 8 data and stop bit
+#define RX_BUFFER_SIZE       (64)      //!< receive buffer of the AVR hardware serial port
+#define TX_BUFFER_SIZE       (64)      //!< transmit buffer of the AVR hardware serial port
+#define LINE_SIZE            (4096)    //!< bytes that can be on their way to the host
+#define FRAMES_MAX           (64)      //!< frames that can be on their way to the clients
+#define CLIENTS_MAX          (SHA204_LINK_WINDOW)
+#define CLIENT_TIMEOUT_US    (3000000UL)
+#define LOOP_US              (20)      //!< one pass of loop() with nothing to do
+
+#define KEY_CHILD            (10)
+#define KEY_PARENT           (13)
+#define MAC_MODE_CHALLENGE   ((uint8_t) 0x00)
+
+static const sha204_engine_scheme_t scheme = {
+	KEY_PARENT,
+	{SHA204_DERIVE_KEY, DERIVE_KEY_RANDOM_FLAG, KEY_CHILD, 0x00},
+	CHECKMAC_MODE_BLOCK1_TEMPKEY | CHECKMAC_MODE_SOURCE_FLAG_MATCH,
+	{SHA204_MAC, MAC_MODE_CHALLENGE, KEY_CHILD, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
+};
+
+static void clients_run();
+
+// Serial port of the host. Bytes sent by clients travel one after the other on
+// the shared line and are moved into the receive buffer once they have arrived.
+// Reading first lets the clients catch up with the host.
+class HostPort : public Stream
+{
+public:
+	HostPort() { clear(); }
+	void clear();
+	void sendFrom(uint64_t at, const uint8_t *bytes, size_t size);
+	int available();
+	int read();
+	int peek();
+	size_t write(uint8_t value) { return write(&value, 1); }
+	size_t write(const uint8_t *buffer, size_t size);
+
+	struct frame_t
+	{
+		uint64_t arrives_at;
+		uint8_t size;
+		uint8_t bytes[1 + SHA204_LINK_FRAME_MAX];
+	} frames[FRAMES_MAX];	// frames on their way to the clients
+	size_t frame_head, frame_count;
+	unsigned long overruns;
+
+private:
+	void deliver();
+
+	struct
+	{
+		uint64_t at;
+		uint8_t value;
+	} line[LINE_SIZE];
+	size_t line_head, line_count;
+	uint64_t rx_free_at, tx_free_at;
+	uint8_t rx_buffer[RX_BUFFER_SIZE];
+	size_t rx_head, rx_count;
+};
+
+void HostPort::clear()
+{
+	frame_head = frame_count = line_head = line_count = rx_head = rx_count = 0;
+	rx_free_at = tx_free_at = host_clock_us();
+	overruns = 0;
+}
+
+void HostPort::sendFrom(uint64_t at, const uint8_t *bytes, size_t size)
+{
+	size_t i;
+
+	if (rx_free_at > at)
+		at = rx_free_at;
+	for (i = 0; i < size && line_count < LINE_SIZE; i++, line_count++) {
+		at += BYTE_US;
+		line[(line_head + line_count) % LINE_SIZE].at = at;
+		line[(line_head + line_count) % LINE_SIZE].value = bytes[i];
+	}
+	rx_free_at = at;
+}
+
+void HostPort::deliver()
+{
+	uint64_t now = host_clock_us();
+
+	clients_run();
+	while (line_count && line[line_head].at <= now) {
+		if (rx_count < RX_BUFFER_SIZE) {
+			rx_buffer[(rx_head + rx_count) % RX_BUFFER_SIZE] = line[line_head].value;
+			rx_count++;
+		}
+		else
+			overruns++;
+		line_head = (line_head + 1) % LINE_SIZE;
+		line_count--;
+	}
+}
+
+int HostPort::available()
+{
+	deliver();
+	return (int) rx_count;
+}
+
+int HostPort::read()
+{
+	int value = peek();
+
+	if (value >= 0) {
+		rx_head = (rx_head + 1) % RX_BUFFER_SIZE;
+		rx_count--;
+	}
+	return value;
+}
+
+int HostPort::peek()
+{
+	deliver();
+	return rx_count ? rx_buffer[rx_head] : -1;
+}
+
+// sha204Link writes one frame per call. The call waits only while the
+// transmit buffer has no room for the frame.
+size_t HostPort::write(const uint8_t *buffer, size_t size)
+{
+	uint64_t now = host_clock_us();
+	uint64_t queued = tx_free_at > now ? (tx_free_at - now + BYTE_US - 1) / BYTE_US : 0;
+	struct frame_t *frame;
+
+	if (size > sizeof(frame->bytes) || frame_count == FRAMES_MAX)
+		return 0;
+	if (queued + size > TX_BUFFER_SIZE)
+		delayMicroseconds((queued + size - TX_BUFFER_SIZE) * BYTE_US);
+	now = host_clock_us();
+	if (tx_free_at < now)
+		tx_free_at = now;
+	tx_free_at += size * BYTE_US;
+
+	frame = &frames[(frame_head + frame_count) % FRAMES_MAX];
+	frame->arrives_at = tx_free_at;
+	frame->size = (uint8_t) size;
+	memcpy(frame->bytes, buffer, size);
+	frame_count++;
+	return size;
+}
+
+#define CLIENT_SEND_SERIAL   (0)
+#define CLIENT_CHALLENGED    (1)
+#define CLIENT_SEND_MAC      (2)
+#define CLIENT_DONE          (3)
+
+struct client_t
+{
+	sha204EmulatorDevice device;
+	uint8_t channel;
+	uint8_t serial[NONCE_NUMIN_SIZE_PASSTHROUGH];
+	uint8_t state;
+	uint8_t seq;
+	uint8_t mac[MAC_CHALLENGE_SIZE];
+	uint64_t next_at;      // time of the next thing the client does
+	uint64_t started_at;
+};
+
+static HostPort port;
+static sha204Link host_link(port);
+static sha204EmulatorDevice host_device;
+static atsha204Class sha204(0);
+static client_t clients[CLIENTS_MAX];
+static uint8_t client_count;
+static uint64_t client_mac_us;
+static unsigned long passed, failed, timeouts;
+
+// Sends a frame as a client would, with the CRC computed by a link of its own.
+class FrameCapture : public Stream
+{
+public:
+	int available() { return 0; }
+	int read() { return -1; }
+	int peek() { return -1; }
+	size_t write(uint8_t value) { return write(&value, 1); }
+	size_t write(const uint8_t *buffer, size_t size) { port.sendFrom(at, buffer, size); return size; }
+	uint64_t at;
+};
+
+static FrameCapture client_port;
+static sha204Link client_link(client_port);
+
+static void client_send(client_t *client, uint64_t at, uint8_t type, uint8_t seq, const uint8_t *payload)
+{
+	client_port.at = at;
+	client_link.send(client->channel, type, seq, payload, 32);
+}
+
+// Computes the MAC of the diversified key as the client device does. The
+// time it takes on the bus was measured once and is added by the caller.
+static void client_mac(client_t *client, const uint8_t *challenge)
+{
+	uint8_t packet[MAC_COUNT_LONG] = {MAC_COUNT_LONG, SHA204_MAC, MAC_MODE_CHALLENGE, KEY_CHILD, 0};
+	uint8_t response[MAC_RSP_SIZE];
+	uint8_t flag = SHA204_SWI_FLAG_CMD;
+
+	memcpy(&packet[MAC_CHALLENGE_IDX], challenge, MAC_CHALLENGE_SIZE);
+	atsha204Class::sha204c_calculate_crc(MAC_COUNT_LONG - SHA204_CRC_SIZE, packet, &packet[MAC_COUNT_LONG - SHA204_CRC_SIZE]);
+	client->device.wake();
+	client->device.send(1, &flag);
+	client->device.send(sizeof(packet), packet);
+	memset(response, 0, sizeof(response));
+	client->device.receive(sizeof(response), response);
+	flag = SHA204_SWI_FLAG_SLEEP;
+	client->device.send(1, &flag);
+	memcpy(client->mac, &response[SHA204_BUFFER_POS_DATA], sizeof(client->mac));
+}
+
+// A frame from the host has arrived at the clients.
+static void client_receive(const HostPort::frame_t *frame)
+{
+	const uint8_t *packet = &frame->bytes[1];
+	client_t *client;
+
+	if (frame->size < 1 + SHA204_LINK_FRAME_MIN || atsha204Class::sha204c_check_crc((uint8_t *) packet) != SHA204_SUCCESS
+			|| packet[1] >= client_count)
+		return;
+	client = &clients[packet[1]];
+
+	if (packet[2] == SHA204_LINK_CHALLENGE && client->state == CLIENT_CHALLENGED) {
+		client_mac(client, &packet[SHA204_LINK_HEADER_SIZE]);
+		client->seq = packet[3];
+		client->state = CLIENT_SEND_MAC;
+		client->next_at = frame->arrives_at + client_mac_us;
+	}
+	else if (packet[2] == SHA204_LINK_RESULT && client->state == CLIENT_DONE && packet[3] == client->seq) {
+		if (packet[SHA204_LINK_HEADER_SIZE] == SHA204_SUCCESS)
+			passed++;
+		else
+			failed++;
+		client->state = CLIENT_SEND_SERIAL;
+		client->next_at = frame->arrives_at;
+	}
+}
+
+// Runs what the clients do up to now, in the order it happens.
+static void clients_run()
+{
+	uint64_t now = host_clock_us();
+
+	for (;;) {
+		HostPort::frame_t *frame = port.frame_count ? &port.frames[port.frame_head] : NULL;
+		client_t *next = NULL;
+		uint8_t i;
+
+		for (i = 0; i < client_count; i++) {
+			client_t *client = &clients[i];
+			if (client->state == CLIENT_CHALLENGED || client->state == CLIENT_DONE) {
+				if (now - client->started_at < CLIENT_TIMEOUT_US)
+					continue;
+				// No answer; send the serial number again.
+				timeouts++;
+				client->state = CLIENT_SEND_SERIAL;
+				client->next_at = client->started_at + CLIENT_TIMEOUT_US;
+			}
+			if (!next || client->next_at < next->next_at)
+				next = client;
+		}
+
+		if (frame && frame->arrives_at <= now && (!next || frame->arrives_at <= next->next_at)) {
+			client_receive(frame);
+			port.frame_head = (port.frame_head + 1) % FRAMES_MAX;
+			port.frame_count--;
+		}
+		else if (next && next->next_at <= now) {
+			if (next->state == CLIENT_SEND_SERIAL) {
+				client_send(next, next->next_at, SHA204_LINK_SERIAL, 0, next->serial);
+				next->state = CLIENT_CHALLENGED;
+				next->started_at = next->next_at;
+			}
+			else {
+				client_send(next, next->next_at, SHA204_LINK_RESPONSE, next->seq, next->mac);
+				next->state = CLIENT_DONE;
+			}
+		}
+		else
+			return;
+	}
+}
+
+// Locks a device and stores the parent key, as the personalization of the examples does.
+static void setup_device(sha204EmulatorDevice *device, uint8_t serial)
+{
+	device->config[2] = serial;
+	device->config[8] = serial;
+	// Slot 10 takes keys derived from slot 13.
+	device->config[20 + 2 * KEY_CHILD] = 0x00;
+	device->config[21 + 2 * KEY_CHILD] = 0x30 | KEY_PARENT;
+	memset(&device->data[KEY_PARENT * SHA204_EMULATOR_SLOT_SIZE], 0x5A, SHA204_EMULATOR_SLOT_SIZE);
+	device->config[86] = device->config[87] = 0x00;
+}
+
+// Derives the key of a client through the library, as the client example does,
+// and measures how long waking the device for a MAC takes on the bus.
+static uint8_t setup_client(client_t *client, uint8_t channel)
+{
+	atsha204Class client_sha204(0);
+	uint8_t command[SHA204_CMD_SIZE_MAX];
+	uint8_t response[SHA204_RSP_SIZE_MAX];
+	uint64_t start;
+	uint8_t ret_code;
+
+	setup_device(&client->device, 0x10 + channel);
+	client_sha204.setHostDevice(&client->device);
+	client->channel = channel;
+	client->state = CLIENT_SEND_SERIAL;
+
+	memset(client->serial, 0x65, sizeof(client->serial));
+	client_sha204.sha204c_wakeup(response);
+	ret_code = client_sha204.getSerialNumber(client->serial);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = client_sha204.sha204m_nonce(command, response, NONCE_MODE_PASSTHROUGH, client->serial);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = client_sha204.sha204m_derive_key(command, response, DERIVE_KEY_RANDOM_FLAG, KEY_CHILD, NULL);
+	client_sha204.sha204p_sleep();
+
+	start = host_clock_us();
+	client_sha204.sha204c_wakeup(response);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = client_sha204.sha204m_mac(command, response, MAC_MODE_CHALLENGE, KEY_CHILD, client->serial);
+	client_sha204.sha204p_sleep();
+	client_mac_us = host_clock_us() - start;
+
+	client->device.setTiming(SHA204_EMULATOR_TIMING_INSTANT);
+	return ret_code;
+}
+
+// The loop of the host example before sha204AuthEngine: a random is generated
+// when a serial number arrives and the whole sequence runs when the MAC arrives.
+static struct
+{
+	uint8_t in_use;
+	uint8_t channel;
+	uint8_t seq;
+	uint8_t serial[NONCE_NUMIN_SIZE_PASSTHROUGH];
+	uint8_t challenge[MAC_CHALLENGE_SIZE];
+} challenges[SHA204_LINK_WINDOW];
+
+static void sequential_poll()
+{
+	sha204_link_frame_t frame;
+	uint8_t command[RANDOM_COUNT];
+	uint8_t response[RANDOM_RSP_SIZE];
+	uint8_t channel, seq, ret_code;
+	int i;
+
+	if (host_link.poll(&frame) == SHA204_SUCCESS) {
+		if (frame.type == SHA204_LINK_SERIAL) {
+			for (i = 0; i < SHA204_LINK_WINDOW && challenges[i].in_use; i++)
+				;
+			if (i == SHA204_LINK_WINDOW)
+				return;
+			sha204.sha204c_wakeup(response);
+			ret_code = sha204.sha204m_random(command, response, RANDOM_NO_SEED_UPDATE);
+			sha204.sha204p_sleep();
+			if (ret_code != SHA204_SUCCESS || host_link.request(frame.channel, SHA204_LINK_CHALLENGE,
+					&response[SHA204_BUFFER_POS_DATA], MAC_CHALLENGE_SIZE, &challenges[i].seq) != SHA204_SUCCESS)
+				return;
+			challenges[i].in_use = 1;
+			challenges[i].channel = frame.channel;
+			memcpy(challenges[i].serial, frame.payload, NONCE_NUMIN_SIZE_PASSTHROUGH);
+			memcpy(challenges[i].challenge, &response[SHA204_BUFFER_POS_DATA], MAC_CHALLENGE_SIZE);
+		}
+		else if (frame.type == SHA204_LINK_RESPONSE && frame.answered) {
+			for (i = 0; i < SHA204_LINK_WINDOW; i++)
+				if (challenges[i].in_use && challenges[i].channel == frame.channel && challenges[i].seq == frame.seq)
+					break;
+			if (i == SHA204_LINK_WINDOW)
+				return;
+			const sha204_auth_step_t steps[] = {
+				{SHA204_NONCE, NONCE_MODE_PASSTHROUGH, 0, NONCE_NUMIN_SIZE_PASSTHROUGH, challenges[i].serial, 0, NULL, 0, NULL, NULL},
+				{SHA204_GENDIG, GENDIG_ZONE_DATA, KEY_PARENT, GENDIG_OTHER_DATA_SIZE, (uint8_t *) scheme.derive_key_command,
+						0, NULL, 0, NULL, NULL},
+				{SHA204_CHECKMAC, scheme.checkmac_mode, 0, CHECKMAC_CLIENT_CHALLENGE_SIZE, challenges[i].challenge,
+						CHECKMAC_CLIENT_RESPONSE_SIZE, frame.payload, CHECKMAC_OTHER_DATA_SIZE,
+						(uint8_t *) scheme.checkmac_other_data, NULL},
+			};
+			sha204_auth_result_t result;
+			ret_code = sha204.authenticate(steps, sizeof(steps) / sizeof(steps[0]), &result);
+			challenges[i].in_use = 0;
+			host_link.send(frame.channel, SHA204_LINK_RESULT, frame.seq, &ret_code, 1);
+		}
+	}
+	while (host_link.expired(SHA204_ENGINE_TIMEOUT, &channel, &seq) == SHA204_SUCCESS)
+		for (i = 0; i < SHA204_LINK_WINDOW; i++)
+			if (challenges[i].in_use && challenges[i].channel == channel && challenges[i].seq == seq)
+				challenges[i].in_use = 0;
+}
+
+static void run(const char *mode, uint8_t count, unsigned long seconds, sha204AuthEngine *engine)
+{
+	uint64_t start, end;
+	uint8_t i;
+
+	port.clear();
+	host_link.cancel();
+	memset(challenges, 0, sizeof(challenges));
+	passed = failed = timeouts = 0;
+	client_count = count;
+	start = host_clock_us();
+	end = start + (uint64_t) seconds * 1000000;
+	for (i = 0; i < count; i++) {
+		clients[i].state = CLIENT_SEND_SERIAL;
+		clients[i].next_at = start;
+	}
+
+	while (host_clock_us() < end) {
+		uint64_t before = host_clock_us();
+
+		clients_run();
+		if (engine)
+			engine->poll();
+		else
+			sequential_poll();
+		if (host_clock_us() == before)
+			delayMicroseconds(LOOP_US);
+	}
+
+	if (engine) {
+		const sha204_engine_stats_t *stats = engine->getStats();
+		printf("%s,%u,%.2f,%lu,%lu,%lu,%u,%u,%u,%lu\n", mode, count, (double) passed / seconds,
+				passed, failed, timeouts, stats->primed, stats->unprimed, stats->ahead, port.overruns);
+	}
+	else
+		printf("%s,%u,%.2f,%lu,%lu,%lu,0,0,0,%lu\n", mode, count, (double) passed / seconds,
+				passed, failed, timeouts, port.overruns);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long seconds = argc > 1 ? strtoul(argv[1], NULL, 0) : 60;
+	unsigned long max_clients = argc > 2 ? strtoul(argv[2], NULL, 0) : CLIENTS_MAX;
+	uint8_t i;
+
+	if (!seconds || !max_clients || max_clients > CLIENTS_MAX) {
+		fprintf(stderr, "usage: %s [seconds] [clients, 1 to %u]\n", argv[0], CLIENTS_MAX);
+		return 2;
+	}
+	setup_device(&host_device, 0x01);
+	sha204.setHostDevice(&host_device);
+	for (i = 0; i < max_clients; i++) {
+		if (setup_client(&clients[i], i) != SHA204_SUCCESS) {
+			fprintf(stderr, "client %u: the key could not be derived\n", i);
+			return 1;
+		}
+	}
+
+	printf("mode,clients,auths_per_s,passed,failed,timeouts,primed,unprimed,ahead,overruns\n");
+	for (i = 1; i <= max_clients; i++) {
+		sha204AuthEngine engine(sha204, host_link, &scheme);
+
+		run("sequential", i, seconds, NULL);
+		run("engine", i, seconds, &engine);
+	}
+	return 0;
+}
@@ -0,0 +1,79 @@
+/* Measures what the execution times of the detected part save on a desktop host.
+
+   Build from the library directory and run:
+
+     g++ -O2 -DSHA204_SWI_HOST -Iextras/host -I. *.cpp extras/host/arduino_host.cpp \
+         extras/host/sha204_emulator_device.cpp extras/host/sha204_variant.cpp -o sha204_variant
+     ./sha204_variant
+
+   Each row runs a Random, a Nonce, a GenDig and a MAC on an emulated device
+   with locked zones, once with the *_DELAY values and once after
+   detectVariant(). The ATSHA204 rows use revision 0x07 and the typical
+   times of the ATSHA204, the ATSHA204A rows revision 0x09 and shorter
+   times. The stock row leaves the configuration of the emulator as it is,
+   RevNum 00 09 04 00, which has to be detected as an ATSHA204. The last row
+   selects the ATSHA204A times for an ATSHA204, which has to cost polls but
+   not fail. Results are printed as comma
+   separated lines: part,selection,variant,ret_code,ms
+   ms is virtual bus time from the wake pulse to the MAC response. */
+
+#include <stdio.h>
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+#include "sha204_emulator_device.h"
+
+static void run(const char *part, uint8_t revision, uint8_t timing, const char *selection)
+{
+	sha204EmulatorDevice device;
+	atsha204Class sha204(0);
+	uint8_t command[NONCE_COUNT_LONG];
+	uint8_t response[RANDOM_RSP_SIZE];
+	uint8_t numin[NONCE_NUMIN_SIZE];
+	uint8_t challenge[MAC_CHALLENGE_SIZE];
+	unsigned long start_us, us;
+	uint8_t ret_code;
+
+	if (strcmp(part, "stock"))
+		device.config[ADDRESS_REVISION] = revision;
+	device.config[ADDRESS_LOCKCONFIG] = 0x00;
+	device.config[ADDRESS_LOCKVALUE] = 0x00;
+	device.setTiming(timing);
+	sha204.setHostDevice(&device);
+	memset(numin, 0x5A, sizeof(numin));
+	memset(challenge, 0xA5, sizeof(challenge));
+
+	ret_code = sha204.sha204c_wakeup(response);
+	if (ret_code == SHA204_SUCCESS && !strcmp(selection, "detected"))
+		ret_code = sha204.detectVariant();
+	else if (!strcmp(selection, "forced_a"))
+		sha204.setVariant(SHA204_VARIANT_ATSHA204A);
+	sha204.sha204p_sleep();
+
+	start_us = host_clock_us();
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = sha204.sha204c_wakeup(response);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = sha204.sha204m_random(command, response, RANDOM_NO_SEED_UPDATE);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = sha204.sha204m_nonce(command, response, NONCE_MODE_NO_SEED_UPDATE, numin);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = sha204.sha204m_gen_dig(command, response, GENDIG_ZONE_DATA, 0, NULL);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = sha204.sha204m_mac(command, response, MAC_MODE_BLOCK2_TEMPKEY, 0, challenge);
+	us = host_clock_us() - start_us;
+	sha204.sha204p_sleep();
+	printf("%s,%s,%u,0x%02X,%.1f\n", part, selection, sha204.getVariant(), ret_code, us / 1000.0);
+}
+
+int main()
+{
+	printf("part,selection,variant,ret_code,ms\n");
+	run("atsha204", 0x07, SHA204_EMULATOR_TIMING_TYPICAL, "default");
+	run("atsha204", 0x07, SHA204_EMULATOR_TIMING_TYPICAL, "detected");
+	run("atsha204a", 0x09, SHA204_EMULATOR_TIMING_TYPICAL_A, "default");
+	run("atsha204a", 0x09, SHA204_EMULATOR_TIMING_TYPICAL_A, "detected");
+	run("atsha204", 0x07, SHA204_EMULATOR_TIMING_TYPICAL, "forced_a");
+	run("stock", 0x00, SHA204_EMULATOR_TIMING_TYPICAL, "detected");
+	return 0;
+}
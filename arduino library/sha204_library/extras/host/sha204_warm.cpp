@@ -0,0 +1,99 @@
+/* Measures the boot time sha204WarmStart saves on a desktop host.
+
+   Build from the library directory and run:
+
+     g++ -O2 -DSHA204_SWI_HOST -Iextras/host -I. *.cpp extras/host/arduino_host.cpp \
+         extras/host/sha204_emulator_device.cpp extras/host/sha204_warm.cpp -o sha204_warm
+     ./sha204_warm
+
+   The emulated device has locked configuration and data zones and typical
+   timing, and the EEPROM is an array. The config_only rows boot a device
+   whose data zone is not locked yet, so its record is not used. The baseline reads what a firmware reads at
+   boot without the record: getSerialNumber() and sha204e_read_config_zone().
+   Results are printed as comma separated lines:
+   scenario,ret_code,warm,commands,ms
+   ms is virtual bus time from the wake pulse to the last response. */
+
+#include <stdio.h>
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+#include "sha204_emulator_device.h"
+
+static uint8_t eeprom[1024];
+
+static void eeprom_read(void *context, uint16_t address, uint8_t *data, uint8_t count)
+{
+	(void) context;
+	memcpy(data, &eeprom[address], count);
+}
+
+static void eeprom_write(void *context, uint16_t address, const uint8_t *data, uint8_t count)
+{
+	(void) context;
+	memcpy(&eeprom[address], data, count);
+}
+
+static void baseline(sha204EmulatorDevice &device)
+{
+	atsha204Class sha204(0);
+	uint8_t response[SHA204_RSP_SIZE_MIN];
+	uint8_t serial[SHA204_WARM_SERIAL_SIZE];
+	uint8_t config[SHA204_CONFIG_SIZE];
+	unsigned long commands = device.commandCount();
+	unsigned long start_us;
+	uint8_t ret_code;
+
+	sha204.setHostDevice(&device);
+	start_us = host_clock_us();
+	ret_code = sha204.sha204c_wakeup(response);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = sha204.getSerialNumber(serial);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = sha204.sha204e_read_config_zone(config);
+	unsigned long us = host_clock_us() - start_us;
+	sha204.sha204p_sleep();
+	printf("baseline,0x%02X,0,%lu,%.1f\n", ret_code, device.commandCount() - commands, us / 1000.0);
+}
+
+static void boot(const char *name, sha204EmulatorDevice &device)
+{
+	atsha204Class sha204(0);
+	sha204WarmStart warm(sha204, eeprom_read, eeprom_write);
+	sha204_warm_result_t result;
+
+	sha204.setHostDevice(&device);
+	warm.begin(&result);
+	printf("%s,0x%02X,%u,%u,%.1f\n", name, result.ret_code, result.warm, result.commands, result.total_us / 1000.0);
+}
+
+int main()
+{
+	sha204EmulatorDevice device, other;
+
+	device.setTiming(SHA204_EMULATOR_TIMING_TYPICAL);
+	device.config[ADDRESS_LOCKCONFIG] = 0x00;
+	device.config[ADDRESS_LOCKVALUE] = 0x00;
+	other.setTiming(SHA204_EMULATOR_TIMING_TYPICAL);
+	other.config[ADDRESS_LOCKCONFIG] = 0x00;
+	other.config[ADDRESS_LOCKVALUE] = 0x00;
+	other.config[ADDRESS_SN47] ^= 0x01;
+
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	printf("scenario,ret_code,warm,commands,ms\n");
+	baseline(device);
+	boot("first_boot", device);
+	boot("next_boot", device);
+	boot("other_device", other);
+	boot("back_again", device);
+
+	// A flipped bit in the record makes the next boot read the device.
+	eeprom[5] ^= 0x01;
+	boot("corrupt_record", device);
+
+	// Locking the data zone later would make a stored lock word stale.
+	other.config[ADDRESS_LOCKVALUE] = 0x55;
+	boot("config_only_first", other);
+	boot("config_only_next", other);
+	return 0;
+}
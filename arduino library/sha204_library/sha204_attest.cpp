@@ -0,0 +1,149 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+sha204Attestor::sha204Attestor(atsha204Class &device, uint16_t key_id)
+{
+	this->device = &device;
+	this->key_id = key_id;
+	first = 0;
+	count = 0;
+	chained_hook = NULL;
+	chained_context = NULL;
+}
+
+/** \brief Adds an image to attest.
+ *
+ * \param[in] read      function that reads the image; it must not use the device
+ * \param[in] context   passed to read
+ * \param[in] size      image size in bytes
+ * \param[in] challenge 32 bytes hashed in front of the image so that the MAC is fresh;
+ *                      NULL for none
+ * \return SHA204_SUCCESS, SHA204_BAD_PARAM, or SHA204_FUNC_FAIL if
+ *         SHA204_ATTEST_IMAGES images are waiting already
+ */
+uint8_t sha204Attestor::add(sha204_image_read_t read, void *context, uint32_t size, const uint8_t *challenge)
+{
+	uint8_t index = (first + count) % SHA204_ATTEST_IMAGES;
+
+	if (!read)
+		return SHA204_BAD_PARAM;
+	if (count == SHA204_ATTEST_IMAGES)
+		return SHA204_FUNC_FAIL;
+
+	images[index].read = read;
+	images[index].context = context;
+	images[index].size = size;
+	images[index].offset = 0;
+	images[index].failed = 0;
+	images[index].hash.init();
+	if (challenge)
+		images[index].hash.update(challenge, MAC_CHALLENGE_SIZE);
+	count++;
+	return SHA204_SUCCESS;
+}
+
+/** \brief Hashes one chunk of the images that have been added.
+ *
+ * Call it when the sketch has nothing else to do, so that less hashing is left
+ * for attest().
+ *
+ * \return 1 if there is more to hash, 0 if not
+ */
+uint8_t sha204Attestor::hash()
+{
+	uint8_t i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (hashChunk((first + i) % SHA204_ATTEST_IMAGES))
+			return 1;
+	}
+	return 0;
+}
+
+/** \brief Attests the image that was added first.
+ *
+ * Hashes what is left of the image, then runs Nonce and MAC in one awake session.
+ * While the device executes them, the image added after it is hashed. The device's
+ * wait hook is set for this; a hook that was set before is still called and is
+ * restored afterwards.
+ *
+ * \param[out] digest SHA-256 of the challenge and the image; may be NULL
+ * \param[out] mac    32-byte MAC over the digest; may be NULL
+ * \return SHA204_SUCCESS, SHA204_FUNC_FAIL if no image was added or its read failed,
+ *         or the return code of the device
+ */
+uint8_t sha204Attestor::attest(uint8_t *digest, uint8_t *mac)
+{
+	uint8_t image_digest[NONCE_NUMIN_SIZE_PASSTHROUGH];
+	uint8_t response[MAC_RSP_SIZE];
+	sha204_auth_step_t steps[2] = {
+		{SHA204_NONCE, NONCE_MODE_PASSTHROUGH, 0, NONCE_NUMIN_SIZE_PASSTHROUGH, image_digest, 0, NULL, 0, NULL, NULL},
+		{SHA204_MAC, SHA204_ATTEST_MAC_MODE, key_id, 0, NULL, 0, NULL, 0, NULL, response},
+	};
+	sha204_auth_result_t result;
+	uint8_t index = first;
+	uint8_t ret_code;
+
+	if (!count)
+		return SHA204_FUNC_FAIL;
+
+	while (hashChunk(index))
+		;
+	// The image is done with either way.
+	first = (first + 1) % SHA204_ATTEST_IMAGES;
+	count--;
+	if (images[index].failed)
+		return SHA204_FUNC_FAIL;
+
+	images[index].hash.finish(image_digest);
+	if (digest)
+		memcpy(digest, image_digest, sizeof(image_digest));
+
+	chained_hook = device->getWaitHook(&chained_context);
+	device->setWaitHook(hashHook, this);
+	ret_code = device->authenticate(steps, 2, &result);
+	device->setWaitHook(chained_hook, chained_context);
+	if (ret_code == SHA204_SUCCESS && mac)
+		memcpy(mac, &response[SHA204_BUFFER_POS_DATA], MAC_CHALLENGE_SIZE);
+	return ret_code;
+}
+
+// Returns the number of images that have been added and not attested yet.
+uint8_t sha204Attestor::pending()
+{
+	return count;
+}
+
+// Wait hook while the device executes: calls the hook it replaced, then hashes
+// the next image for what is left of one hook interval.
+void sha204Attestor::hashHook(void *context)
+{
+	sha204Attestor *attestor = (sha204Attestor *) context;
+	unsigned long start_us = micros();
+
+	if (attestor->chained_hook)
+		attestor->chained_hook(attestor->chained_context);
+	while (attestor->hash() && micros() - start_us < SHA204_WAIT_HOOK_INTERVAL)
+		;
+}
+
+// Reads and hashes the next chunk of an image. Returns 1 if more is left.
+uint8_t sha204Attestor::hashChunk(uint8_t index)
+{
+	uint8_t chunk[SHA204_ATTEST_CHUNK];
+	uint32_t left = images[index].size - images[index].offset;
+	uint16_t length = left < SHA204_ATTEST_CHUNK ? (uint16_t) left : SHA204_ATTEST_CHUNK;
+
+	if (!left || images[index].failed)
+		return 0;
+	if (images[index].read(images[index].context, images[index].offset, chunk, length) != length)
+	{
+		images[index].failed = 1;
+		return 0;
+	}
+	images[index].hash.update(chunk, length);
+	images[index].offset += length;
+	return images[index].offset < images[index].size;
+}
@@ -0,0 +1,107 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+/** \brief Runs a sequence of commands, for example Nonce, GenDig and CheckMac, in one awake session.
+ *
+ * All steps are checked before the device is woken. The device is woken once,
+ * the steps run in order, and the device is put to sleep after the last step
+ * or the first one that fails. While a command executes, the packet of the next
+ * step is assembled in the other of two command buffers (2 * 84 bytes of stack),
+ * so marshaling and CRC add no time between the commands.
+ *
+ * \param[in] steps       commands to run
+ * \param[in] step_count  number of steps, at most SHA204_AUTH_STEPS_MAX
+ * \param[out] result     aggregated result and timing
+ * \param[in] idle        1 to put the device into idle mode instead of sleep at the end,
+ *                        which keeps TempKey for a later transaction
+ * \return status of the transaction, also stored in result->ret_code;
+ *         SHA204_FUNC_FAIL if a step answered with a non-zero status, as CheckMac does
+ *         for a client response that does not match
+ */
+uint8_t atsha204Class::authenticate(const sha204_auth_step_t *steps, uint8_t step_count, sha204_auth_result_t *result,
+		uint8_t idle)
+{
+	uint8_t tx_buffer[2][SHA204_CMD_SIZE_MAX];
+	uint8_t response[SHA204_RSP_SIZE_MAX];
+	uint8_t *rx_buffer;
+	uint8_t poll_delay, poll_timeout, response_size;
+	uint8_t ret_code = SHA204_SUCCESS;
+	uint8_t i;
+	unsigned long start_us;
+
+	if (!steps || !result || !step_count || step_count > SHA204_AUTH_STEPS_MAX)
+		return SHA204_BAD_PARAM;
+
+	result->steps_done = 0;
+	result->status = 0;
+	result->total_us = 0;
+	for (i = 0; i < SHA204_AUTH_STEPS_MAX; i++)
+		result->step_us[i] = 0;
+
+	// Check every step up front so that a bad one does not cut the session short.
+	for (i = 0; i < step_count && ret_code == SHA204_SUCCESS; i++)
+	{
+		const sha204_auth_step_t *step = &steps[i];
+
+		if ((uint16_t) step->datalen1 + step->datalen2 + step->datalen3 + SHA204_CMD_SIZE_MIN > SHA204_CMD_SIZE_MAX)
+			ret_code = SHA204_BAD_PARAM;
+		else
+			ret_code = sha204m_check_parameters(step->op_code, step->param1, step->param2,
+						step->datalen1, step->data1, step->datalen2, step->data2, step->datalen3, step->data3,
+						SHA204_CMD_SIZE_MAX, tx_buffer[0], SHA204_RSP_SIZE_MAX, response);
+		result->steps_done = i;
+	}
+	if (ret_code != SHA204_SUCCESS)
+	{
+		result->ret_code = ret_code;
+		return ret_code;
+	}
+	result->steps_done = 0;
+
+	start_us = micros();
+	sha204m_assemble(steps[0].op_code, steps[0].param1, steps[0].param2, steps[0].datalen1, steps[0].data1,
+				steps[0].datalen2, steps[0].data2, steps[0].datalen3, steps[0].data3, tx_buffer[0]);
+	ret_code = sha204c_wakeup(response);
+
+	for (i = 0; i < step_count && ret_code == SHA204_SUCCESS; i++)
+	{
+		const sha204_auth_step_t *step = &steps[i];
+		unsigned long step_start_us;
+
+		// Let the execution delay of this step assemble the next one.
+		if (i + 1 < step_count)
+		{
+			prepare_step = &steps[i + 1];
+			prepare_buffer = tx_buffer[(i + 1) & 1];
+		}
+
+		response_size = SHA204_RSP_SIZE_MAX;
+		sha204m_command_timing(step->op_code, step->param1, &poll_delay, &poll_timeout, &response_size);
+		rx_buffer = step->rx_buffer ? step->rx_buffer : response;
+
+		step_start_us = micros();
+		ret_code = sha204c_exchange(tx_buffer[i & 1], response_size, rx_buffer, poll_delay, poll_timeout, NULL, 1);
+		result->step_us[i] = micros() - step_start_us;
+		if (ret_code != SHA204_SUCCESS)
+			break;
+
+		if (rx_buffer[SHA204_BUFFER_POS_COUNT] == SHA204_RSP_SIZE_MIN)
+		{
+			result->status = rx_buffer[SHA204_BUFFER_POS_STATUS];
+			if (result->status)
+				ret_code = SHA204_FUNC_FAIL;
+		}
+		if (ret_code == SHA204_SUCCESS)
+			result->steps_done++;
+	}
+	prepare_step = NULL;
+	result->total_us = micros() - start_us;
+
+	if (idle)
+		sha204p_idle();
+	else
+		sha204p_sleep();
+	result->ret_code = ret_code;
+	return ret_code;
+}
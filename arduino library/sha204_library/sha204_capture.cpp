@@ -0,0 +1,91 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#if defined(SHA204_CAPTURE)
+
+/** \brief Starts capturing into a caller supplied ring buffer.
+ *
+ * When the buffer is full the oldest records are dropped.
+ * \param[in] buffer capture memory; must stay valid until captureEnd() is called
+ * \param[in] size   size of buffer in bytes
+ */
+void atsha204Class::captureBegin(uint8_t *buffer, uint16_t size)
+{
+	capture_buffer = buffer;
+	capture_size = size;
+	captureClear();
+}
+
+void atsha204Class::captureEnd()
+{
+	capture_buffer = NULL;
+	capture_size = 0;
+	captureClear();
+}
+
+void atsha204Class::captureClear()
+{
+	capture_head = capture_tail = capture_used = 0;
+}
+
+void atsha204Class::sha204p_capture(uint8_t type, uint8_t status, uint8_t length, const uint8_t *data)
+{
+	uint16_t record_size = SHA204_CAPTURE_HEADER_SIZE + length;
+	uint8_t header[SHA204_CAPTURE_HEADER_SIZE];
+	uint32_t now = micros();
+	uint8_t i;
+
+	if (!capture_buffer || record_size > capture_size)
+		return;
+
+	// Drop the oldest records until the new one fits.
+	while (capture_size - capture_used < record_size) {
+		uint16_t length_index = (capture_tail + SHA204_CAPTURE_HEADER_SIZE - 1) % capture_size;
+		uint16_t oldest_size = SHA204_CAPTURE_HEADER_SIZE + capture_buffer[length_index];
+		capture_tail = (capture_tail + oldest_size) % capture_size;
+		capture_used -= oldest_size;
+	}
+
+	header[0] = type;
+	header[1] = (uint8_t) now;
+	header[2] = (uint8_t) (now >> 8);
+	header[3] = (uint8_t) (now >> 16);
+	header[4] = (uint8_t) (now >> 24);
+	header[5] = status;
+	header[6] = length;
+
+	for (i = 0; i < SHA204_CAPTURE_HEADER_SIZE; i++) {
+		capture_buffer[capture_head] = header[i];
+		if (++capture_head == capture_size)
+			capture_head = 0;
+	}
+	for (i = 0; i < length; i++) {
+		capture_buffer[capture_head] = data[i];
+		if (++capture_head == capture_size)
+			capture_head = 0;
+	}
+	capture_used += record_size;
+}
+
+/** \brief Writes the captured records in the export format described in sha204_library.h.
+ *
+ * \param[in] out destination, e.g. Serial
+ * \return number of bytes written
+ */
+uint16_t atsha204Class::captureExport(Print &out)
+{
+	uint16_t i;
+	uint16_t index = capture_tail;
+
+	out.write((const uint8_t *) "S204", 4);
+	out.write(SHA204_CAPTURE_VERSION);
+	for (i = 0; i < capture_used; i++) {
+		out.write(capture_buffer[index]);
+		if (++index == capture_size)
+			index = 0;
+	}
+	return capture_used + 5;
+}
+
+#endif
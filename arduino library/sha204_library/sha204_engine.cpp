@@ -0,0 +1,314 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+// States of an engine slot
+#define ENGINE_FREE        ((uint8_t) 0)   // not in use
+#define ENGINE_SERIAL      ((uint8_t) 1)   // serial number received, waiting for a random
+#define ENGINE_CHALLENGED  ((uint8_t) 2)   // challenge sent, waiting for the MAC
+#define ENGINE_ANSWERED    ((uint8_t) 3)   // MAC received, waiting for CheckMac
+
+sha204AuthEngine::sha204AuthEngine(atsha204Class &device, sha204Link &link, const sha204_engine_scheme_t *scheme)
+{
+	uint8_t i;
+
+	this->device = &device;
+	this->link = &link;
+	this->scheme = scheme;
+	random_ready = 0;
+	primed = SHA204_ENGINE_NONE;
+	working = SHA204_ENGINE_NONE;
+	for (i = 0; i < SHA204_ENGINE_SLOTS; i++)
+	{
+		slots[i].state = ENGINE_FREE;
+		slots[i].since = 0;
+	}
+	resetStats();
+	device.setWaitHook(drain, this);
+}
+
+/** \brief Takes in the frames that have arrived, then does at most one piece of device work.
+ *
+ * Call it from loop() as often as possible. The device work is, in order of
+ * priority: checking a MAC that has arrived, generating a random for a client
+ * waiting for its challenge, running Nonce and GenDig for the oldest challenged
+ * client, and generating the random for the next client. The random of the next
+ * challenge is generated in the same wake cycle as other work when one is needed.
+ *
+ * \return SHA204_SUCCESS, or the return code of device work that failed.
+ *         A MAC that does not match is reported to its client, not here.
+ */
+uint8_t sha204AuthEngine::poll()
+{
+	sha204_auth_step_t step = {SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, 0, 0, NULL, 0, NULL, 0, NULL, NULL};
+	sha204_auth_result_t result;
+	uint8_t channel, seq, slot, ret_code;
+
+	takeIn();
+	while (link->expired(SHA204_ENGINE_TIMEOUT, &channel, &seq) == SHA204_SUCCESS)
+	{
+		for (slot = 0; slot < SHA204_ENGINE_SLOTS; slot++)
+		{
+			if (slots[slot].state == ENGINE_CHALLENGED && slots[slot].channel == channel && slots[slot].seq == seq)
+			{
+				slots[slot].state = ENGINE_FREE;
+				if (primed == slot)
+					primed = SHA204_ENGINE_NONE;
+				stats.expired++;
+			}
+		}
+	}
+
+	slot = oldest(ENGINE_ANSWERED);
+	if (slot != SHA204_ENGINE_NONE)
+		return verify(slot);
+
+	slot = oldest(ENGINE_SERIAL);
+	if (slot != SHA204_ENGINE_NONE)
+	{
+		if (!random_ready)
+		{
+			ret_code = run(&step, 0, &result);
+			if (ret_code != SHA204_SUCCESS)
+				return ret_code;
+		}
+		return challenge(slot);
+	}
+
+	if (primed == SHA204_ENGINE_NONE)
+	{
+		slot = oldest(ENGINE_CHALLENGED);
+		if (slot != SHA204_ENGINE_NONE)
+			return prime(slot);
+	}
+
+	if (!random_ready)
+		return run(&step, 0, &result);
+	return SHA204_SUCCESS;
+}
+
+// Returns the number of clients being authenticated.
+uint8_t sha204AuthEngine::pending()
+{
+	uint8_t i, n = 0;
+
+	for (i = 0; i < SHA204_ENGINE_SLOTS; i++)
+		n += slots[i].state != ENGINE_FREE;
+	return n;
+}
+
+const sha204_engine_stats_t *sha204AuthEngine::getStats()
+{
+	return &stats;
+}
+
+void sha204AuthEngine::resetStats()
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+// Wait hook of the device
+void sha204AuthEngine::drain(void *context)
+{
+	((sha204AuthEngine *) context)->takeIn();
+}
+
+void sha204AuthEngine::takeIn()
+{
+	sha204_link_frame_t frame;
+	uint8_t ret_code;
+
+	while ((ret_code = link->poll(&frame)) != SHA204_RX_NO_RESPONSE)
+	{
+		if (ret_code == SHA204_SUCCESS)
+			receive(&frame);
+	}
+}
+
+void sha204AuthEngine::receive(const sha204_link_frame_t *frame)
+{
+	uint8_t slot;
+
+	if (frame->type == SHA204_LINK_SERIAL && frame->length == NONCE_NUMIN_SIZE_PASSTHROUGH)
+	{
+		// A client that sends its serial number again has given up on its challenge.
+		for (slot = 0; slot < SHA204_ENGINE_SLOTS; slot++)
+		{
+			if (slots[slot].state != ENGINE_FREE && slots[slot].channel == frame->channel)
+				break;
+		}
+		if (slot == SHA204_ENGINE_SLOTS)
+			slot = oldest(ENGINE_FREE);
+		if (slot == SHA204_ENGINE_NONE || slot == working)
+		{
+			// The client sends its serial number again after a while.
+			stats.busy++;
+			return;
+		}
+		if (primed == slot)
+			primed = SHA204_ENGINE_NONE;
+
+		slots[slot].state = ENGINE_SERIAL;
+		slots[slot].channel = frame->channel;
+		slots[slot].since = millis();
+		memcpy(slots[slot].serial, frame->payload, NONCE_NUMIN_SIZE_PASSTHROUGH);
+		if (random_ready && oldest(ENGINE_SERIAL) == slot && challenge(slot) == SHA204_SUCCESS)
+			stats.ahead++;
+	}
+	else if (frame->type == SHA204_LINK_RESPONSE && frame->answered && frame->length == CHECKMAC_CLIENT_RESPONSE_SIZE)
+	{
+		for (slot = 0; slot < SHA204_ENGINE_SLOTS; slot++)
+		{
+			if (slots[slot].state == ENGINE_CHALLENGED && slots[slot].channel == frame->channel && slots[slot].seq == frame->seq)
+			{
+				memcpy(slots[slot].mac, frame->payload, CHECKMAC_CLIENT_RESPONSE_SIZE);
+				slots[slot].state = ENGINE_ANSWERED;
+				slots[slot].since = millis();
+				break;
+			}
+		}
+	}
+}
+
+// Returns the slot that has been in the given state the longest, or SHA204_ENGINE_NONE.
+uint8_t sha204AuthEngine::oldest(uint8_t state)
+{
+	uint8_t i, slot = SHA204_ENGINE_NONE;
+	unsigned long now = millis();
+
+	for (i = 0; i < SHA204_ENGINE_SLOTS; i++)
+	{
+		if (slots[i].state == state && (slot == SHA204_ENGINE_NONE || now - slots[i].since > now - slots[slot].since))
+			slot = i;
+	}
+	return slot;
+}
+
+// Sends the random that was generated ahead of time as the challenge of a slot.
+uint8_t sha204AuthEngine::challenge(uint8_t slot)
+{
+	uint8_t ret_code = link->request(slots[slot].channel, SHA204_LINK_CHALLENGE, random, MAC_CHALLENGE_SIZE, &slots[slot].seq);
+
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	memcpy(slots[slot].challenge, random, MAC_CHALLENGE_SIZE);
+	random_ready = 0;
+	slots[slot].state = ENGINE_CHALLENGED;
+	slots[slot].since = millis();
+	return SHA204_SUCCESS;
+}
+
+/* Runs a transaction, with a Random step after the given ones if no random is
+ * ready. steps must have room for it. The device idles instead of sleeping
+ * while TempKey holds a client key. */
+uint8_t sha204AuthEngine::run(sha204_auth_step_t *steps, uint8_t step_count, sha204_auth_result_t *result)
+{
+	uint8_t response[RANDOM_RSP_SIZE];
+	uint8_t random_step = step_count;
+	uint8_t ret_code;
+
+	if (!random_ready)
+	{
+		sha204_auth_step_t step = {SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, 0, 0, NULL, 0, NULL, 0, NULL, response};
+		steps[step_count++] = step;
+	}
+
+	ret_code = device->authenticate(steps, step_count, result, primed != SHA204_ENGINE_NONE);
+	if (random_step < step_count && result->steps_done > random_step)
+	{
+		memcpy(random, &response[SHA204_BUFFER_POS_DATA], MAC_CHALLENGE_SIZE);
+		random_ready = 1;
+	}
+	return ret_code;
+}
+
+// Fills in Nonce and GenDig, which load TempKey with the diversified key of a slot.
+void sha204AuthEngine::keySteps(uint8_t slot, sha204_auth_step_t *steps)
+{
+	sha204_auth_step_t nonce = {SHA204_NONCE, NONCE_MODE_PASSTHROUGH, 0, NONCE_NUMIN_SIZE_PASSTHROUGH, slots[slot].serial,
+			0, NULL, 0, NULL, NULL};
+	sha204_auth_step_t gendig = {SHA204_GENDIG, GENDIG_ZONE_DATA, scheme->parent_key, GENDIG_OTHER_DATA_SIZE,
+			(uint8_t *) scheme->derive_key_command, 0, NULL, 0, NULL, NULL};
+
+	steps[0] = nonce;
+	steps[1] = gendig;
+}
+
+// Loads TempKey with the diversified key of a challenged client and leaves
+// the device idle, so that its MAC can be checked with CheckMac alone.
+uint8_t sha204AuthEngine::prime(uint8_t slot)
+{
+	sha204_auth_result_t result;
+	sha204_auth_step_t steps[3];
+	uint8_t ret_code;
+
+	keySteps(slot, steps);
+	primed = working = slot;
+	ret_code = run(steps, 2, &result);
+	if (result.steps_done < 2)
+		primed = SHA204_ENGINE_NONE;
+	working = SHA204_ENGINE_NONE;
+	return ret_code;
+}
+
+/* Checks the MAC of a slot and sends the client its result. CheckMac uses up
+ * TempKey, so the same transaction primes the next challenged client. */
+uint8_t sha204AuthEngine::verify(uint8_t slot)
+{
+	sha204_auth_result_t result;
+	sha204_auth_step_t steps[6];
+	sha204_auth_step_t checkmac = {SHA204_CHECKMAC, scheme->checkmac_mode, 0, CHECKMAC_CLIENT_CHALLENGE_SIZE,
+			slots[slot].challenge, CHECKMAC_CLIENT_RESPONSE_SIZE, slots[slot].mac,
+			CHECKMAC_OTHER_DATA_SIZE, (uint8_t *) scheme->checkmac_other_data, NULL};
+	uint8_t was_primed = primed == slot;
+	uint8_t next = oldest(ENGINE_CHALLENGED);
+	uint8_t step_count, check_count;
+	uint8_t ret_code;
+
+	working = slot;
+	for (;;)
+	{
+		// Unless TempKey holds the key of this client, it is loaded first.
+		step_count = 0;
+		if (!was_primed)
+		{
+			keySteps(slot, steps);
+			step_count = 2;
+		}
+		steps[step_count++] = checkmac;
+		check_count = step_count;
+		if (next != SHA204_ENGINE_NONE)
+		{
+			keySteps(next, &steps[step_count]);
+			step_count += 2;
+		}
+
+		primed = next;
+		ret_code = run(steps, step_count, &result);
+		if (result.steps_done < check_count + 2)
+			primed = SHA204_ENGINE_NONE;
+		if (!was_primed || result.steps_done || result.status == SHA204_STATUS_BYTE_MISCOMPARE)
+			break;
+		// TempKey was lost, for example to the watchdog. Start over.
+		was_primed = 0;
+	}
+	working = SHA204_ENGINE_NONE;
+	if (was_primed)
+		stats.primed++;
+	else
+		stats.unprimed++;
+
+	// A failed step after a matching CheckMac does not fail the client.
+	if (ret_code != SHA204_SUCCESS && result.steps_done >= check_count)
+		ret_code = SHA204_SUCCESS;
+	if (ret_code == SHA204_SUCCESS)
+		stats.passed++;
+	else if (ret_code == SHA204_FUNC_FAIL && result.status == SHA204_STATUS_BYTE_MISCOMPARE)
+		stats.failed++;
+	else
+		stats.errors++;
+
+	link->send(slots[slot].channel, SHA204_LINK_RESULT, slots[slot].seq, &ret_code, 1);
+	slots[slot].state = ENGINE_FREE;
+	return ret_code == SHA204_FUNC_FAIL && result.status == SHA204_STATUS_BYTE_MISCOMPARE ? SHA204_SUCCESS : ret_code;
+}
@@ -0,0 +1,94 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#if defined(SHA204_HEALTH)
+
+const sha204_health_t *atsha204Class::getHealth()
+{
+	return &health;
+}
+
+// Closes the circuit and clears the counters. The limits are kept.
+void atsha204Class::resetHealth()
+{
+	health.state = SHA204_HEALTH_CLOSED;
+	health.consecutive_failures = 0;
+	health.error_rate = 0;
+	health.opened_at = 0;
+	health.calls = health.failures = health.rejected = health.opens = 0;
+}
+
+/** \brief Sets when the circuit opens and how long it stays open.
+ *
+ * \param[in] max_failures   consecutive failures that open the circuit
+ * \param[in] max_error_rate error rate (of 255) that opens the circuit, 0 to ignore the error rate
+ * \param[in] probe_interval ms until an open circuit lets a probe call through
+ */
+void atsha204Class::setHealthLimits(uint8_t max_failures, uint8_t max_error_rate, uint16_t probe_interval)
+{
+	health.max_failures = max_failures;
+	health.max_error_rate = max_error_rate;
+	health.probe_interval = probe_interval;
+}
+
+// Returns whether the next call would be let through. A multi-device
+// sketch can use this to pick a device that is likely to answer.
+uint8_t atsha204Class::isAvailable()
+{
+	return health.state != SHA204_HEALTH_OPEN || millis() - health.opened_at >= health.probe_interval;
+}
+
+uint8_t atsha204Class::sha204c_health_admit()
+{
+	if (health.state == SHA204_HEALTH_OPEN) {
+		if (millis() - health.opened_at < health.probe_interval) {
+			health.rejected++;
+			return 0;
+		}
+		// Let this call through as a probe.
+		health.state = SHA204_HEALTH_HALF_OPEN;
+	}
+	return 1;
+}
+
+uint8_t atsha204Class::sha204c_health_record(uint8_t ret_code)
+{
+	// A status response means the device is alive.
+	uint8_t failed = ret_code != SHA204_SUCCESS && ret_code != SHA204_PARSE_ERROR
+			&& ret_code != SHA204_CMD_FAIL;
+
+	health.calls++;
+	health.error_rate -= health.error_rate >> 3;
+	if (failed) {
+		health.failures++;
+		health.error_rate += (255 - health.error_rate) >> 3;
+		if (health.consecutive_failures < 255)
+			health.consecutive_failures++;
+	}
+	else
+		health.consecutive_failures = 0;
+
+	if (health.state == SHA204_HEALTH_HALF_OPEN) {
+		if (failed) {
+			health.state = SHA204_HEALTH_OPEN;
+			health.opened_at = millis();
+			health.opens++;
+		}
+		else {
+			// Start over so that failures from before the outage do not reopen the circuit.
+			health.state = SHA204_HEALTH_CLOSED;
+			health.error_rate = 0;
+		}
+	}
+	else if (failed && (health.consecutive_failures >= health.max_failures
+			|| (health.max_error_rate && health.calls >= SHA204_HEALTH_MIN_CALLS
+				&& health.error_rate >= health.max_error_rate))) {
+		health.state = SHA204_HEALTH_OPEN;
+		health.opened_at = millis();
+		health.opens++;
+	}
+	return ret_code;
+}
+
+#endif
@@ -44,5 +44,7 @@
 
 #define SHA204_COMM_FAIL            ((uint8_t)  0xF0) //!< Communication with device failed. Same as in hardware dependent modules.
 #define SHA204_TIMEOUT              ((uint8_t)  0xF1) //!< Timed out while waiting for response. Number of bytes received is 0.
+#define SHA204_DEADLINE             ((uint8_t)  0xF2) //!< Gave up because the next wait would have exceeded the deadline of the retry policy.
+#define SHA204_CIRCUIT_OPEN         ((uint8_t)  0xF4) //!< Device failed too often. Calls fail until the probe interval has passed.
 
 #endif
@@ -2,6 +2,50 @@
 #include "sha204_library.h"
 #include "sha204_includes/sha204_lib_return_codes.h"
 
+// Statistics hooks. They expand to nothing unless SHA204_STATS is defined.
+#if defined(SHA204_STATS)
+#define SHA204_STATS_INC(counter)     (stats.counter++)
+#define SHA204_STATS_START()          unsigned long stats_start_us = micros()
+#define SHA204_STATS_DONE(ret_code)   sha204c_stats_record(tx_buffer[SHA204_OPCODE_IDX], stats_start_us, (ret_code))
+#else
+#define SHA204_STATS_INC(counter)     do {} while (0)
+#define SHA204_STATS_START()
+#define SHA204_STATS_DONE(ret_code)   (ret_code)
+#endif
+
+// Circuit breaker hooks. They expand to nothing unless SHA204_HEALTH is defined.
+#if defined(SHA204_HEALTH)
+#define SHA204_HEALTH_ADMIT()         do { if (!sha204c_health_admit()) return SHA204_CIRCUIT_OPEN; } while (0)
+#define SHA204_HEALTH_DONE(ret_code)  sha204c_health_record(ret_code)
+#else
+#define SHA204_HEALTH_ADMIT()         do {} while (0)
+#define SHA204_HEALTH_DONE(ret_code)  (ret_code)
+#endif
+
+// Response cache hooks. They expand to nothing unless SHA204_MEMO is defined.
+#if defined(SHA204_MEMO)
+#define SHA204_MEMO_LOOKUP()          do { if (sha204c_memo_lookup(tx_buffer, rx_size, rx_buffer)) return SHA204_SUCCESS; } while (0)
+#define SHA204_MEMO_STORE(ret_code)   sha204c_memo_store(tx_buffer, rx_buffer, ret_code)
+#else
+#define SHA204_MEMO_LOOKUP()          do {} while (0)
+#define SHA204_MEMO_STORE(ret_code)   (ret_code)
+#endif
+
+// Bookkeeping at every exit of sha204c_send_and_receive.
+#define SHA204_TRANSACTION_DONE(ret_code) \
+  (SHA204_TRACE_FINISH(SHA204_TRACE_TRANSACTION), SHA204_HEALTH_DONE(SHA204_STATS_DONE(ret_code)))
+
+// Packet capture hook. It expands to nothing unless SHA204_CAPTURE is defined.
+#if defined(SHA204_CAPTURE)
+#define SHA204_CAPTURE_EVENT(type, status, length, data)   sha204p_capture(type, status, length, data)
+#else
+#define SHA204_CAPTURE_EVENT(type, status, length, data)   do {} while (0)
+#endif
+
+
+#if !defined(SHA204_SWI_ARM) && !defined(SHA204_SWI_HOST)
+// The 32-bit ARM backend in sha204_swi_arm.cpp and the host backend in
+// sha204_swi_host.cpp replace the constructor and the SWI bit bang functions below.
 
 // atsha204Class Constructor
 // Feed this function the Arduino-ized pin number you want to assign to the ATSHA204's SDA pin
@@ -18,6 +62,32 @@ atsha204Class::atsha204Class(uint8_t pin)
 	device_port_OUT = portOutputRegister(port);
 	// Point to input register of pin
 	device_port_IN = portInputRegister(port);
+	init();
+}
+#endif
+
+// Sets the members that do not depend on the backend. Called by the constructor
+// of every backend.
+void atsha204Class::init()
+{
+	setRetryPolicy(NULL);
+	prepare_step = NULL;
+	setWaitHook(NULL, NULL);
+	setVariant(SHA204_VARIANT_UNKNOWN);
+
+#if defined(SHA204_STATS)
+	resetStats();
+#endif
+#if defined(SHA204_HEALTH)
+	setHealthLimits(SHA204_HEALTH_MAX_FAILURES, SHA204_HEALTH_MAX_ERROR_RATE, SHA204_HEALTH_PROBE_INTERVAL);
+	resetHealth();
+#endif
+#if defined(SHA204_MEMO)
+	memoClear();
+#endif
+#if defined(SHA204_CAPTURE)
+	captureEnd();
+#endif
 }
 
 /* 	Puts a the ATSHA204's unique, 4-byte serial number in the response array 
@@ -52,6 +122,8 @@ uint8_t atsha204Class::getSerialNumber(uint8_t * response)
 
 /* SWI bit bang functions */
 
+#if !defined(SHA204_SWI_ARM) && !defined(SHA204_SWI_HOST)
+
 void atsha204Class::swi_set_signal_pin(uint8_t is_high)
 {
   *device_port_DDR |= device_pin;
@@ -62,22 +134,31 @@ void atsha204Class::swi_set_signal_pin(uint8_t is_high)
     *device_port_OUT &= ~device_pin;
 }
 
+#if !defined(SHA204_SWI_SPI_TX)
+// The SPI transmitter in sha204_swi_spi.cpp replaces this function
+// when SHA204_SWI_SPI_TX is defined.
 uint8_t atsha204Class::swi_send_bytes(uint8_t count, uint8_t *buffer)
 {
   uint8_t i, bit_mask;
 
   // Disable interrupts while sending.
   noInterrupts();  //swi_disable_interrupts();
+  SHA204_TRACE_BEGIN(SHA204_TRACE_MASK);
 
   // Set signal pin as output.
   *device_port_OUT |= device_pin;
   *device_port_DDR |= device_pin;
 
   // Wait turn around time.
+  SHA204_TRACE_BEGIN(SHA204_TRACE_TURNAROUND);
   delayMicroseconds(RX_TX_DELAY);  //RX_TX_DELAY;
+  SHA204_TRACE_FINISH(SHA204_TRACE_TURNAROUND);
 
   for (i = 0; i < count; i++) 
   {
+    // Keeps the trace clock consistent while interrupts are disabled.
+    SHA204_TRACE_TICK();
+
     for (bit_mask = 1; bit_mask > 0; bit_mask <<= 1) 
     {
       if (bit_mask & buffer[i]) 
@@ -101,15 +182,15 @@ uint8_t atsha204Class::swi_send_bytes(uint8_t count, uint8_t *buffer)
       }
     }
   }
+  SHA204_TRACE_FINISH(SHA204_TRACE_MASK);
   interrupts();  //swi_enable_interrupts();
   return SWI_FUNCTION_RETCODE_SUCCESS;
 }
+#endif
 
-uint8_t atsha204Class::swi_send_byte(uint8_t value)
-{
-  return swi_send_bytes(1, &value);
-}
-
+#if !defined(SHA204_SWI_ICP)
+// The input capture receiver in sha204_swi_icp.cpp replaces this function
+// when SHA204_SWI_ICP is defined.
 uint8_t atsha204Class::swi_receive_bytes(uint8_t count, uint8_t *buffer) 
 {
   uint8_t status = SWI_FUNCTION_RETCODE_SUCCESS;
@@ -120,6 +201,7 @@ uint8_t atsha204Class::swi_receive_bytes(uint8_t count, uint8_t *buffer)
 
   // Disable interrupts while receiving.
   noInterrupts(); //swi_disable_interrupts();
+  SHA204_TRACE_BEGIN(SHA204_TRACE_MASK);
 
   // Configure signal pin as input.
   *device_port_DDR &= ~device_pin;
@@ -202,7 +284,18 @@ uint8_t atsha204Class::swi_receive_bytes(uint8_t count, uint8_t *buffer)
 
     if (status != SWI_FUNCTION_RETCODE_SUCCESS)
       break;
+
+    // The count byte tells how long the response is. Stop right after its
+    // last byte instead of waiting for a start pulse that never comes.
+#if !defined(SHA204_RX_FULL_SIZE)
+    if (i == SHA204_BUFFER_POS_COUNT && buffer[i] >= SHA204_RSP_SIZE_MIN && buffer[i] < count)
+      count = buffer[i];
+#endif
+
+    // Keeps the trace clock consistent while interrupts are disabled.
+    SHA204_TRACE_TICK();
   }
+  SHA204_TRACE_FINISH(SHA204_TRACE_MASK);
   interrupts(); //swi_enable_interrupts();
 
   if (status == SWI_FUNCTION_RETCODE_TIMEOUT) 
@@ -213,27 +306,46 @@ uint8_t atsha204Class::swi_receive_bytes(uint8_t count, uint8_t *buffer)
   }
   return status;
 }
+#endif
+#endif
+
+uint8_t atsha204Class::swi_send_byte(uint8_t value)
+{
+  return swi_send_bytes(1, &value);
+}
 
 /* Physical functions */
 
 uint8_t atsha204Class::sha204p_wakeup()
 {
+  SHA204_TRACE_BEGIN(SHA204_TRACE_WAKE);
   swi_set_signal_pin(0);
   delayMicroseconds(10*SHA204_WAKEUP_PULSE_WIDTH);
   swi_set_signal_pin(1);
   delay(SHA204_WAKEUP_DELAY);
+  SHA204_TRACE_FINISH(SHA204_TRACE_WAKE);
+  SHA204_CAPTURE_EVENT(SHA204_CAPTURE_WAKE, SHA204_SUCCESS, 0, NULL);
 
   return SHA204_SUCCESS;
 }
 
 uint8_t atsha204Class::sha204p_sleep()
 {
+  SHA204_CAPTURE_EVENT(SHA204_CAPTURE_SLEEP, SHA204_SUCCESS, 0, NULL);
   return swi_send_byte(SHA204_SWI_FLAG_SLEEP);
 }
 
-uint8_t atsha204Class::sha204p_resync(uint8_t size, uint8_t *response)
+// Idle mode keeps TempKey, which sleep clears. The watchdog starts over with the next wake.
+uint8_t atsha204Class::sha204p_idle()
 {
-  delay(SHA204_SYNC_TIMEOUT);
+  SHA204_CAPTURE_EVENT(SHA204_CAPTURE_IDLE, SHA204_SUCCESS, 0, NULL);
+  return swi_send_byte(SHA204_SWI_FLAG_IDLE);
+}
+
+uint8_t atsha204Class::sha204p_resync(uint8_t size, uint8_t *response, uint8_t delay_ms)
+{
+  SHA204_CAPTURE_EVENT(SHA204_CAPTURE_RESYNC, SHA204_SUCCESS, 0, NULL);
+  delay(delay_ms);
   return sha204p_receive_response(size, response);
 }
 
@@ -248,38 +360,81 @@ uint8_t atsha204Class::sha204p_receive_response(uint8_t size, uint8_t *response)
 
   (void) swi_send_byte(SHA204_SWI_FLAG_TX);
 
+  SHA204_TRACE_BEGIN(SHA204_TRACE_RECEIVE);
   ret_code = swi_receive_bytes(size, response);
+  SHA204_TRACE_FINISH(SHA204_TRACE_RECEIVE);
   if (ret_code == SWI_FUNCTION_RETCODE_SUCCESS || ret_code == SWI_FUNCTION_RETCODE_RX_FAIL) 
   {
     count_byte = response[SHA204_BUFFER_POS_COUNT];
     if ((count_byte < SHA204_RSP_SIZE_MIN) || (count_byte > size))
-      return SHA204_INVALID_SIZE;
-
-    return SHA204_SUCCESS;
+      ret_code = SHA204_INVALID_SIZE;
+    else
+      ret_code = SHA204_SUCCESS;
+    SHA204_CAPTURE_EVENT(SHA204_CAPTURE_RX, ret_code, count_byte < size ? count_byte : size, response);
+    return ret_code;
   }
 
   // Translate error so that the Communication layer
   // can distinguish between a real error or the
   // device being busy executing a command.
   if (ret_code == SWI_FUNCTION_RETCODE_TIMEOUT)
-    return SHA204_RX_NO_RESPONSE;
+    ret_code = SHA204_RX_NO_RESPONSE;
   else
-    return SHA204_RX_FAIL;
+    ret_code = SHA204_RX_FAIL;
+  SHA204_CAPTURE_EVENT(SHA204_CAPTURE_RX, ret_code, 0, NULL);
+  return ret_code;
 }
 
 uint8_t atsha204Class::sha204p_send_command(uint8_t count, uint8_t * command)
 {
+  SHA204_TRACE_BEGIN(SHA204_TRACE_FLAG);
   uint8_t ret_code = swi_send_byte(SHA204_SWI_FLAG_CMD);
+  SHA204_TRACE_FINISH(SHA204_TRACE_FLAG);
   if (ret_code != SWI_FUNCTION_RETCODE_SUCCESS)
     return SHA204_COMM_FAIL;
 
-  return swi_send_bytes(count, command);
+  SHA204_TRACE_BEGIN(SHA204_TRACE_COMMAND);
+  ret_code = swi_send_bytes(count, command);
+  SHA204_TRACE_FINISH(SHA204_TRACE_COMMAND);
+  SHA204_CAPTURE_EVENT(SHA204_CAPTURE_TX, ret_code, count, command);
+  return ret_code;
 }
 
 /* Communication functions */
 
+static const sha204_retry_policy_t sha204_retry_policy_default = SHA204_RETRY_POLICY_DEFAULT;
+
+/** \brief Sets the retry policy of this instance.
+ *
+ * \param[in] policy policy to use from now on; must stay valid while in use.
+ *                   NULL selects SHA204_RETRY_POLICY_DEFAULT.
+ */
+void atsha204Class::setRetryPolicy(const sha204_retry_policy_t *policy)
+{
+  retry_policy = policy ? policy : &sha204_retry_policy_default;
+}
+
+const sha204_retry_policy_t *atsha204Class::getRetryPolicy()
+{
+  return retry_policy;
+}
+
+// Returns whether waiting another ms would exceed the deadline of a call started at start_ms.
+static uint8_t sha204c_over_budget(const sha204_retry_policy_t *policy, unsigned long start_ms, uint16_t ms)
+{
+  return policy->deadline && millis() - start_ms + ms > policy->deadline;
+}
+
 uint8_t atsha204Class::sha204c_wakeup(uint8_t *response)
 {
+  SHA204_HEALTH_ADMIT();
+  return SHA204_HEALTH_DONE(sha204c_wakeup(response, retry_policy));
+}
+
+uint8_t atsha204Class::sha204c_wakeup(uint8_t *response, const sha204_retry_policy_t *policy)
+{
+  SHA204_STATS_INC(wakeups);
+
   uint8_t ret_code = sha204p_wakeup();
   if (ret_code != SHA204_SUCCESS)
     return ret_code;
@@ -300,24 +455,62 @@ uint8_t atsha204Class::sha204c_wakeup(uint8_t *response)
       ret_code = SHA204_BAD_CRC;
   }
   if (ret_code != SHA204_SUCCESS)
-    delay(SHA204_COMMAND_EXEC_MAX);
+    delay(policy->wake_fail_delay);
 
   return ret_code;
 }
 
 uint8_t atsha204Class::sha204c_resync(uint8_t size, uint8_t *response)
 {
-  // Try to re-synchronize without sending a Wake token
-  // (step 1 of the re-synchronization process).
-  uint8_t ret_code = sha204p_resync(size, response);
-  if (ret_code == SHA204_SUCCESS)
-    return ret_code;
+  return sha204c_resync(size, response, retry_policy, millis());
+}
+
+// Ends a call that ran out of its budget after a command was sent. The command has
+// finished executing by then, since it is only sent when its execution fits into the
+// budget. Sleep leaves the device in a known state; the next call has to wake it.
+uint8_t atsha204Class::sha204c_abandon()
+{
+  (void) sha204p_sleep();
+  return SHA204_DEADLINE;
+}
+
+// Re-synchronizes as the policy says. Returns SHA204_DEADLINE without
+// waiting if the worst case would end past the deadline of the call,
+// and SHA204_FUNC_FAIL if the policy does not re-synchronize.
+uint8_t atsha204Class::sha204c_resync(uint8_t size, uint8_t *response, const sha204_retry_policy_t *policy,
+    unsigned long start_ms)
+{
+  uint8_t ret_code;
+  uint16_t worst_case = SHA204_WAKEUP_DELAY + policy->wake_fail_delay;
+
+  if (policy->resync == SHA204_RESYNC_NONE)
+    return SHA204_FUNC_FAIL;
+  if (policy->resync == SHA204_RESYNC_FULL)
+    worst_case += policy->sync_delay;
+  if (sha204c_over_budget(policy, start_ms, worst_case))
+    return SHA204_DEADLINE;
+
+  SHA204_STATS_INC(resyncs);
+  SHA204_TRACE_BEGIN(SHA204_TRACE_RESYNC);
+
+  if (policy->resync == SHA204_RESYNC_FULL)
+  {
+    // Try to re-synchronize without sending a Wake token
+    // (step 1 of the re-synchronization process).
+    ret_code = sha204p_resync(size, response, policy->sync_delay);
+    if (ret_code == SHA204_SUCCESS)
+    {
+      SHA204_TRACE_FINISH(SHA204_TRACE_RESYNC);
+      return ret_code;
+    }
+  }
 
   // We lost communication. Send a Wake pulse and try
   // to receive a response (steps 2 and 3 of the
   // re-synchronization process).
   (void) sha204p_sleep();
-  ret_code = sha204c_wakeup(response);
+  ret_code = sha204c_wakeup(response, policy);
+  SHA204_TRACE_FINISH(SHA204_TRACE_RESYNC);
 
   // Translate a return value of success into one
   // that indicates that the device had to be woken up
@@ -325,44 +518,166 @@ uint8_t atsha204Class::sha204c_resync(uint8_t size, uint8_t *response)
   return (ret_code == SHA204_SUCCESS ? SHA204_RESYNC_WITH_WAKEUP : ret_code);
 }
 
-uint8_t atsha204Class::sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer, uint8_t execution_delay, uint8_t execution_timeout)
+/** \brief Sends a command and receives its response, retrying as the retry policy says.
+ *
+ * \param[in] policy retry policy for this call; NULL for the policy of the instance
+ * \return status of the operation; SHA204_DEADLINE if the policy deadline cut the call short.
+ *         The device is then asleep if a command had been sent.
+ */
+uint8_t atsha204Class::sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer, uint8_t execution_delay, uint8_t execution_timeout,
+    const sha204_retry_policy_t *policy)
+{
+  return sha204c_exchange(tx_buffer, rx_size, rx_buffer, execution_delay, execution_timeout, policy, 0);
+}
+
+/** \brief Sets a function to call while the device executes a command.
+ *
+ * The hook is called every SHA204_WAIT_HOOK_INTERVAL us of the minimum execution
+ * time, so a sketch can keep a serial port drained during long commands.
+ *
+ * \param[in] hook    function to call; NULL to just wait
+ * \param[in] context passed to the hook
+ */
+void atsha204Class::setWaitHook(sha204_wait_hook_t hook, void *context)
+{
+  wait_hook = hook;
+  wait_hook_context = context;
+}
+
+/** \brief Returns the function called while the device executes a command.
+ *
+ * \param[out] context receives the context of the hook; may be NULL
+ * \return the hook, or NULL if none is set
+ */
+sha204_wait_hook_t atsha204Class::getWaitHook(void **context)
+{
+  if (context)
+    *context = wait_hook_context;
+  return wait_hook;
+}
+
+// Waits the minimum execution time of a command. A packet queued in prepare_step
+// is assembled in the meantime and the wait hook is called; only the rest of the
+// time is spent waiting.
+void atsha204Class::sha204c_execution_wait(uint8_t delay_ms)
+{
+  const sha204_auth_step_t *step = prepare_step;
+  unsigned long wait_us = (unsigned long) delay_ms * 1000;
+  unsigned long start_us, elapsed_us;
+
+  if (!step && !wait_hook)
+  {
+    delay(delay_ms);
+    return;
+  }
+
+  start_us = micros();
+  if (step)
+  {
+    prepare_step = NULL;
+    sha204m_assemble(step->op_code, step->param1, step->param2, step->datalen1, step->data1,
+        step->datalen2, step->data2, step->datalen3, step->data3, prepare_buffer);
+  }
+  while (wait_hook && micros() - start_us + SHA204_WAIT_HOOK_INTERVAL <= wait_us)
+  {
+    unsigned long call_us = micros();
+
+    // A hook that takes the whole interval is called again right away.
+    wait_hook(wait_hook_context);
+    call_us = micros() - call_us;
+    if (call_us < SHA204_WAIT_HOOK_INTERVAL)
+      delayMicroseconds(SHA204_WAIT_HOOK_INTERVAL - call_us);
+  }
+  elapsed_us = micros() - start_us;
+  if (elapsed_us >= wait_us)
+    return;
+  wait_us -= elapsed_us;
+  delay(wait_us / 1000);
+  delayMicroseconds(wait_us % 1000);
+}
+
+// sha204c_send_and_receive for packets whose CRC may already be in place.
+uint8_t atsha204Class::sha204c_exchange(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer, uint8_t execution_delay, uint8_t execution_timeout,
+    const sha204_retry_policy_t *policy, uint8_t crc_ready)
 {
   uint8_t ret_code = SHA204_FUNC_FAIL;
   uint8_t ret_code_resync;
   uint8_t n_retries_send;
   uint8_t n_retries_receive;
+  uint8_t n_resends = 0;
   uint8_t i;
   uint8_t status_byte;
   uint8_t count = tx_buffer[SHA204_BUFFER_POS_COUNT];
   uint8_t count_minus_crc = count - SHA204_CRC_SIZE;
-  uint16_t execution_timeout_us = (uint16_t) (execution_timeout * 1000) + SHA204_RESPONSE_TIMEOUT;
+  uint16_t execution_timeout_us;
   volatile uint16_t timeout_countdown;
+  unsigned long start_ms = millis();
+  SHA204_MEMO_LOOKUP();
+  if (timing)
+    sha204c_variant_delay(tx_buffer[SHA204_OPCODE_IDX], &execution_delay, &execution_timeout);
+  execution_timeout_us = (uint16_t) (execution_timeout * 1000) + SHA204_RESPONSE_TIMEOUT;
+  SHA204_STATS_START();
+  SHA204_HEALTH_ADMIT();
+
+  if (!policy)
+    policy = retry_policy;
+  SHA204_TRACE_BEGIN(SHA204_TRACE_TRANSACTION);
 
   // Append CRC.
-  sha204c_calculate_crc(count_minus_crc, tx_buffer, tx_buffer + count_minus_crc);
+  if (!crc_ready)
+    sha204c_calculate_crc(count_minus_crc, tx_buffer, tx_buffer + count_minus_crc);
 
   // Retry loop for sending a command and receiving a response.
-  n_retries_send = SHA204_RETRY_COUNT + 1;
+  n_retries_send = policy->send_retries + 1;
 
   while ((n_retries_send-- > 0) && (ret_code != SHA204_SUCCESS)) 
   {
+    if (n_retries_send != policy->send_retries)
+    {
+      SHA204_STATS_INC(retries);
+
+      // Back off before resending.
+      if (policy->backoff)
+      {
+        uint16_t backoff = (uint16_t) policy->backoff << (n_resends < 8 ? n_resends : 8);
+        if (sha204c_over_budget(policy, start_ms, backoff))
+          return SHA204_TRANSACTION_DONE(sha204c_abandon());
+        delay(backoff);
+      }
+      n_resends++;
+    }
+
+    // A device that executes a command ignores I/O until it is done, so a command
+    // is only sent if its whole execution fits into the budget.
+    if (sha204c_over_budget(policy, start_ms, (uint16_t) execution_delay + execution_timeout))
+      return SHA204_TRANSACTION_DONE(n_resends ? sha204c_abandon() : SHA204_DEADLINE);
+
     // Send command.
+    SHA204_STATS_INC(sends);
     ret_code = sha204p_send_command(count, tx_buffer);
     if (ret_code != SHA204_SUCCESS) 
     {
-      if (sha204c_resync(rx_size, rx_buffer) == SHA204_RX_NO_RESPONSE)
-        return ret_code; // The device seems to be dead in the water.
+      ret_code_resync = sha204c_resync(rx_size, rx_buffer, policy, start_ms);
+      if (ret_code_resync == SHA204_DEADLINE)
+        return SHA204_TRANSACTION_DONE(sha204c_abandon());
+      if (ret_code_resync == SHA204_RX_NO_RESPONSE)
+        return SHA204_TRANSACTION_DONE(ret_code); // The device seems to be dead in the water.
       else
         continue;
     }
 
     // Wait minimum command execution time and then start polling for a response.
-    delay(execution_delay);
+    SHA204_TRACE_BEGIN(SHA204_TRACE_EXECUTION);
+    sha204c_execution_wait(execution_delay);
+    SHA204_TRACE_FINISH(SHA204_TRACE_EXECUTION);
 
     // Retry loop for receiving a response.
-    n_retries_receive = SHA204_RETRY_COUNT + 1;
+    n_retries_receive = policy->receive_retries + 1;
     while (n_retries_receive-- > 0) 
     {
+      if (n_retries_receive != policy->receive_retries)
+        SHA204_STATS_INC(retries);
+
       // Reset response buffer.
       for (i = 0; i < rx_size; i++)
         rx_buffer[i] = 0;
@@ -371,17 +686,24 @@ uint8_t atsha204Class::sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_s
       timeout_countdown = execution_timeout_us;
       do 
       {
+        SHA204_TRACE_BEGIN(SHA204_TRACE_POLL);
         ret_code = sha204p_receive_response(rx_size, rx_buffer);
+        SHA204_TRACE_FINISH(SHA204_TRACE_POLL);
         timeout_countdown -= SHA204_RESPONSE_TIMEOUT;
       } 
       while ((timeout_countdown > SHA204_RESPONSE_TIMEOUT) && (ret_code == SHA204_RX_NO_RESPONSE));
 
       if (ret_code == SHA204_RX_NO_RESPONSE) 
       {
+        SHA204_STATS_INC(no_response);
+
         // We did not receive a response. Re-synchronize and send command again.
-        if (sha204c_resync(rx_size, rx_buffer) == SHA204_RX_NO_RESPONSE)
+        ret_code_resync = sha204c_resync(rx_size, rx_buffer, policy, start_ms);
+        if (ret_code_resync == SHA204_DEADLINE)
+          return SHA204_TRANSACTION_DONE(sha204c_abandon());
+        if (ret_code_resync == SHA204_RX_NO_RESPONSE)
           // The device seems to be dead in the water.
-          return ret_code;
+          return SHA204_TRANSACTION_DONE(ret_code);
         else
           break;
       }
@@ -390,7 +712,9 @@ uint8_t atsha204Class::sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_s
       if (ret_code == SHA204_INVALID_SIZE)
       {
         // We see 0xFF for the count when communication got out of sync.
-        ret_code_resync = sha204c_resync(rx_size, rx_buffer);
+        ret_code_resync = sha204c_resync(rx_size, rx_buffer, policy, start_ms);
+        if (ret_code_resync == SHA204_DEADLINE)
+          return SHA204_TRANSACTION_DONE(sha204c_abandon());
         if (ret_code_resync == SHA204_SUCCESS)
           // We did not have to wake up the device. Try receiving response again.
           continue;
@@ -400,7 +724,7 @@ uint8_t atsha204Class::sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_s
           break;
         else
           // We failed to re-synchronize.
-          return ret_code;
+          return SHA204_TRANSACTION_DONE(ret_code);
       }
 
       // We received a response of valid size.
@@ -411,7 +735,7 @@ uint8_t atsha204Class::sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_s
         // Received valid response.
         if (rx_buffer[SHA204_BUFFER_POS_COUNT] > SHA204_RSP_SIZE_MIN)
           // Received non-status response. We are done.
-          return ret_code;
+          return SHA204_TRANSACTION_DONE(SHA204_MEMO_STORE(ret_code));
 
         // Received status response.
         status_byte = rx_buffer[SHA204_BUFFER_POS_STATUS];
@@ -419,11 +743,18 @@ uint8_t atsha204Class::sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_s
         // Translate the three possible device status error codes
         // into library return codes.
         if (status_byte == SHA204_STATUS_BYTE_PARSE)
-          return SHA204_PARSE_ERROR;
+        {
+          SHA204_STATS_INC(status_errors);
+          return SHA204_TRANSACTION_DONE(SHA204_PARSE_ERROR);
+        }
         if (status_byte == SHA204_STATUS_BYTE_EXEC)
-          return SHA204_CMD_FAIL;
+        {
+          SHA204_STATS_INC(status_errors);
+          return SHA204_TRANSACTION_DONE(SHA204_CMD_FAIL);
+        }
         if (status_byte == SHA204_STATUS_BYTE_COMM) 
         {
+          SHA204_STATS_INC(status_errors);
           // In case of the device status byte indicating a communication
           // error this function exits the retry loop for receiving a response
           // and enters the overall retry loop
@@ -434,13 +765,16 @@ uint8_t atsha204Class::sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_s
 
         // Received status response from CheckMAC, DeriveKey, GenDig,
         // Lock, Nonce, Pause, UpdateExtra, or Write command.
-        return ret_code;
+        return SHA204_TRANSACTION_DONE(ret_code);
       }
 
       else 
       {
         // Received response with incorrect CRC.
-        ret_code_resync = sha204c_resync(rx_size, rx_buffer);
+        SHA204_STATS_INC(bad_crc);
+        ret_code_resync = sha204c_resync(rx_size, rx_buffer, policy, start_ms);
+        if (ret_code_resync == SHA204_DEADLINE)
+          return SHA204_TRANSACTION_DONE(sha204c_abandon());
         if (ret_code_resync == SHA204_SUCCESS)
           // We did not have to wake up the device. Try receiving response again.
           continue;
@@ -450,14 +784,14 @@ uint8_t atsha204Class::sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_s
           break;
         else
           // We failed to re-synchronize.
-          return ret_code;
+          return SHA204_TRANSACTION_DONE(ret_code);
       } // block end of check response consistency
 
     } // block end of receive retry loop
 
   } // block end of send and receive retry loop
 
-  return ret_code;
+  return SHA204_TRANSACTION_DONE(ret_code);
 }
 
 
@@ -584,9 +918,7 @@ uint8_t atsha204Class::sha204m_execute(uint8_t op_code, uint8_t param1, uint16_t
 			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
 			uint8_t tx_size, uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer)
 {
-	uint8_t poll_delay, poll_timeout, response_size;
-	uint8_t *p_buffer;
-	uint8_t len;
+	uint8_t poll_delay, poll_timeout, response_size = rx_size;
 
 	uint8_t ret_code = sha204m_check_parameters(op_code, param1, param2,
 				datalen1, data1, datalen2, data2, datalen3, data3,
@@ -595,95 +927,117 @@ uint8_t atsha204Class::sha204m_execute(uint8_t op_code, uint8_t param1, uint16_t
 		return ret_code;
 
 	// Supply delays and response size.
+	sha204m_command_timing(op_code, param1, &poll_delay, &poll_timeout, &response_size);
+
+	// Assemble command. Its CRC is in place, so it is not calculated again.
+	sha204m_assemble(op_code, param1, param2, datalen1, data1, datalen2, data2, datalen3, data3, tx_buffer);
+
+	// Send command and receive response.
+	return sha204c_exchange(&tx_buffer[0], response_size,
+				&rx_buffer[0],	poll_delay, poll_timeout, NULL, 1);
+}
+
+// Supplies the execution delays and the response size of a command.
+void atsha204Class::sha204m_command_timing(uint8_t op_code, uint8_t param1,
+			uint8_t *poll_delay, uint8_t *poll_timeout, uint8_t *response_size)
+{
 	switch (op_code) 
 	{
 		case SHA204_CHECKMAC:
-			poll_delay = CHECKMAC_DELAY;
-			poll_timeout = CHECKMAC_EXEC_MAX - CHECKMAC_DELAY;
-			response_size = CHECKMAC_RSP_SIZE;
+			*poll_delay = CHECKMAC_DELAY;
+			*poll_timeout = CHECKMAC_EXEC_MAX - CHECKMAC_DELAY;
+			*response_size = CHECKMAC_RSP_SIZE;
 			break;
 
 		case SHA204_DERIVE_KEY:
-			poll_delay = DERIVE_KEY_DELAY;
-			poll_timeout = DERIVE_KEY_EXEC_MAX - DERIVE_KEY_DELAY;
-			response_size = DERIVE_KEY_RSP_SIZE;
+			*poll_delay = DERIVE_KEY_DELAY;
+			*poll_timeout = DERIVE_KEY_EXEC_MAX - DERIVE_KEY_DELAY;
+			*response_size = DERIVE_KEY_RSP_SIZE;
 			break;
 
 		case SHA204_DEVREV:
-			poll_delay = DEVREV_DELAY;
-			poll_timeout = DEVREV_EXEC_MAX - DEVREV_DELAY;
-			response_size = DEVREV_RSP_SIZE;
+			*poll_delay = DEVREV_DELAY;
+			*poll_timeout = DEVREV_EXEC_MAX - DEVREV_DELAY;
+			*response_size = DEVREV_RSP_SIZE;
 			break;
 
 		case SHA204_GENDIG:
-			poll_delay = GENDIG_DELAY;
-			poll_timeout = GENDIG_EXEC_MAX - GENDIG_DELAY;
-			response_size = GENDIG_RSP_SIZE;
+			*poll_delay = GENDIG_DELAY;
+			*poll_timeout = GENDIG_EXEC_MAX - GENDIG_DELAY;
+			*response_size = GENDIG_RSP_SIZE;
 			break;
 
 		case SHA204_HMAC:
-			poll_delay = HMAC_DELAY;
-			poll_timeout = HMAC_EXEC_MAX - HMAC_DELAY;
-			response_size = HMAC_RSP_SIZE;
+			*poll_delay = HMAC_DELAY;
+			*poll_timeout = HMAC_EXEC_MAX - HMAC_DELAY;
+			*response_size = HMAC_RSP_SIZE;
 			break;
 
 		case SHA204_LOCK:
-			poll_delay = LOCK_DELAY;
-			poll_timeout = LOCK_EXEC_MAX - LOCK_DELAY;
-			response_size = LOCK_RSP_SIZE;
+			*poll_delay = LOCK_DELAY;
+			*poll_timeout = LOCK_EXEC_MAX - LOCK_DELAY;
+			*response_size = LOCK_RSP_SIZE;
 			break;
 
 		case SHA204_MAC:
-			poll_delay = MAC_DELAY;
-			poll_timeout = MAC_EXEC_MAX - MAC_DELAY;
-			response_size = MAC_RSP_SIZE;
+			*poll_delay = MAC_DELAY;
+			*poll_timeout = MAC_EXEC_MAX - MAC_DELAY;
+			*response_size = MAC_RSP_SIZE;
 			break;
 
 		case SHA204_NONCE:
-			poll_delay = NONCE_DELAY;
-			poll_timeout = NONCE_EXEC_MAX - NONCE_DELAY;
-			response_size = param1 == NONCE_MODE_PASSTHROUGH
+			*poll_delay = NONCE_DELAY;
+			*poll_timeout = NONCE_EXEC_MAX - NONCE_DELAY;
+			*response_size = param1 == NONCE_MODE_PASSTHROUGH
 								? NONCE_RSP_SIZE_SHORT : NONCE_RSP_SIZE_LONG;
 			break;
 
 		case SHA204_PAUSE:
-			poll_delay = PAUSE_DELAY;
-			poll_timeout = PAUSE_EXEC_MAX - PAUSE_DELAY;
-			response_size = PAUSE_RSP_SIZE;
+			*poll_delay = PAUSE_DELAY;
+			*poll_timeout = PAUSE_EXEC_MAX - PAUSE_DELAY;
+			*response_size = PAUSE_RSP_SIZE;
 			break;
 
 		case SHA204_RANDOM:
-			poll_delay = RANDOM_DELAY;
-			poll_timeout = RANDOM_EXEC_MAX - RANDOM_DELAY;
-			response_size = RANDOM_RSP_SIZE;
+			*poll_delay = RANDOM_DELAY;
+			*poll_timeout = RANDOM_EXEC_MAX - RANDOM_DELAY;
+			*response_size = RANDOM_RSP_SIZE;
 			break;
 
 		case SHA204_READ:
-			poll_delay = READ_DELAY;
-			poll_timeout = READ_EXEC_MAX - READ_DELAY;
-			response_size = (param1 & SHA204_ZONE_COUNT_FLAG)
+			*poll_delay = READ_DELAY;
+			*poll_timeout = READ_EXEC_MAX - READ_DELAY;
+			*response_size = (param1 & SHA204_ZONE_COUNT_FLAG)
 								? READ_32_RSP_SIZE : READ_4_RSP_SIZE;
 			break;
 
 		case SHA204_UPDATE_EXTRA:
-			poll_delay = UPDATE_DELAY;
-			poll_timeout = UPDATE_EXEC_MAX - UPDATE_DELAY;
-			response_size = UPDATE_RSP_SIZE;
+			*poll_delay = UPDATE_DELAY;
+			*poll_timeout = UPDATE_EXEC_MAX - UPDATE_DELAY;
+			*response_size = UPDATE_RSP_SIZE;
 			break;
 
 		case SHA204_WRITE:
-			poll_delay = WRITE_DELAY;
-			poll_timeout = WRITE_EXEC_MAX - WRITE_DELAY;
-			response_size = WRITE_RSP_SIZE;
+			*poll_delay = WRITE_DELAY;
+			*poll_timeout = WRITE_EXEC_MAX - WRITE_DELAY;
+			*response_size = WRITE_RSP_SIZE;
 			break;
 
 		default:
-			poll_delay = 0;
-			poll_timeout = SHA204_COMMAND_EXEC_MAX;
-			response_size = rx_size;
+			// The response size of unknown op-codes is left to the caller.
+			*poll_delay = 0;
+			*poll_timeout = SHA204_COMMAND_EXEC_MAX;
 	}
+}
+
+// Assembles a command packet including its CRC and returns its size.
+uint8_t atsha204Class::sha204m_assemble(uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			uint8_t *tx_buffer)
+{
+	uint8_t *p_buffer;
+	uint8_t len;
 
-	// Assemble command.
 	len = datalen1 + datalen2 + datalen3 + SHA204_CMD_SIZE_MIN;
 	p_buffer = tx_buffer;
 	*p_buffer++ = len;
@@ -707,9 +1061,7 @@ uint8_t atsha204Class::sha204m_execute(uint8_t op_code, uint8_t param1, uint16_t
 
 	sha204c_calculate_crc(len - SHA204_CRC_SIZE, tx_buffer, p_buffer);
 
-	// Send command and receive response.
-	return sha204c_send_and_receive(&tx_buffer[0], response_size,
-				&rx_buffer[0],	poll_delay, poll_timeout);
+	return len;
 }
 
 uint8_t atsha204Class::sha204m_check_parameters(uint8_t op_code, uint8_t param1, uint16_t param2,
@@ -821,13 +1173,30 @@ uint8_t atsha204Class::sha204m_check_parameters(uint8_t op_code, uint8_t param1,
 
 /* CRC Calculator and Checker */
 void atsha204Class::sha204c_calculate_crc(uint8_t length, uint8_t *data, uint8_t *crc) 
+{
+  uint16_t crc_register = sha204c_update_crc(length, data, 0);
+
+  crc[0] = (uint8_t) (crc_register & 0x00FF);
+  crc[1] = (uint8_t) (crc_register >> 8);
+}
+
+/** \brief Continues a CRC over more data, so that data read in pieces needs no buffer.
+ *
+ * \param[in] length       number of bytes
+ * \param[in] data         the bytes
+ * \param[in] crc_register 0 for the first piece, then the return value of the previous call
+ * \return CRC register; its low byte is the first CRC byte of a packet
+ */
+uint16_t atsha204Class::sha204c_update_crc(uint8_t length, const uint8_t *data, uint16_t crc_register)
 {
   uint8_t counter;
-  uint16_t crc_register = 0;
   uint16_t polynom = 0x8005;
   uint8_t shift_register;
   uint8_t data_bit, crc_bit;
 
+#if defined(SHA204_SWI_HOST)
+  host_charge_crc(length);
+#endif
   for (counter = 0; counter < length; counter++)
   {
     for (shift_register = 0x01; shift_register > 0x00; shift_register <<= 1) 
@@ -842,8 +1211,7 @@ void atsha204Class::sha204c_calculate_crc(uint8_t length, uint8_t *data, uint8_t
         crc_register ^= polynom;
     }
   }
-  crc[0] = (uint8_t) (crc_register & 0x00FF);
-  crc[1] = (uint8_t) (crc_register >> 8);
+  return crc_register;
 }
 
 uint8_t atsha204Class::sha204c_check_crc(uint8_t *response)
@@ -998,32 +1366,47 @@ uint8_t atsha204Class::sha204e_read_config_zone(uint8_t *config_data)
 	return ret_code;
 }
 
+/** \brief Locks the configuration zone unless it is locked already.
+ *
+ * The summary is the CRC of the whole zone. It is updated as each read response
+ * arrives, so no copy of the zone is needed. The word with the LockConfig byte is
+ * read first, which makes a locked zone cost a single read.
+ *
+ * \return status of the operation
+ */
 uint8_t atsha204Class::sha204e_lock_config_zone()
 {
 	uint8_t ret_code;
-	uint8_t config_data[SHA204_CONFIG_SIZE];
-	uint8_t crc_array[SHA204_CRC_SIZE];
-	uint16_t crc;
-	uint8_t command[LOCK_COUNT];
-	uint8_t response[LOCK_RSP_SIZE];
-	
-	//sha204p_sleep();
-	
-	ret_code = sha204e_read_config_zone(config_data);
+	// Read and Lock commands have the same size.
+	uint8_t command[SHA204_CMD_SIZE_MIN];
+	uint8_t response[READ_32_RSP_SIZE];
+	uint8_t lock_word[SHA204_ZONE_ACCESS_4];
+	uint16_t crc = 0;
+	uint8_t address, size;
+
+	ret_code = sha204m_read(command, response, SHA204_ZONE_CONFIG, ADDRESS_LOCKCONFIG & ~(SHA204_ZONE_ACCESS_4 - 1));
 	if (ret_code != SHA204_SUCCESS)
 		return ret_code;
-		
+
 	// Check whether the configuration zone is locked already.
-	if (config_data[87] == 0)
+	if (response[SHA204_BUFFER_POS_DATA + ADDRESS_LOCKCONFIG % SHA204_ZONE_ACCESS_4] == 0)
 		return ret_code;
-	
-	sha204c_calculate_crc(sizeof(config_data), config_data, crc_array);
-	crc = (crc_array[1] << 8) + crc_array[0];
+	memcpy(lock_word, &response[SHA204_BUFFER_POS_DATA], sizeof(lock_word));
 
-	//ret_code = sha204c_wakeup(response);
-	ret_code = sha204m_lock(command, response, SHA204_ZONE_CONFIG, crc);
-	
-	return ret_code;
+	// Everything before the last word, in 32-byte blocks while they fit.
+	for (address = 0; address < SHA204_CONFIG_SIZE - SHA204_ZONE_ACCESS_4; address += size)
+	{
+		size = address + SHA204_ZONE_ACCESS_32 <= SHA204_CONFIG_SIZE - SHA204_ZONE_ACCESS_4
+				? SHA204_ZONE_ACCESS_32 : SHA204_ZONE_ACCESS_4;
+		ret_code = sha204m_read(command, response,
+				SHA204_ZONE_CONFIG | (size == SHA204_ZONE_ACCESS_32 ? READ_ZONE_MODE_32_BYTES : 0), address);
+		if (ret_code != SHA204_SUCCESS)
+			return ret_code;
+		crc = sha204c_update_crc(size, &response[SHA204_BUFFER_POS_DATA], crc);
+	}
+	crc = sha204c_update_crc(sizeof(lock_word), lock_word, crc);
+
+	return sha204m_lock(command, response, SHA204_ZONE_CONFIG, crc);
 }
 
 
@@ -1238,3 +1621,34 @@ uint8_t atsha204Class::sha204m_mac(uint8_t *tx_buffer, uint8_t *rx_buffer,
 	return sha204c_send_and_receive(&tx_buffer[0], MAC_RSP_SIZE, &rx_buffer[0],
 				MAC_DELAY, MAC_EXEC_MAX - MAC_DELAY);
 }
+
+/**
+*	CheckMac command. The status byte of the response is 0 if the client response matched.
+*/
+uint8_t atsha204Class::sha204m_check_mac(uint8_t *tx_buffer, uint8_t *rx_buffer,
+			uint8_t mode, uint8_t key_id, uint8_t *client_challenge, uint8_t *client_response, uint8_t *other_data)
+{
+	if (!tx_buffer || !rx_buffer || !client_response || !other_data
+				|| (mode & ~CHECKMAC_MODE_MASK) || (key_id > SHA204_KEY_ID_MAX))
+		// no null pointers allowed
+		// mode has to match an allowed CheckMac mode.
+		// key_id > 15 not allowed
+		return SHA204_BAD_PARAM;
+
+	tx_buffer[SHA204_COUNT_IDX] = CHECKMAC_COUNT;
+	tx_buffer[SHA204_OPCODE_IDX] = SHA204_CHECKMAC;
+	tx_buffer[CHECKMAC_MODE_IDX] = mode;
+	tx_buffer[CHECKMAC_KEYID_IDX] = key_id;
+	tx_buffer[CHECKMAC_KEYID_IDX + 1] = 0;
+
+	// The client challenge is ignored when TempKey supplies the second SHA block.
+	if (client_challenge == NULL)
+		memset(&tx_buffer[CHECKMAC_CLIENT_CHALLENGE_IDX], 0, CHECKMAC_CLIENT_CHALLENGE_SIZE);
+	else
+		memcpy(&tx_buffer[CHECKMAC_CLIENT_CHALLENGE_IDX], client_challenge, CHECKMAC_CLIENT_CHALLENGE_SIZE);
+	memcpy(&tx_buffer[CHECKMAC_CLIENT_RESPONSE_IDX], client_response, CHECKMAC_CLIENT_RESPONSE_SIZE);
+	memcpy(&tx_buffer[CHECKMAC_DATA_IDX], other_data, CHECKMAC_OTHER_DATA_SIZE);
+
+	return sha204c_send_and_receive(&tx_buffer[0], CHECKMAC_RSP_SIZE, &rx_buffer[0],
+				CHECKMAC_DELAY, CHECKMAC_EXEC_MAX - CHECKMAC_DELAY);
+}
@@ -17,6 +17,84 @@
 #define SWI_FUNCTION_RETCODE_SUCCESS     ((uint8_t) 0x00) //!< Communication with device succeeded.
 #define SWI_FUNCTION_RETCODE_TIMEOUT     ((uint8_t) 0xF1) //!< Communication timed out.
 #define SWI_FUNCTION_RETCODE_RX_FAIL     ((uint8_t) 0xF9) //!< Communication failed after at least one byte was received.
+#define SWI_FUNCTION_RETCODE_BUSY        ((uint8_t) 0xF3) //!< A background transfer is still in progress.
+
+//! Completion callback for background SWI transfers. Called from interrupt context with a SWI return code.
+typedef void (*sha204_swi_callback_t)(uint8_t status);
+
+// The receivers stop right after the last byte announced by the count byte of a
+// response. Define SHA204_RX_FULL_SIZE to wait for the start pulse timeout after a
+// short response instead, as they used to, for example to measure the difference.
+//#define SHA204_RX_FULL_SIZE
+
+/* swi_icp.h */
+
+// Define SHA204_SWI_ICP to receive through the Timer1 input capture unit instead of
+// busy-wait edge polling. The device's SDA pin must then be connected to ICP1
+// (digital pin 8 on ATmega328P boards). Timer1 is borrowed only while a response is
+// being received. Its control, compare A, counter and interrupt mask registers are
+// restored afterwards, but the counter does not advance in the meantime. The library
+// defines the TIMER1_CAPT_vect and TIMER1_COMPA_vect interrupt handlers, so a sketch
+// that uses Servo or any other code defining one of them fails to link with this flag.
+//#define SHA204_SWI_ICP
+
+#define SWI_ICP_TICKS_PER_US     ((uint16_t) (F_CPU / 1000000UL))  //! Timer1 runs without prescaler.
+#define SWI_ICP_ZERO_WINDOW      ((uint16_t) (20 * SWI_ICP_TICKS_PER_US))  //! A second falling edge within this window of a start pulse marks a zero bit.
+#define SWI_ICP_START_TIMEOUT    ((uint16_t) (SWI_RECEIVE_TIME_OUT * SWI_ICP_TICKS_PER_US))  //! maximum time between two start pulses
+
+/* swi_spi.h */
+
+// Define SHA204_SWI_SPI_TX to transmit through the SPI peripheral instead of
+// delay loops. Every SWI bit is shifted out as one SPI byte on MOSI, so the
+// device's SDA pin must be connected to MOSI (digital pin 11 on ATmega328P boards).
+// When combined with SHA204_SWI_ICP, tie MOSI and ICP1 together and pass the MOSI
+// pin to the constructor.
+//#define SHA204_SWI_SPI_TX
+
+#define SWI_SPI_PATTERN_ZERO     ((uint8_t) 0x5F)  //! low, high, low, then high for five pulse widths
+#define SWI_SPI_PATTERN_ONE      ((uint8_t) 0x7F)  //! low, then high for seven pulse widths
+#if F_CPU == 16000000UL
+#define SWI_SPI_SPCR_CLOCK       (_BV(SPR1))       //! F_CPU / 64 = 250 kHz, one SPI bit per BIT_DELAY
+#define SWI_SPI_SPSR_CLOCK       (0)
+#elif F_CPU == 8000000UL
+#define SWI_SPI_SPCR_CLOCK       (_BV(SPR1))       //! F_CPU / 32 = 250 kHz, one SPI bit per BIT_DELAY
+#define SWI_SPI_SPSR_CLOCK       (_BV(SPI2X))
+#endif
+
+/* swi_arm.h */
+
+// On 32-bit ARM cores the SWI layer drives the pin through atomic set and clear
+// registers and times pulses with the DWT cycle counter (Cortex-M3 and above).
+// Supported cores: ARDUINO_ARCH_SAM, ARDUINO_ARCH_SAMD (SAMD51) and ARDUINO_ARCH_STM32.
+#if defined(__arm__) && !defined(SHA204_SWI_HOST)
+#define SHA204_SWI_ARM
+#define SWI_ARM_CYCLES_PER_US    ((uint32_t) (F_CPU / 1000000UL))
+#define SWI_ARM_PULSE_CYCLES     ((uint32_t) ((uint64_t) F_CPU * START_PULSE_WIDTH / 1000000000UL))  //! width of one pulse in CPU cycles
+#define SWI_ARM_ZERO_WINDOW      (3 * SWI_ARM_PULSE_CYCLES)  //! A second falling edge within this window of a start pulse marks a zero bit.
+#define SWI_ARM_START_TIMEOUT    ((uint32_t) SWI_RECEIVE_TIME_OUT * SWI_ARM_CYCLES_PER_US)  //! #START_PULSE_TIME_OUT in CPU cycles
+#endif
+
+/* swi_host.h */
+
+// Define SHA204_SWI_HOST to build the library on a desktop host. The SWI layer then
+// talks to a device stand-in derived from sha204HostDevice instead of a pin, and the
+// physical, communication and marshaling layers run unchanged. See extras/host.
+//#define SHA204_SWI_HOST
+
+#if defined(SHA204_SWI_HOST)
+//! Device stand-in that sees the bytes a real device would see on the wire
+class sha204HostDevice
+{
+public:
+	virtual ~sha204HostDevice() {}
+	//! Called at the end of a wake pulse.
+	virtual void wake() = 0;
+	//! Receives a flag byte or the bytes of a command packet. Returns a SWI return code.
+	virtual uint8_t send(uint8_t count, const uint8_t *buffer) = 0;
+	//! Delivers up to count bytes after a transmit flag. Returns a SWI return code.
+	virtual uint8_t receive(uint8_t count, uint8_t *buffer) = 0;
+};
+#endif
 
 /* sha204_physical.h */
 
@@ -249,7 +327,7 @@
 
 #define CPU_CLOCK_DEVIATION_POSITIVE   (1.01)
 #define CPU_CLOCK_DEVIATION_NEGATIVE   (0.99)
-#define SHA204_RETRY_COUNT           (1)
+#define SHA204_RETRY_COUNT           (1)    //! send and receive retries of SHA204_RETRY_POLICY_DEFAULT
 #define SWI_RECEIVE_TIME_OUT      ((uint16_t) 163)  //! #START_PULSE_TIME_OUT in us instead of loop counts
 #define SWI_US_PER_BYTE           ((uint16_t) 313)  //! It takes 312.5 us to send a byte (9 single-wire bits / 230400 Baud * 8 flag bits).
 #define SHA204_SYNC_TIMEOUT       ((uint8_t) 85)//! delay before sending a transmit flag in the synchronization routine
@@ -264,10 +342,327 @@
 #define SHA204_BUFFER_POS_STATUS     (1)  //! buffer index of status byte in status response
 #define SHA204_BUFFER_POS_DATA       (1)  //! buffer index of first data byte in data response
 #define SHA204_STATUS_BYTE_WAKEUP    ((uint8_t) 0x11)  //! command parse error
+#define SHA204_STATUS_BYTE_MISCOMPARE ((uint8_t) 0x01) //! CheckMac response did not match
 #define SHA204_STATUS_BYTE_PARSE     ((uint8_t) 0x03)  //! command parse error
 #define SHA204_STATUS_BYTE_EXEC      ((uint8_t) 0x0F)  //! command execution error
 #define SHA204_STATUS_BYTE_COMM      ((uint8_t) 0xFF)  //! communication error
 
+/* sha204_stats.h */
+
+// Define SHA204_STATS to count retries, resyncs, wakeups and errors and to keep
+// per op-code latency histograms for each device. Without it the hooks compile to nothing.
+//#define SHA204_STATS
+
+#define SHA204_STATS_OPCODES         (14)  //! 13 op-codes plus one histogram for unknown op-codes
+#define SHA204_STATS_BUCKETS         (10)  //! bucket 0: < 1 ms, bucket n: >= 2^(n-1) ms (1 ms = 1024 us), last bucket is open
+#define SHA204_STATS_DUMP_VERSION    ((uint8_t) 1)  //! first byte of the binary dump
+
+#if defined(SHA204_STATS)
+//! Reliability counters and latency histograms of one device
+typedef struct
+{
+	uint16_t sends;              //!< command packets sent
+	uint16_t retries;            //!< additional send or receive attempts in sha204c_send_and_receive
+	uint16_t resyncs;            //!< calls of sha204c_resync
+	uint16_t wakeups;            //!< calls of sha204c_wakeup, including the ones made by sha204c_resync
+	uint16_t bad_crc;            //!< responses with SHA204_BAD_CRC
+	uint16_t no_response;        //!< polling ended with SHA204_RX_NO_RESPONSE
+	uint16_t status_errors;      //!< parse, execution and communication status responses
+	uint16_t latency[SHA204_STATS_OPCODES][SHA204_STATS_BUCKETS];  //!< sha204c_send_and_receive duration per op-code
+} sha204_stats_t;
+#endif
+
+/* sha204_trace.h */
+
+// Define SHA204_TRACE to record timestamped begin and end events of the phases of
+// the SWI, physical and communication layers in a ring buffer shared by all devices.
+// sha204_trace_report() decodes it into the worst-case interrupt-masked time and a
+// per-phase breakdown. Without it the trace points compile to nothing.
+//#define SHA204_TRACE
+
+#define SHA204_TRACE_SIZE            (64)   //! ring buffer entries (5 bytes each)
+
+// Trace phases. Begin events carry the phase only, end events have SHA204_TRACE_END set.
+#define SHA204_TRACE_MASK            (0)    //!< interrupts disabled by the SWI layer
+#define SHA204_TRACE_WAKE            (1)    //!< wake pulse and wake delay
+#define SHA204_TRACE_FLAG            (2)    //!< flag byte preceding a command
+#define SHA204_TRACE_COMMAND         (3)    //!< command body
+#define SHA204_TRACE_TURNAROUND      (4)    //!< turn around time before transmitting
+#define SHA204_TRACE_EXECUTION       (5)    //!< minimum execution delay before polling
+#define SHA204_TRACE_POLL            (6)    //!< one polling attempt (transmit flag and receive)
+#define SHA204_TRACE_RECEIVE         (7)    //!< receive loop
+#define SHA204_TRACE_RESYNC          (8)    //!< re-synchronization
+#define SHA204_TRACE_TRANSACTION     (9)    //!< whole sha204c_send_and_receive call
+#define SHA204_TRACE_PHASES          (10)   //!< number of phases
+#define SHA204_TRACE_END             ((uint8_t) 0x80)  //!< event flag: phase ended
+
+// Trace clock: DWT cycles on ARM, micros() on AVR. Override both to use another timer.
+#if !defined(SHA204_TRACE_TICKS_PER_US)
+#if defined(SHA204_SWI_ARM)
+#define SHA204_TRACE_TICKS_PER_US    SWI_ARM_CYCLES_PER_US
+#else
+#define SHA204_TRACE_TICKS_PER_US    (1)
+#endif
+#endif
+
+#if defined(SHA204_TRACE)
+//! one trace event
+typedef struct
+{
+	uint32_t time;     //!< trace clock ticks
+	uint8_t event;     //!< phase, ORed with SHA204_TRACE_END for end events
+} sha204_trace_entry_t;
+
+void sha204_trace(uint8_t event);
+void sha204_trace_tick();
+uint8_t sha204_trace_read(sha204_trace_entry_t *entries, uint8_t max_entries);
+void sha204_trace_clear();
+void sha204_trace_report(Print &out);
+
+#define SHA204_TRACE_BEGIN(phase)    sha204_trace(phase)
+#define SHA204_TRACE_FINISH(phase)   sha204_trace((phase) | SHA204_TRACE_END)
+#define SHA204_TRACE_TICK()          sha204_trace_tick()
+#else
+#define SHA204_TRACE_BEGIN(phase)    ((void) 0)
+#define SHA204_TRACE_FINISH(phase)   ((void) 0)
+#define SHA204_TRACE_TICK()          ((void) 0)
+#endif
+
+/* sha204_capture.h */
+
+// Define SHA204_CAPTURE to log the packets crossing sha204p_send_command and
+// sha204p_receive_response, plus wake, sleep, idle and resync events, into a ring buffer
+// supplied by the caller. captureExport() writes the log in a compact binary format
+// that the replay driver in extras/host feeds back through the library.
+//#define SHA204_CAPTURE
+
+// Export format: "S204", SHA204_CAPTURE_VERSION, then records oldest first. Each record
+// is type (1 byte), micros() (4 bytes, little-endian), status (1 byte), length (1 byte)
+// and length data bytes.
+#define SHA204_CAPTURE_VERSION       ((uint8_t) 1)
+#define SHA204_CAPTURE_HEADER_SIZE   (7)    //! record size without data
+#define SHA204_CAPTURE_TX            ((uint8_t) 1)   //!< command packet; status is the return code of sha204p_send_command
+#define SHA204_CAPTURE_RX            ((uint8_t) 2)   //!< response packet; status is the return code of sha204p_receive_response
+#define SHA204_CAPTURE_WAKE          ((uint8_t) 3)   //!< wake pulse
+#define SHA204_CAPTURE_SLEEP         ((uint8_t) 4)   //!< sleep flag
+#define SHA204_CAPTURE_RESYNC        ((uint8_t) 5)   //!< re-synchronization delay before a receive
+#define SHA204_CAPTURE_IDLE          ((uint8_t) 6)   //!< idle flag
+
+/* sha204_retry.h */
+
+// A retry policy controls how hard sha204c_send_and_receive tries before it gives up.
+// It is set per instance with setRetryPolicy() and can be overridden per call.
+// SHA204_RETRY_POLICY_DEFAULT behaves like earlier versions of the library.
+// A command is only sent if its maximum execution time fits into what is left of the
+// deadline, since a device that executes a command ignores everything sent to it. A
+// call that gives up after a command went out puts the device to sleep.
+#define SHA204_RESYNC_FULL           ((uint8_t) 0)   //!< transmit flag after sync_delay, then sleep and wake if needed
+#define SHA204_RESYNC_WAKE           ((uint8_t) 1)   //!< sleep and wake right away; TempKey is lost
+#define SHA204_RESYNC_NONE           ((uint8_t) 2)   //!< never re-synchronize: resend after timeouts, give up on garbled responses
+
+typedef struct
+{
+	uint8_t send_retries;      //!< command resends after a failed attempt
+	uint8_t receive_retries;   //!< further receive attempts for each send
+	uint8_t resync;            //!< re-synchronization strategy
+	uint8_t sync_delay;        //!< ms to wait before the transmit flag of a re-synchronization
+	uint8_t wake_fail_delay;   //!< ms to wait after a failed wake-up
+	uint8_t backoff;           //!< ms to wait before the first resend; doubles with every further resend
+	uint16_t deadline;         //!< budget in ms for a whole call, 0 for none
+} sha204_retry_policy_t;
+
+#define SHA204_RETRY_POLICY_DEFAULT  {SHA204_RETRY_COUNT, SHA204_RETRY_COUNT, SHA204_RESYNC_FULL, \
+		SHA204_SYNC_TIMEOUT, SHA204_COMMAND_EXEC_MAX, 0, 0}
+
+/* sha204_health.h */
+
+// Define SHA204_HEALTH to track the health of every device and to stop talking to a
+// device that keeps failing. After too many failures its circuit opens and
+// sha204c_wakeup and sha204c_send_and_receive return SHA204_CIRCUIT_OPEN at once.
+// When the probe interval has passed, the next call goes through as a probe and
+// closes the circuit again if it succeeds. Responses with a parse or execution
+// error status count as success, since the device answered.
+//#define SHA204_HEALTH
+
+#define SHA204_HEALTH_CLOSED          ((uint8_t) 0)  //!< calls go through
+#define SHA204_HEALTH_OPEN            ((uint8_t) 1)  //!< calls fail until the probe interval has passed
+#define SHA204_HEALTH_HALF_OPEN       ((uint8_t) 2)  //!< a probe call is in progress
+#define SHA204_HEALTH_MAX_FAILURES    (3)     //! default number of consecutive failures that opens the circuit
+#define SHA204_HEALTH_MAX_ERROR_RATE  (128)   //! default error rate (of 255) that opens the circuit
+#define SHA204_HEALTH_PROBE_INTERVAL  (1000)  //! default time in ms until an open circuit lets a probe through
+#define SHA204_HEALTH_MIN_CALLS       (8)     //! calls needed before the error rate is trusted
+
+#if defined(SHA204_HEALTH)
+//! Circuit breaker state and failure counters of one device
+typedef struct
+{
+	uint8_t state;                 //!< SHA204_HEALTH_CLOSED, _OPEN or _HALF_OPEN
+	uint8_t consecutive_failures;  //!< failed calls since the last success
+	uint8_t error_rate;            //!< moving average of failed calls over about eight calls, 255 = all failed
+	uint8_t max_failures;          //!< consecutive failures that open the circuit
+	uint8_t max_error_rate;        //!< error rate that opens the circuit, 0 to ignore the error rate
+	uint16_t probe_interval;       //!< ms until an open circuit lets a probe through
+	unsigned long opened_at;       //!< millis() when the circuit opened
+	uint16_t calls;                //!< calls that went through
+	uint16_t failures;             //!< calls that failed
+	uint16_t rejected;             //!< calls refused while the circuit was open
+	uint16_t opens;                //!< times the circuit opened
+} sha204_health_t;
+#endif
+
+/* sha204_memo.h */
+
+// Define SHA204_MEMO to answer commands whose response can no longer change from a
+// small cache in front of sha204c_send_and_receive instead of sending them to the device.
+// Only commands without data are cached, and only while the lock state proves their
+// response immutable: DevRev and the serial number and revision bytes always, the
+// slot configurations once the configuration zone is locked, and the OTP zone and
+// slots that are read in clear and never written once the data zone is locked.
+// memoRefresh() reads the lock state. Until it is called, or after memoClear(),
+// only the first group is cached.
+//#define SHA204_MEMO
+
+#if !defined(SHA204_MEMO_ENTRIES)
+#define SHA204_MEMO_ENTRIES          (4)    //! cached responses, 40 bytes each
+#endif
+#define SHA204_MEMO_KEY_SIZE         (SHA204_CMD_SIZE_MIN - SHA204_CRC_SIZE)  //! count, op-code and parameters of a cached command
+#define SHA204_MEMO_IMMUTABLE_END    (16)   //! config bytes below this are never writable (serial number, RevNum)
+#define SHA204_MEMO_CONFIG_END       (52)   //! config bytes below this are fixed once the configuration zone is locked
+
+#define SHA204_MEMO_CONFIG_LOCKED    ((uint8_t) 0x01)  //!< the configuration zone is locked
+#define SHA204_MEMO_DATA_LOCKED      ((uint8_t) 0x02)  //!< the data and OTP zones are locked
+#define SHA204_MEMO_OTP_FIXED        ((uint8_t) 0x04)  //!< the OTP zone is not in consumption mode
+
+#define SHA204_SLOT_IS_SECRET        ((uint16_t) 0x0080)  //!< slot configuration bit 7: the slot cannot be read in clear
+#define SHA204_SLOT_ENCRYPT_READ     ((uint16_t) 0x0040)  //!< slot configuration bit 6: reads are encrypted with TempKey
+#define SHA204_SLOT_WRITE_CONFIG     ((uint16_t) 0xF000)  //!< slot configuration bits 12 to 15: WriteConfig
+#define SHA204_SLOT_WRITE_NEVER      ((uint16_t) 0x8000)  //!< WriteConfig: neither Write nor DeriveKey can change the slot
+#define SHA204_OTP_MODE_CONSUMPTION  ((uint8_t) 0x55)     //!< OTP mode: bits can still be cleared after the lock
+
+#if defined(SHA204_MEMO)
+//! one cached response
+typedef struct
+{
+	uint8_t command[SHA204_MEMO_KEY_SIZE];    //!< command packet without CRC, count 0 for an unused entry
+	uint8_t response[SHA204_RSP_SIZE_MAX];    //!< response packet with count and CRC
+} sha204_memo_entry_t;
+
+//! Lock state and counters of the response cache of one device
+typedef struct
+{
+	uint8_t state;           //!< SHA204_MEMO_CONFIG_LOCKED, _DATA_LOCKED and _OTP_FIXED as found by memoRefresh()
+	uint16_t fixed_slots;    //!< bit n set: slot n is read in clear and never written
+	uint16_t hits;           //!< cacheable commands answered from the cache
+	uint16_t misses;         //!< cacheable commands sent to the device
+	uint16_t evictions;      //!< entries dropped to make room
+} sha204_memo_t;
+#endif
+
+/* sha204_auth.h */
+
+// An authentication transaction runs a sequence of commands, for example Nonce,
+// GenDig and CheckMac, in one awake session. While the device executes one command
+// the next packet is assembled, so its marshaling and CRC cost no extra time.
+#define SHA204_AUTH_STEPS_MAX        (8)    //! maximum number of commands in a transaction
+#define SHA204_WAIT_HOOK_INTERVAL    (1000) //! us between calls of the wait hook while a command executes
+
+//! Called while the device executes a command, for example to read a serial port.
+//! It must not use the device.
+typedef void (*sha204_wait_hook_t)(void *context);
+
+//! One command of an authentication transaction, with the parameters of sha204m_execute
+typedef struct
+{
+	uint8_t op_code;       //!< command op-code
+	uint8_t param1;        //!< first parameter, usually the mode
+	uint16_t param2;       //!< second parameter, usually the key id
+	uint8_t datalen1;      //!< size of data1
+	uint8_t *data1;        //!< first data block, for example a challenge
+	uint8_t datalen2;      //!< size of data2
+	uint8_t *data2;        //!< second data block, for example the CheckMac client response
+	uint8_t datalen3;      //!< size of data3
+	uint8_t *data3;        //!< third data block, for example the CheckMac other data
+	uint8_t *rx_buffer;    //!< receives the response packet; NULL to discard it. It must hold the
+	                       //!< response size of the command, for example READ_32_RSP_SIZE for a
+	                       //!< 32-byte Read; SHA204_RSP_SIZE_MAX bytes always suffice.
+} sha204_auth_step_t;
+
+//! Aggregated result of an authentication transaction
+typedef struct
+{
+	uint8_t ret_code;      //!< SHA204_SUCCESS, or the return code of the step that failed
+	uint8_t steps_done;    //!< steps that succeeded; the index of the failed step on failure
+	uint8_t status;        //!< status byte of the last status response; 0 if CheckMac matched
+	unsigned long total_us;                       //!< from the wake pulse to the last response
+	unsigned long step_us[SHA204_AUTH_STEPS_MAX]; //!< from sending a command to its checked response
+} sha204_auth_result_t;
+
+/* sha204_stream.h */
+
+// readZone() reads a range of a zone in one awake session with as few Read commands
+// as the alignment allows: 32-byte reads for the whole blocks in the range, 4-byte
+// reads for the words before and after them. Each response goes straight from the
+// receive buffer to a sink function, so no buffer of the whole range is needed.
+#define SHA204_STREAM_SESSION_MAX    (1000) //! ms after which the device is put to sleep and woken again, before its watchdog does it
+
+//! Receives length bytes read at a byte address. Returns 0 to go on, anything else to stop.
+typedef uint8_t (*sha204_zone_sink_t)(void *context, uint16_t address, const uint8_t *data, uint8_t length);
+
+//! Result of a readZone() call
+typedef struct
+{
+	uint8_t ret_code;         //!< SHA204_SUCCESS, or the return code of the read that failed
+	uint8_t stopped;          //!< 1 if the sink stopped the read
+	uint8_t reads;            //!< Read commands sent
+	uint16_t bytes;           //!< bytes handed to the sink
+	unsigned long total_us;   //!< from the wake pulse to the return of the last sink call
+	uint16_t bytes_per_s;     //!< throughput, bytes over total_us
+} sha204_stream_result_t;
+
+/* sha204_link.h */
+
+// sha204Link frames messages between a host and its clients over a Stream such as
+// Serial. A frame is a start byte followed by a packet laid out like a command packet:
+// count, channel, type, sequence number, payload and the CRC-16 of the device.
+// Frames sent with request() stay outstanding until a frame with the same channel and
+// sequence number comes back, so several challenges can be in flight at a time.
+// poll() never blocks; it consumes whatever bytes have arrived.
+#define SHA204_LINK_SOF              ((uint8_t) 0x5A)  //!< start of frame
+#define SHA204_LINK_HEADER_SIZE      (4)    //! count, channel, type and sequence number
+#define SHA204_LINK_PAYLOAD_MAX      (32)   //! largest payload, one challenge, serial or MAC
+#define SHA204_LINK_FRAME_MIN        (SHA204_LINK_HEADER_SIZE + SHA204_CRC_SIZE)  //! frame size without start byte and payload
+#define SHA204_LINK_FRAME_MAX        (SHA204_LINK_FRAME_MIN + SHA204_LINK_PAYLOAD_MAX)
+#define SHA204_LINK_WINDOW           (4)    //! requests that can be outstanding at a time
+#define SHA204_LINK_BYTE_TIMEOUT     (20)   //! ms between two bytes of a frame before it is dropped
+
+// Message types of the diversified examples. The link does not interpret them.
+#define SHA204_LINK_SERIAL           ((uint8_t) 0x01)  //!< client to host: padded serial number
+#define SHA204_LINK_CHALLENGE        ((uint8_t) 0x02)  //!< host to client: random challenge
+#define SHA204_LINK_RESPONSE         ((uint8_t) 0x03)  //!< client to host: MAC of the challenge
+#define SHA204_LINK_RESULT           ((uint8_t) 0x04)  //!< host to client: CheckMac status byte
+
+//! A received frame
+typedef struct
+{
+	uint8_t channel;        //!< client the frame is from or to
+	uint8_t type;           //!< message type
+	uint8_t seq;            //!< sequence number
+	uint8_t answered;       //!< 1 if the frame answered an outstanding request
+	uint16_t round_trip;    //!< ms since that request was sent
+	uint8_t length;         //!< payload size
+	uint8_t payload[SHA204_LINK_PAYLOAD_MAX];  //!< payload
+} sha204_link_frame_t;
+
+//! Frame counters of a link
+typedef struct
+{
+	uint16_t sent;          //!< frames sent
+	uint16_t received;      //!< valid frames received
+	uint16_t bad_crc;       //!< frames dropped because of their CRC
+	uint16_t bad_frames;    //!< frames dropped because of their count or a gap between bytes
+	uint16_t expired;       //!< requests that were not answered in time
+} sha204_link_stats_t;
+
 /* EEPROM Addresses */
 /* Configuration Zone */
 #define ADDRESS_SN03		0	// SN[0:3] are bytes 0->3 of configuration zone
@@ -278,6 +673,9 @@
 #define ADDRESS_I2CADD		16	// Defines I2C address of SHA204
 #define	ADDRESS_OTPMODE		18	// Sets the One-time-programmable mode
 #define	ADDRESS_SELECTOR	19	// Controls writability of Selector
+#define ADDRESS_SLOTCONFIG	20	// SlotConfig of slots 0 to 15, two bytes each
+#define ADDRESS_LOCKVALUE	86	// 0x55 while the data and OTP zones are unlocked
+#define ADDRESS_LOCKCONFIG	87	// 0x55 while the configuration zone is unlocked
 
 #define SHA204_CONFIG_SIZE	88
 
@@ -301,15 +699,288 @@
 #define CHECKMAC_CLIENT_COMMAND_SIZE    ( 4)                   //!< CheckMAC size of client command header size inside "other data"
 /** @} */
 
+/* sha204_engine.h */
+
+// sha204AuthEngine checks the MACs of several clients with diversified keys over one
+// sha204Link. Device work is scheduled around the messages: the random challenge for
+// the next client is generated before its serial number arrives, and Nonce and GenDig
+// for a challenged client run while the client computes and sends its MAC, so only
+// CheckMac is left when the MAC arrives. TempKey holds the key of one client at a time
+// and is kept in idle mode; a MAC from another client runs the whole sequence. The
+// engine sets the wait hook of the device to take in frames while commands execute.
+#define SHA204_ENGINE_SLOTS          SHA204_LINK_WINDOW  //! clients that can be authenticated at a time
+#define SHA204_ENGINE_TIMEOUT        (2000) //! ms a client has to answer a challenge
+#define SHA204_ENGINE_NONE           ((uint8_t) 0xFF)    //!< no slot
+
+//! Diversified key scheme the MACs are checked against
+typedef struct
+{
+	uint8_t parent_key;                                     //!< host slot with the parent of the client keys
+	uint8_t derive_key_command[GENDIG_OTHER_DATA_SIZE];     //!< DeriveKey the clients ran; GenDig other data
+	uint8_t checkmac_mode;                                  //!< CheckMac mode; TempKey must be the first block
+	uint8_t checkmac_other_data[CHECKMAC_OTHER_DATA_SIZE];  //!< MAC command of the clients and the bytes it leaves out
+} sha204_engine_scheme_t;
+
+//! Counters of an authentication engine
+typedef struct
+{
+	uint16_t passed;        //!< MACs that matched
+	uint16_t failed;        //!< MACs that did not match
+	uint16_t errors;        //!< device errors; the client gets the return code
+	uint16_t primed;        //!< MACs checked with CheckMac alone because Nonce and GenDig had run ahead
+	uint16_t unprimed;      //!< MACs that needed Nonce, GenDig and CheckMac
+	uint16_t ahead;         //!< challenges sent from a random generated ahead of time
+	uint16_t busy;          //!< serial numbers ignored because every slot was in use
+	uint16_t expired;       //!< challenges not answered within SHA204_ENGINE_TIMEOUT
+} sha204_engine_stats_t;
+
+/* sha204_scheduler.h */
+
+// sha204Scheduler shares one device between several kinds of work. A job is a
+// transaction as run by authenticate(), so a Nonce and the commands that use its
+// TempKey always run in one awake session. Jobs run one at a time by priority, then
+// by deadline, then in the order they were submitted. A job that keeps TempKey puts
+// the device into idle mode, and until a job of the same owner that does not keep it
+// has run, no other owner's job is started.
+#define SHA204_SCHED_QUEUE           (8)    //! jobs that can wait at a time
+#define SHA204_SCHED_CLASSES         (3)    //! number of priorities
+#define SHA204_SCHED_HOLD_TIMEOUT    (1000) //! ms TempKey is kept for an owner; the watchdog clears it after about 1.3 s
+
+#define SHA204_SCHED_NONE            ((uint8_t) 0xFF)  //!< no job or owner
+#define SHA204_PRIORITY_HIGH         ((uint8_t) 0)   //!< latency critical, for example authentication
+#define SHA204_PRIORITY_NORMAL       ((uint8_t) 1)   //!< for example configuration reads
+#define SHA204_PRIORITY_LOW          ((uint8_t) 2)   //!< background work, for example filling a random pool
+
+#define SHA204_JOB_KEEP_TEMPKEY      ((uint8_t) 0x01)  //!< idle instead of sleep and keep TempKey for the owner's next job
+
+#define SHA204_JOB_FREE              ((uint8_t) 0)   //!< not submitted, or finished
+#define SHA204_JOB_QUEUED            ((uint8_t) 1)   //!< waiting to run
+
+struct sha204_job;
+//! Called when a job has finished, failed or missed its deadline.
+typedef void (*sha204_job_done_t)(struct sha204_job *job, void *context);
+
+//! A transaction submitted to a sha204Scheduler. It must stay valid until it is done.
+typedef struct sha204_job
+{
+	const sha204_auth_step_t *steps;  //!< commands to run
+	uint8_t step_count;               //!< number of steps
+	uint8_t priority;                 //!< SHA204_PRIORITY_HIGH, _NORMAL or _LOW
+	uint8_t owner;                    //!< who the job is for, not SHA204_SCHED_NONE; TempKey is kept per owner
+	uint8_t flags;                    //!< SHA204_JOB_KEEP_TEMPKEY
+	uint16_t deadline;                //!< ms after submitting by which the job must have started, 0 for none
+	sha204_job_done_t done;           //!< called when the job is done; may be NULL
+	void *context;                    //!< passed to done
+	uint8_t state;                    //!< SHA204_JOB_FREE or SHA204_JOB_QUEUED
+	unsigned long submitted;          //!< millis() when the job was submitted
+	sha204_auth_result_t result;      //!< result; ret_code is SHA204_DEADLINE if the job never ran
+} sha204_job_t;
+
+//! Counters of one priority class of a scheduler
+typedef struct
+{
+	uint16_t runs;            //!< jobs that ran
+	uint16_t failed;          //!< jobs that ran and did not return SHA204_SUCCESS
+	uint16_t expired;         //!< jobs dropped because their deadline passed while they waited
+	uint16_t wait_max;        //!< longest queueing delay in ms
+	unsigned long wait_total; //!< queueing delay in ms of all jobs that ran
+} sha204_sched_stats_t;
+
+/* sha204_attest.h */
+
+// sha204Attestor has the device vouch for firmware images and other large data.
+// An image is hashed with SHA-256 in chunks from wherever a read function finds it,
+// such as flash, an external SPI flash or a file. The digest is loaded into TempKey
+// with Nonce in pass-through mode, and MAC signs it with a key:
+// MAC = SHA-256(key || digest || MAC command || 000... || SN[8] || 0000 || SN[0:1]).
+// A second image can be added while the first one is attested; it is hashed from the
+// wait hook of the device while Nonce and MAC execute.
+#define SHA204_ATTEST_CHUNK          (64)   //! bytes read and hashed at a time, one SHA-256 block
+#define SHA204_ATTEST_IMAGES         (2)    //! images that can be added at a time
+#define SHA204_ATTEST_MAC_MODE       (MAC_MODE_BLOCK2_TEMPKEY | MAC_MODE_SOURCE_FLAG_MATCH)  //! TempKey from a pass-through Nonce
+
+//! Reads length bytes of an image at offset into buffer and returns the number of bytes read.
+typedef uint16_t (*sha204_image_read_t)(void *context, uint32_t offset, uint8_t *buffer, uint16_t length);
+
+/* sha204_zone.h */
+
+// sha204ZoneCache buffers the data and OTP zones in 32-byte blocks. Writes are kept
+// in RAM until flush() or sleep(). A block whose eight words were all written goes
+// out as one 32-byte write instead of eight 4-byte ones. Once the data zone is locked
+// only 32-byte writes are accepted there, so a partly written block is completed by
+// one 32-byte read first. Reads are answered from the cache where it holds the words
+// and otherwise read the whole block. Only slots that are read and written in clear
+// may be accessed through the cache.
+#define SHA204_ZONE_CACHE_BLOCKS     (2)    //! blocks held at a time, 36 bytes each
+#define SHA204_ZONE_CACHE_WORDS      (SHA204_ZONE_ACCESS_32 / SHA204_ZONE_ACCESS_4)  //! words in a block
+#define SHA204_ZONE_CACHE_ALL        ((uint8_t) 0xFF)  //!< word mask of a whole block
+#define SHA204_ZONE_CACHE_NONE       ((uint8_t) 0xFF)  //!< tag of an unused block
+
+#define SHA204_ZONE_SHORT           (0)    //!< counter index of 4-byte accesses
+#define SHA204_ZONE_LONG            (1)    //!< counter index of 32-byte accesses
+
+//! Counters of a sha204ZoneCache, each for 4-byte and 32-byte accesses
+typedef struct
+{
+	uint16_t reads[2];           //!< read() calls
+	uint16_t writes[2];          //!< write() calls
+	uint16_t device_reads[2];    //!< Read commands sent
+	uint16_t device_writes[2];   //!< Write commands sent
+	uint32_t read_us[2];         //!< time spent in the Read commands
+	uint32_t write_us[2];        //!< time spent in the Write commands
+} sha204_zone_stats_t;
+
+/* sha204_provision.h */
+
+// sha204Provisioner brings a blank device into the state a sha204_image_t describes.
+// The configuration bytes are read once and only the words that differ are written,
+// the slot configurations as one 32-byte block. Slots and OTP are written in 32-byte
+// blocks; they cannot be read before the data zone is locked, so they are not compared.
+// The lock summaries are computed from the image and the serial number instead of
+// reading the zones back. The device checks them, so a wrong write makes the lock fail.
+// Summaries compiled offline, see extras/host/sha204_compile.cpp, can be passed instead.
+#define SHA204_PROVISION_CONFIG_START (16)  //! first configuration byte Write can change
+#define SHA204_PROVISION_CONFIG_END  (84)   //! first configuration byte after them
+#define SHA204_PROVISION_CONFIG_SIZE (SHA204_PROVISION_CONFIG_END - SHA204_PROVISION_CONFIG_START)
+#define SHA204_PROVISION_SLOT_COUNT  (SHA204_KEY_ID_MAX + 1)  //! number of slots
+#define SHA204_PROVISION_OTP_SIZE    ((SHA204_OTP_BLOCK_MAX + 1) * SHA204_ZONE_ACCESS_32)  //! size of the OTP zone
+
+#define SHA204_PROVISION_LOCK_CONFIG ((uint8_t) 0x01)  //!< lock the configuration zone
+#define SHA204_PROVISION_LOCK_DATA   ((uint8_t) 0x02)  //!< lock the data and OTP zones; the image has to hold all slots and OTP
+#define SHA204_PROVISION_SUMMARIES   ((uint8_t) 0x04)  //!< lock with the summaries of the image instead of computing them
+
+//! Target state of a device
+typedef struct
+{
+	const uint8_t *config;    //!< SHA204_PROVISION_CONFIG_SIZE configuration bytes from byte 16 on, or NULL to leave them
+	const uint8_t *data;      //!< 16 slots of 32 bytes, or NULL
+	uint16_t slots;           //!< bit n set: write slot n; the others are expected to hold their data already
+	const uint8_t *otp;       //!< SHA204_PROVISION_OTP_SIZE OTP bytes, or NULL to leave them
+	uint8_t lock;             //!< SHA204_PROVISION_LOCK_CONFIG, SHA204_PROVISION_LOCK_DATA and SHA204_PROVISION_SUMMARIES
+	uint16_t config_summary;  //!< CRC of the locked configuration zone, used with SHA204_PROVISION_SUMMARIES
+	uint16_t data_summary;    //!< CRC of the data and OTP zones, used with SHA204_PROVISION_SUMMARIES
+} sha204_image_t;
+
+//! Result of provisioning one device
+typedef struct
+{
+	uint8_t ret_code;         //!< SHA204_SUCCESS, or the return code of the command that failed
+	uint8_t reads;            //!< Read commands sent
+	uint8_t writes;           //!< Write commands sent
+	uint8_t unchanged;        //!< configuration words that already matched the image
+	uint8_t locks;            //!< Lock commands sent
+	unsigned long total_us;   //!< from the wake pulse to the last response
+} sha204_provision_result_t;
+
+/* sha204_warm.h */
+
+// sha204WarmStart keeps what a firmware reads from the device at boot in non-volatile
+// memory of the MCU, such as its EEPROM: the serial number, the DevRev response, a
+// SHA-256 hash of the configuration zone and the lock word. At the next boot a single
+// 4-byte read of SN[4:7] checks that the same device is attached, and the record is
+// used instead of reading the zone again. SN[0:1] is the same on every device, so the
+// word holding SN[4:7] tells devices apart better than the one holding SN[0:3]. A
+// record is trusted only if the configuration and data zones were both locked when it
+// was stored. UserExtra and Selector (bytes 84 and 85) can still change after that, so
+// they are left out of the hash, and those bytes of the stored lock word may be stale.
+#define SHA204_WARM_MAGIC            ((uint8_t) 0xA8)  //!< first byte of a stored record; change it with the layout
+#define SHA204_WARM_SERIAL_SIZE      (9)    //! SN[0:8]
+#define SHA204_WARM_HASH_SIZE        (32)   //! SHA-256 of the configuration zone
+
+//! Reads count bytes at address of the non-volatile memory.
+typedef void (*sha204_nvm_read_t)(void *context, uint16_t address, uint8_t *data, uint8_t count);
+//! Writes count bytes to address of the non-volatile memory.
+typedef void (*sha204_nvm_write_t)(void *context, uint16_t address, const uint8_t *data, uint8_t count);
+
+//! Record stored by sha204WarmStart
+typedef struct
+{
+	uint8_t magic;                                //!< SHA204_WARM_MAGIC
+	uint8_t serial[SHA204_WARM_SERIAL_SIZE];      //!< SN[0:8]
+	uint8_t dev_rev[4];                           //!< data of the DevRev response
+	uint8_t lock_word[4];                         //!< configuration bytes 84 to 87
+	uint8_t config_hash[SHA204_WARM_HASH_SIZE];   //!< SHA-256 of the configuration bytes except 84 and 85
+	uint8_t crc[SHA204_CRC_SIZE];                 //!< CRC of the bytes above, as the device computes it
+} sha204_warm_record_t;
+
+//! Result of sha204WarmStart::begin() and refresh()
+typedef struct
+{
+	uint8_t ret_code;         //!< SHA204_SUCCESS, or the return code of the command that failed
+	uint8_t warm;             //!< 1 if the stored record was used
+	uint8_t commands;         //!< commands sent, not counting the wake-up
+	unsigned long total_us;   //!< from the wake pulse to the last response
+} sha204_warm_result_t;
+
+#if defined(__AVR__)
+// Read and write functions for the EEPROM of an AVR. Bytes that already hold
+// the value are not written again.
+void sha204_eeprom_read(void *context, uint16_t address, uint8_t *data, uint8_t count);
+void sha204_eeprom_write(void *context, uint16_t address, const uint8_t *data, uint8_t count);
+#endif
+
+/* sha204_variant.h */
+
+// detectVariant() tells the ATSHA204 and the ATSHA204A apart by their revision, the
+// last byte of RevNum (configuration byte 7). DevRev returns RevNum, so the revision
+// is also the last byte of its response. detectVariant() selects the execution times
+// of that part. sha204c_exchange() then waits the time of the table before the first
+// poll instead of the *_DELAY value. Polling still ends at the *_EXEC_MAX value, so a
+// command that takes longer than the table costs polls, not a failure.
+#define SHA204_VARIANT_UNKNOWN       ((uint8_t) 0)     //!< not detected; the *_DELAY values apply
+#define SHA204_VARIANT_ATSHA204      ((uint8_t) 1)     //!< ATSHA204
+#define SHA204_VARIANT_ATSHA204A     ((uint8_t) 2)     //!< ATSHA204A
+#define SHA204_REVISION_ATSHA204A    ((uint8_t) 0x09)  //! first revision of the ATSHA204A
+#define ADDRESS_REVISION             (7)               //! revision byte of RevNum
+
+// Typical execution times of the ATSHA204A where they are shorter than those above
+#define CHECKMAC_DELAY_A                ((uint8_t) ( 5.0 * CPU_CLOCK_DEVIATION_NEGATIVE - 0.5))
+#define DERIVE_KEY_DELAY_A              ((uint8_t) ( 2.0 * CPU_CLOCK_DEVIATION_NEGATIVE - 0.5))
+#define GENDIG_DELAY_A                  ((uint8_t) ( 5.0 * CPU_CLOCK_DEVIATION_NEGATIVE - 0.5))
+#define HMAC_DELAY_A                    ((uint8_t) (13.0 * CPU_CLOCK_DEVIATION_NEGATIVE - 0.5))
+#define MAC_DELAY_A                     ((uint8_t) ( 5.0 * CPU_CLOCK_DEVIATION_NEGATIVE - 0.5))
+#define NONCE_DELAY_A                   ((uint8_t) ( 7.0 * CPU_CLOCK_DEVIATION_NEGATIVE - 0.5))
+#define RANDOM_DELAY_A                  ((uint8_t) ( 1.0 * CPU_CLOCK_DEVIATION_NEGATIVE - 0.5))
+
+//! Minimum execution times of a variant in ms, waited before the first poll
+typedef struct
+{
+	uint8_t checkmac;
+	uint8_t derive_key;
+	uint8_t devrev;
+	uint8_t gendig;
+	uint8_t hmac;
+	uint8_t lock;
+	uint8_t mac;
+	uint8_t nonce;
+	uint8_t pause;
+	uint8_t random;
+	uint8_t read;
+	uint8_t update_extra;
+	uint8_t write;
+} sha204_timing_t;
+
 #define SHA204_SUCCESS					0
 
 class atsha204Class
 {
 private:
+#if defined(SHA204_SWI_HOST)
+	sha204HostDevice *host_device;
+	uint8_t host_pin_low;
+	static void host_charge_crc(uint8_t length);
+#elif defined(SHA204_SWI_ARM)
+	uint8_t device_pin_number;
+	uint8_t device_pin_ready;
+	uint32_t device_pin, device_pin_clear;
+	volatile uint32_t *device_port_SET, *device_port_CLR, *device_port_IN;
+	volatile uint32_t *device_port_DIRSET, *device_port_DIRCLR;	// NULL for open-drain pins
+	void swi_init_pin();
+#else
 	uint8_t device_pin;
 	volatile uint8_t *device_port_DDR, *device_port_OUT, *device_port_IN;
-	void sha204c_calculate_crc(uint8_t length, uint8_t *data, uint8_t *crc);
-	uint8_t sha204c_check_crc(uint8_t *response);
+#endif
+	void init();
 	void swi_set_signal_pin(uint8_t is_high);
 	uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer);
 	uint8_t swi_send_bytes(uint8_t count, uint8_t *buffer);
@@ -317,15 +988,61 @@ private:
 	uint8_t sha204p_receive_response(uint8_t size, uint8_t *response);
 	uint8_t sha204p_wakeup();
 	uint8_t sha204p_send_command(uint8_t count, uint8_t * command);
-	uint8_t sha204p_sleep();
-	uint8_t sha204p_resync(uint8_t size, uint8_t *response);
+	uint8_t sha204p_resync(uint8_t size, uint8_t *response, uint8_t delay_ms);
+	const sha204_retry_policy_t *retry_policy;
+	uint8_t sha204c_wakeup(uint8_t *response, const sha204_retry_policy_t *policy);
+	uint8_t sha204c_resync(uint8_t size, uint8_t *response, const sha204_retry_policy_t *policy,
+			unsigned long start_ms);
+	uint8_t sha204c_exchange(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer, uint8_t execution_delay, uint8_t execution_timeout,
+			const sha204_retry_policy_t *policy, uint8_t crc_ready);
+	void sha204c_execution_wait(uint8_t delay_ms);
+	uint8_t sha204c_abandon();
+	const sha204_auth_step_t *prepare_step;	// assembled into prepare_buffer during the next execution delay
+	uint8_t *prepare_buffer;
+	sha204_wait_hook_t wait_hook;
+	void *wait_hook_context;
+	uint8_t variant;
+	const sha204_timing_t *timing;	// NULL while the *_DELAY values apply
+	void sha204c_variant_delay(uint8_t op_code, uint8_t *execution_delay, uint8_t *execution_timeout);
+	void sha204m_command_timing(uint8_t op_code, uint8_t param1,
+			uint8_t *poll_delay, uint8_t *poll_timeout, uint8_t *response_size);
+	uint8_t sha204m_assemble(uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			uint8_t *tx_buffer);
+#if defined(SHA204_CAPTURE)
+	uint8_t *capture_buffer;
+	uint16_t capture_size, capture_head, capture_tail, capture_used;
+	void sha204p_capture(uint8_t type, uint8_t status, uint8_t length, const uint8_t *data);
+#endif
+#if defined(SHA204_HEALTH)
+	sha204_health_t health;
+	uint8_t sha204c_health_admit();
+	uint8_t sha204c_health_record(uint8_t ret_code);
+#endif
+#if defined(SHA204_MEMO)
+	sha204_memo_t memo;
+	sha204_memo_entry_t memo_entries[SHA204_MEMO_ENTRIES];	// most recently used first
+	uint8_t sha204c_memo_cacheable(const uint8_t *tx_buffer);
+	uint8_t sha204c_memo_lookup(const uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer);
+	uint8_t sha204c_memo_store(const uint8_t *tx_buffer, const uint8_t *rx_buffer, uint8_t ret_code);
+#endif
+#if defined(SHA204_STATS)
+	sha204_stats_t stats;
+	uint8_t sha204c_stats_record(uint8_t op_code, unsigned long start_us, uint8_t ret_code);
+#endif
 	
 
 public:
 	atsha204Class(uint8_t pin);	// Constructor
 	uint8_t sha204c_wakeup(uint8_t *response);
-	uint8_t sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer, uint8_t execution_delay, uint8_t execution_timeout);
+	uint8_t sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer, uint8_t execution_delay, uint8_t execution_timeout,
+			const sha204_retry_policy_t *policy = NULL);
 	uint8_t sha204c_resync(uint8_t size, uint8_t *response);	
+	static void sha204c_calculate_crc(uint8_t length, uint8_t *data, uint8_t *crc);
+	static uint16_t sha204c_update_crc(uint8_t length, const uint8_t *data, uint16_t crc_register);
+	static uint8_t sha204c_check_crc(uint8_t *response);
+	uint8_t sha204p_sleep();
+	uint8_t sha204p_idle();
 	uint8_t sha204m_random(uint8_t * tx_buffer, uint8_t * rx_buffer, uint8_t mode);
 	uint8_t sha204m_dev_rev(uint8_t *tx_buffer, uint8_t *rx_buffer);
 	uint8_t sha204m_read(uint8_t *tx_buffer, uint8_t *rx_buffer, uint8_t zone, uint16_t address);
@@ -351,7 +1068,271 @@ public:
 	uint8_t sha204e_configure_diversify_key(void);
 	uint8_t sha204m_mac(uint8_t *tx_buffer, uint8_t *rx_buffer,
 			uint8_t mode, uint16_t key_id, uint8_t *challenge);
+	uint8_t sha204m_check_mac(uint8_t *tx_buffer, uint8_t *rx_buffer,
+			uint8_t mode, uint8_t key_id, uint8_t *client_challenge, uint8_t *client_response, uint8_t *other_data);
+	uint8_t authenticate(const sha204_auth_step_t *steps, uint8_t step_count, sha204_auth_result_t *result,
+			uint8_t idle = 0);
+	uint8_t readZone(uint8_t zone, uint16_t address, uint16_t length, sha204_zone_sink_t sink, void *context,
+			sha204_stream_result_t *result = NULL);
+
+	void setRetryPolicy(const sha204_retry_policy_t *policy);
+	const sha204_retry_policy_t *getRetryPolicy();
+	void setWaitHook(sha204_wait_hook_t hook, void *context);
+	sha204_wait_hook_t getWaitHook(void **context = NULL);
+	uint8_t detectVariant();
+	void setVariant(uint8_t variant);
+	uint8_t getVariant();
+
+#if defined(SHA204_SWI_HOST)
+	void setHostDevice(sha204HostDevice *device);
+	static void setHostCrcCost(uint16_t ns_per_byte);
+#endif
+#if defined(SHA204_CAPTURE)
+	void captureBegin(uint8_t *buffer, uint16_t size);
+	void captureEnd();
+	void captureClear();
+	uint16_t captureExport(Print &out);
+#endif
+#if defined(SHA204_HEALTH)
+	const sha204_health_t *getHealth();
+	void resetHealth();
+	void setHealthLimits(uint8_t max_failures, uint8_t max_error_rate, uint16_t probe_interval);
+	uint8_t isAvailable();
+#endif
+#if defined(SHA204_MEMO)
+	const sha204_memo_t *getMemo();
+	uint8_t memoRefresh();
+	void memoClear();
+#endif
+#if defined(SHA204_STATS)
+	const sha204_stats_t *getStats();
+	void resetStats();
+	void dumpStats(Print &out);
+	void printStats(Print &out);
+#endif
+#if defined(SHA204_SWI_ICP)
+	uint8_t swi_receive_bytes_async(uint8_t count, uint8_t *buffer, sha204_swi_callback_t callback);
+	uint8_t swi_receive_busy();
+	uint8_t sha204p_receive_response_async(uint8_t size, uint8_t *response, sha204_swi_callback_t callback);
+#endif
+#if defined(SHA204_SWI_SPI_TX)
+	uint8_t swi_send_bytes_async(uint8_t count, uint8_t *buffer, sha204_swi_callback_t callback);
+	uint8_t swi_send_busy();
+#endif
 
 };
 
+class sha204Link
+{
+private:
+	Stream *stream;
+	uint8_t tx_seq;
+	uint8_t rx_sync;	// start byte seen
+	uint8_t rx_pos;
+	unsigned long rx_last;
+	uint8_t rx_buffer[SHA204_LINK_FRAME_MAX];
+	struct
+	{
+		uint8_t in_use;
+		uint8_t channel;
+		uint8_t seq;
+		unsigned long sent_at;
+	} window[SHA204_LINK_WINDOW];
+	sha204_link_stats_t stats;
+
+public:
+	sha204Link(Stream &stream);
+	uint8_t send(uint8_t channel, uint8_t type, uint8_t seq, const uint8_t *payload, uint8_t length);
+	uint8_t request(uint8_t channel, uint8_t type, const uint8_t *payload, uint8_t length, uint8_t *seq);
+	uint8_t poll(sha204_link_frame_t *frame);
+	uint8_t expired(uint16_t timeout_ms, uint8_t *channel, uint8_t *seq);
+	uint8_t outstanding();
+	void cancel();
+	const sha204_link_stats_t *getStats();
+};
+
+class sha204AuthEngine
+{
+private:
+	atsha204Class *device;
+	sha204Link *link;
+	const sha204_engine_scheme_t *scheme;
+	uint8_t random[MAC_CHALLENGE_SIZE];
+	uint8_t random_ready;
+	uint8_t primed;		// slot whose client key is in TempKey
+	struct
+	{
+		uint8_t state;
+		uint8_t channel;
+		uint8_t seq;
+		unsigned long since;
+		uint8_t serial[NONCE_NUMIN_SIZE_PASSTHROUGH];
+		uint8_t challenge[MAC_CHALLENGE_SIZE];
+		uint8_t mac[CHECKMAC_CLIENT_RESPONSE_SIZE];
+	} slots[SHA204_ENGINE_SLOTS];
+	uint8_t working;	// slot the device works for
+	sha204_engine_stats_t stats;
+	static void drain(void *context);
+	void takeIn();
+	void receive(const sha204_link_frame_t *frame);
+	uint8_t oldest(uint8_t state);
+	uint8_t challenge(uint8_t slot);
+	uint8_t run(sha204_auth_step_t *steps, uint8_t step_count, sha204_auth_result_t *result);
+	void keySteps(uint8_t slot, sha204_auth_step_t *steps);
+	uint8_t prime(uint8_t slot);
+	uint8_t verify(uint8_t slot);
+
+public:
+	sha204AuthEngine(atsha204Class &device, sha204Link &link, const sha204_engine_scheme_t *scheme);
+	uint8_t poll();
+	uint8_t pending();
+	const sha204_engine_stats_t *getStats();
+	void resetStats();
+};
+
+class sha204Sha256
+{
+private:
+	uint32_t state[8];
+	uint32_t length;	// bytes hashed
+	uint8_t block[64];
+	void compress();
+
+public:
+	sha204Sha256();
+	void init();
+	void update(const uint8_t *data, uint16_t count);
+	void finish(uint8_t *digest);
+};
+
+class sha204Attestor
+{
+private:
+	atsha204Class *device;
+	uint16_t key_id;
+	struct
+	{
+		sha204_image_read_t read;
+		void *context;
+		uint32_t size;
+		uint32_t offset;	// bytes hashed so far
+		uint8_t failed;		// read returned fewer bytes than asked for
+		sha204Sha256 hash;
+	} images[SHA204_ATTEST_IMAGES];
+	uint8_t first;		// image attested next
+	uint8_t count;
+	sha204_wait_hook_t chained_hook;	// wait hook of the device before attest(), called from hashHook
+	void *chained_context;
+	static void hashHook(void *context);
+	uint8_t hashChunk(uint8_t index);
+
+public:
+	sha204Attestor(atsha204Class &device, uint16_t key_id);
+	uint8_t add(sha204_image_read_t read, void *context, uint32_t size, const uint8_t *challenge = NULL);
+	uint8_t hash();
+	uint8_t attest(uint8_t *digest, uint8_t *mac);
+	uint8_t pending();
+};
+
+class sha204Scheduler
+{
+private:
+	atsha204Class *device;
+	sha204_job_t *queue[SHA204_SCHED_QUEUE];	// in the order of submission
+	uint8_t queued;
+	uint8_t holder;		// owner whose TempKey the device keeps
+	unsigned long held_at;
+	sha204_sched_stats_t stats[SHA204_SCHED_CLASSES];
+	uint8_t next();
+	sha204_job_t *take(uint8_t index);
+	void finish(sha204_job_t *job);
+
+public:
+	sha204Scheduler(atsha204Class &device);
+	uint8_t submit(sha204_job_t *job);
+	uint8_t cancel(sha204_job_t *job);
+	uint8_t poll();
+	uint8_t pending();
+	const sha204_sched_stats_t *getStats(uint8_t priority);
+	void resetStats();
+	void printStats(Print &out);
+};
+
+class sha204ZoneCache
+{
+private:
+	atsha204Class *device;
+	struct
+	{
+		uint8_t tag;		// zone in bits 6 and 7, block number below
+		uint8_t valid;		// words that match the device or were written
+		uint8_t dirty;		// words not written to the device yet
+		uint8_t used;		// value of clock at the last access
+		uint8_t bytes[SHA204_ZONE_ACCESS_32];
+	} blocks[SHA204_ZONE_CACHE_BLOCKS];
+	uint8_t clock;
+	uint8_t lock_value;		// 0xFF until the lock state has been read
+	sha204_zone_stats_t stats;
+	uint8_t readLockState();
+	uint8_t block(uint8_t tag, uint8_t *index);
+	uint8_t fill(uint8_t index);
+	uint8_t flushBlock(uint8_t index);
+	uint8_t deviceRead(uint8_t zone, uint16_t address, uint8_t *response);
+	uint8_t deviceWrite(uint8_t zone, uint16_t address, uint8_t *data);
+
+public:
+	sha204ZoneCache(atsha204Class &device);
+	uint8_t read(uint8_t zone, uint16_t address, uint8_t *data, uint8_t length);
+	uint8_t write(uint8_t zone, uint16_t address, const uint8_t *data, uint8_t length);
+	uint8_t flush();
+	uint8_t sleep();
+	void invalidate();
+	int16_t savedTransactions();
+	int32_t savedMs();
+	const sha204_zone_stats_t *getStats();
+	void resetStats();
+	void printStats(Print &out);
+};
+
+class sha204Provisioner
+{
+private:
+	atsha204Class *device;
+	sha204_provision_result_t *result;
+	unsigned long session_ms;
+	uint8_t renew();
+	uint8_t read(uint8_t zone, uint16_t address, uint8_t *response);
+	uint8_t write(uint8_t zone, uint16_t address, const uint8_t *data);
+	uint8_t lock(uint8_t zone, uint16_t summary);
+	uint8_t configure(const sha204_image_t *image, uint8_t *config_head, uint8_t config_locked);
+
+public:
+	sha204Provisioner(atsha204Class &device);
+	uint8_t provision(const sha204_image_t *image, sha204_provision_result_t *result = NULL);
+	static void printResult(Print &out, const sha204_provision_result_t *result);
+};
+
+class sha204WarmStart
+{
+private:
+	atsha204Class *device;
+	sha204_nvm_read_t nvm_read;
+	sha204_nvm_write_t nvm_write;
+	void *context;
+	uint16_t address;
+	sha204_warm_record_t record;
+	uint8_t valid;
+	uint16_t recordCrc();
+	uint8_t load(sha204_warm_result_t *result);
+
+public:
+	sha204WarmStart(atsha204Class &device, sha204_nvm_read_t read, sha204_nvm_write_t write,
+			void *context = NULL, uint16_t address = 0);
+	uint8_t begin(sha204_warm_result_t *result = NULL);
+	uint8_t refresh(sha204_warm_result_t *result = NULL);
+	void invalidate();
+	const sha204_warm_record_t *getRecord();
+	static void printResult(Print &out, const sha204_warm_result_t *result);
+};
+
 #endif
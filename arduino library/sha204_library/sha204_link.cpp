@@ -0,0 +1,206 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+sha204Link::sha204Link(Stream &stream)
+{
+	this->stream = &stream;
+	tx_seq = 0;
+	rx_sync = 0;
+	rx_pos = 0;
+	rx_last = 0;
+	cancel();
+	memset(&stats, 0, sizeof(stats));
+}
+
+/** \brief Sends one frame.
+ *
+ * The frame is handed to the stream in one write. It fits into the transmit
+ * buffer of a hardware serial port, so this does not wait for the wire.
+ *
+ * \param[in] seq sequence number; replies carry the one of the request they answer
+ * \return SHA204_SUCCESS, SHA204_BAD_PARAM, or SHA204_COMM_FAIL if the stream took fewer bytes
+ */
+uint8_t sha204Link::send(uint8_t channel, uint8_t type, uint8_t seq, const uint8_t *payload, uint8_t length)
+{
+	uint8_t frame[1 + SHA204_LINK_FRAME_MAX];
+	uint8_t *packet = &frame[1];
+	uint8_t count = SHA204_LINK_FRAME_MIN + length;
+
+	if (length > SHA204_LINK_PAYLOAD_MAX || (length && !payload))
+		return SHA204_BAD_PARAM;
+
+	frame[0] = SHA204_LINK_SOF;
+	packet[SHA204_BUFFER_POS_COUNT] = count;
+	packet[1] = channel;
+	packet[2] = type;
+	packet[3] = seq;
+	if (length)
+		memcpy(&packet[SHA204_LINK_HEADER_SIZE], payload, length);
+	atsha204Class::sha204c_calculate_crc(count - SHA204_CRC_SIZE, packet, &packet[count - SHA204_CRC_SIZE]);
+
+	if (stream->write(frame, count + 1) != (size_t) count + 1)
+		return SHA204_COMM_FAIL;
+	stats.sent++;
+	return SHA204_SUCCESS;
+}
+
+/** \brief Sends a frame with a new sequence number and keeps it outstanding until answered.
+ *
+ * \param[out] seq sequence number of the request
+ * \return SHA204_SUCCESS, SHA204_FUNC_FAIL if SHA204_LINK_WINDOW requests are
+ *         already outstanding, or an error of send()
+ */
+uint8_t sha204Link::request(uint8_t channel, uint8_t type, const uint8_t *payload, uint8_t length, uint8_t *seq)
+{
+	uint8_t i, ret_code;
+
+	for (i = 0; i < SHA204_LINK_WINDOW && window[i].in_use; i++)
+		;
+	if (i == SHA204_LINK_WINDOW)
+		return SHA204_FUNC_FAIL;
+
+	ret_code = send(channel, type, tx_seq, payload, length);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	window[i].in_use = 1;
+	window[i].channel = channel;
+	window[i].seq = tx_seq;
+	window[i].sent_at = millis();
+	if (seq)
+		*seq = tx_seq;
+	tx_seq++;
+	return SHA204_SUCCESS;
+}
+
+/** \brief Consumes the bytes that have arrived and returns the next complete frame.
+ *
+ * Never waits. Bytes outside of frames are skipped. A frame whose bytes
+ * stop arriving for SHA204_LINK_BYTE_TIMEOUT ms is dropped.
+ *
+ * \param[out] frame the frame, valid when SHA204_SUCCESS is returned
+ * \return SHA204_SUCCESS if a frame was received, SHA204_RX_NO_RESPONSE if none is complete yet,
+ *         SHA204_BAD_CRC, SHA204_INVALID_SIZE or SHA204_RX_FAIL if a frame was dropped
+ */
+uint8_t sha204Link::poll(sha204_link_frame_t *frame)
+{
+	uint8_t count, i;
+
+	if (rx_sync && millis() - rx_last > SHA204_LINK_BYTE_TIMEOUT)
+	{
+		rx_sync = 0;
+		stats.bad_frames++;
+		return SHA204_RX_FAIL;
+	}
+
+	while (stream->available() > 0)
+	{
+		uint8_t value = (uint8_t) stream->read();
+
+		rx_last = millis();
+		if (!rx_sync)
+		{
+			if (value == SHA204_LINK_SOF)
+			{
+				rx_sync = 1;
+				rx_pos = 0;
+			}
+			continue;
+		}
+
+		rx_buffer[rx_pos++] = value;
+		count = rx_buffer[SHA204_BUFFER_POS_COUNT];
+		if (count < SHA204_LINK_FRAME_MIN || count > SHA204_LINK_FRAME_MAX)
+		{
+			rx_sync = 0;
+			stats.bad_frames++;
+			return SHA204_INVALID_SIZE;
+		}
+		if (rx_pos < count)
+			continue;
+
+		// The frame is complete.
+		rx_sync = 0;
+		if (atsha204Class::sha204c_check_crc(rx_buffer) != SHA204_SUCCESS)
+		{
+			stats.bad_crc++;
+			return SHA204_BAD_CRC;
+		}
+		stats.received++;
+
+		frame->channel = rx_buffer[1];
+		frame->type = rx_buffer[2];
+		frame->seq = rx_buffer[3];
+		frame->length = count - SHA204_LINK_FRAME_MIN;
+		memcpy(frame->payload, &rx_buffer[SHA204_LINK_HEADER_SIZE], frame->length);
+		frame->answered = 0;
+		frame->round_trip = 0;
+		for (i = 0; i < SHA204_LINK_WINDOW; i++)
+		{
+			if (window[i].in_use && window[i].channel == frame->channel && window[i].seq == frame->seq)
+			{
+				window[i].in_use = 0;
+				frame->answered = 1;
+				frame->round_trip = (uint16_t) (rx_last - window[i].sent_at);
+				break;
+			}
+		}
+		return SHA204_SUCCESS;
+	}
+	return SHA204_RX_NO_RESPONSE;
+}
+
+/** \brief Gives up on one request that has been outstanding for longer than timeout_ms.
+ *
+ * Call it until it stops returning SHA204_SUCCESS. A late answer to a
+ * request given up on is received with frame->answered set to 0.
+ *
+ * \param[out] channel channel of the request
+ * \param[out] seq     sequence number of the request
+ * \return SHA204_SUCCESS if a request expired, SHA204_FUNC_FAIL if none did
+ */
+uint8_t sha204Link::expired(uint16_t timeout_ms, uint8_t *channel, uint8_t *seq)
+{
+	unsigned long now = millis();
+	uint8_t i;
+
+	for (i = 0; i < SHA204_LINK_WINDOW; i++)
+	{
+		if (window[i].in_use && now - window[i].sent_at > timeout_ms)
+		{
+			window[i].in_use = 0;
+			stats.expired++;
+			if (channel)
+				*channel = window[i].channel;
+			if (seq)
+				*seq = window[i].seq;
+			return SHA204_SUCCESS;
+		}
+	}
+	return SHA204_FUNC_FAIL;
+}
+
+// Returns the number of requests that are waiting for an answer.
+uint8_t sha204Link::outstanding()
+{
+	uint8_t i, n = 0;
+
+	for (i = 0; i < SHA204_LINK_WINDOW; i++)
+		n += window[i].in_use;
+	return n;
+}
+
+// Forgets all outstanding requests.
+void sha204Link::cancel()
+{
+	uint8_t i;
+
+	for (i = 0; i < SHA204_LINK_WINDOW; i++)
+		window[i].in_use = 0;
+}
+
+const sha204_link_stats_t *sha204Link::getStats()
+{
+	return &stats;
+}
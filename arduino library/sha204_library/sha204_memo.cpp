@@ -0,0 +1,169 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#if defined(SHA204_MEMO)
+
+const sha204_memo_t *atsha204Class::getMemo()
+{
+	return &memo;
+}
+
+// Drops all cached responses, the counters and the lock state.
+// Call it when another device may have been attached.
+void atsha204Class::memoClear()
+{
+	memset(&memo, 0, sizeof(memo));
+	memset(memo_entries, 0, sizeof(memo_entries));
+}
+
+/** \brief Reads the lock state that decides which responses are cached.
+ *
+ * The device has to be awake. Call it again after locking a zone so that
+ * the responses that became immutable are cached as well. Cached entries
+ * stay valid, since a zone cannot be unlocked.
+ *
+ * \return status of the Read commands; the lock state is left as
+ *         it was found up to the first failing read
+ */
+uint8_t atsha204Class::memoRefresh()
+{
+	uint8_t command[READ_COUNT];
+	uint8_t response[READ_32_RSP_SIZE];
+	uint8_t lock_value, otp_mode, offset, i;
+	uint16_t slot_config, fixed_slots = 0;
+	uint8_t ret_code;
+
+	ret_code = sha204m_read(command, response, SHA204_ZONE_CONFIG, ADDRESS_LOCKVALUE & ~3);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	memo.state = 0;
+	memo.fixed_slots = 0;
+	if (response[SHA204_BUFFER_POS_DATA + (ADDRESS_LOCKCONFIG & 3)] != 0x00)
+		return SHA204_SUCCESS;
+	lock_value = response[SHA204_BUFFER_POS_DATA + (ADDRESS_LOCKVALUE & 3)];
+
+	// The first 32 bytes are fixed now, so this read fills the cache as well.
+	memo.state = SHA204_MEMO_CONFIG_LOCKED;
+	ret_code = sha204m_read(command, response, SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG, 0);
+	if (ret_code != SHA204_SUCCESS || lock_value != 0x00)
+		return ret_code;
+	otp_mode = response[SHA204_BUFFER_POS_DATA + ADDRESS_OTPMODE];
+
+	// Slots 0 to 5 are configured in the first block, slots 6 to 15 in the second.
+	for (i = 0; i <= SHA204_KEY_ID_MAX; i++) {
+		offset = (ADDRESS_SLOTCONFIG + 2 * i) % SHA204_ZONE_ACCESS_32;
+		if (i && !offset) {
+			ret_code = sha204m_read(command, response, SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG, SHA204_ZONE_ACCESS_32);
+			if (ret_code != SHA204_SUCCESS)
+				return ret_code;
+		}
+		slot_config = response[SHA204_BUFFER_POS_DATA + offset] | (response[SHA204_BUFFER_POS_DATA + offset + 1] << 8);
+		if (!(slot_config & (SHA204_SLOT_IS_SECRET | SHA204_SLOT_ENCRYPT_READ))
+				&& (slot_config & SHA204_SLOT_WRITE_CONFIG) == SHA204_SLOT_WRITE_NEVER)
+			fixed_slots |= 1 << i;
+	}
+
+	memo.fixed_slots = fixed_slots;
+	memo.state |= SHA204_MEMO_DATA_LOCKED;
+	if (otp_mode != SHA204_OTP_MODE_CONSUMPTION)
+		memo.state |= SHA204_MEMO_OTP_FIXED;
+	return SHA204_SUCCESS;
+}
+
+// Returns whether the response to a command packet can no longer change.
+uint8_t atsha204Class::sha204c_memo_cacheable(const uint8_t *tx_buffer)
+{
+	uint8_t zone = tx_buffer[READ_ZONE_IDX];
+	uint8_t address = tx_buffer[READ_ADDR_IDX];
+	uint8_t end;
+
+	if (tx_buffer[SHA204_COUNT_IDX] != SHA204_CMD_SIZE_MIN)
+		return 0;
+	if (tx_buffer[SHA204_OPCODE_IDX] == SHA204_DEVREV)
+		return 1;
+	if (tx_buffer[SHA204_OPCODE_IDX] != SHA204_READ || tx_buffer[READ_ADDR_IDX + 1])
+		return 0;
+
+	switch (zone & SHA204_ZONE_MASK) {
+	case SHA204_ZONE_CONFIG:
+		// The address counts words. A 32 byte read covers the block the word is in.
+		if (address > SHA204_ADDRESS_MASK_CONFIG)
+			return 0;
+		if (zone & SHA204_ZONE_COUNT_FLAG)
+			end = (address & ~7) * 4 + SHA204_ZONE_ACCESS_32;
+		else
+			end = address * 4 + SHA204_ZONE_ACCESS_4;
+		if (end <= SHA204_MEMO_IMMUTABLE_END)
+			return 1;
+		return (memo.state & SHA204_MEMO_CONFIG_LOCKED) && end <= SHA204_MEMO_CONFIG_END;
+
+	case SHA204_ZONE_OTP:
+		return (memo.state & (SHA204_MEMO_DATA_LOCKED | SHA204_MEMO_OTP_FIXED))
+				== (SHA204_MEMO_DATA_LOCKED | SHA204_MEMO_OTP_FIXED);
+
+	case SHA204_ZONE_DATA:
+		return (memo.state & SHA204_MEMO_DATA_LOCKED)
+				&& ((memo.fixed_slots >> ((address >> 3) & SHA204_KEY_ID_MAX)) & 1);
+	}
+	return 0;
+}
+
+/** \brief Answers a command from the cache.
+ *
+ * A hit moves the entry to the front, so the least recently used entry is
+ * the one dropped when a new response is stored.
+ *
+ * \return 1 if rx_buffer holds the cached response, 0 if the command has to be sent
+ */
+uint8_t atsha204Class::sha204c_memo_lookup(const uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer)
+{
+	sha204_memo_entry_t entry;
+	uint8_t i;
+
+	if (!sha204c_memo_cacheable(tx_buffer))
+		return 0;
+
+	for (i = 0; i < SHA204_MEMO_ENTRIES; i++)
+		if (!memcmp(memo_entries[i].command, tx_buffer, SHA204_MEMO_KEY_SIZE))
+			break;
+	if (i == SHA204_MEMO_ENTRIES || memo_entries[i].response[SHA204_BUFFER_POS_COUNT] > rx_size) {
+		memo.misses++;
+		return 0;
+	}
+
+	if (i) {
+		memcpy(&entry, &memo_entries[i], sizeof(entry));
+		memmove(&memo_entries[1], &memo_entries[0], i * sizeof(entry));
+		memcpy(&memo_entries[0], &entry, sizeof(entry));
+	}
+	memcpy(rx_buffer, memo_entries[0].response, memo_entries[0].response[SHA204_BUFFER_POS_COUNT]);
+	memo.hits++;
+
+	// A transaction expects its next packet to be assembled while this command runs.
+	if (prepare_step)
+		sha204c_execution_wait(0);
+	return 1;
+}
+
+/** \brief Stores the response to a cacheable command in front of the other entries.
+ *
+ * \param[in] ret_code return code of the command, passed through
+ * \return ret_code
+ */
+uint8_t atsha204Class::sha204c_memo_store(const uint8_t *tx_buffer, const uint8_t *rx_buffer, uint8_t ret_code)
+{
+	uint8_t count = rx_buffer[SHA204_BUFFER_POS_COUNT];
+
+	if (ret_code != SHA204_SUCCESS || count > SHA204_RSP_SIZE_MAX || !sha204c_memo_cacheable(tx_buffer))
+		return ret_code;
+
+	if (memo_entries[SHA204_MEMO_ENTRIES - 1].command[SHA204_COUNT_IDX])
+		memo.evictions++;
+	memmove(&memo_entries[1], &memo_entries[0], (SHA204_MEMO_ENTRIES - 1) * sizeof(sha204_memo_entry_t));
+	memcpy(memo_entries[0].command, tx_buffer, SHA204_MEMO_KEY_SIZE);
+	memcpy(memo_entries[0].response, rx_buffer, count);
+	return ret_code;
+}
+
+#endif
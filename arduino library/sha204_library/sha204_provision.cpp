@@ -0,0 +1,215 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+sha204Provisioner::sha204Provisioner(atsha204Class &device)
+{
+	this->device = &device;
+	result = NULL;
+	session_ms = 0;
+}
+
+/** \brief Brings the device into the state of an image.
+ *
+ * Wakes the device, reads the lock state and the configuration, writes what
+ * differs from the image, locks the zones the image asks for and puts the
+ * device to sleep. Running it again on a device it has finished does not write.
+ * Once the data zone is locked, slots and OTP are left as they are, since
+ * they can neither be written in clear nor, if secret, read to compare them.
+ * With SHA204_PROVISION_SUMMARIES the locks use the summaries of the image,
+ * for example compiled offline, and the image needs only what is still to write.
+ *
+ * \param[in] image   target state
+ * \param[out] result counters and time; may be NULL
+ * \return status of the operation; SHA204_FUNC_FAIL if the configuration zone
+ *         is locked with bytes that differ from the image
+ */
+uint8_t sha204Provisioner::provision(const sha204_image_t *image, sha204_provision_result_t *result)
+{
+	sha204_provision_result_t local_result;
+	uint8_t response[READ_4_RSP_SIZE];
+	uint8_t lock_word[SHA204_ZONE_ACCESS_4];
+	uint8_t config_head[SHA204_PROVISION_CONFIG_START];
+	uint8_t config_locked = 0, data_locked = 0;
+	uint8_t slot, address, ret_code;
+	uint16_t crc;
+	unsigned long start_us;
+
+	if (!result)
+		result = &local_result;
+	memset(result, 0, sizeof(*result));
+	this->result = result;
+
+	// With precomputed summaries the image may leave out what an earlier step wrote.
+	if (!image || ((image->lock & (SHA204_PROVISION_LOCK_CONFIG | SHA204_PROVISION_SUMMARIES)) == SHA204_PROVISION_LOCK_CONFIG
+				&& !image->config)
+			|| ((image->lock & (SHA204_PROVISION_LOCK_DATA | SHA204_PROVISION_SUMMARIES)) == SHA204_PROVISION_LOCK_DATA
+				&& (!image->data || !image->otp))
+			|| (image->slots && !image->data)) {
+		result->ret_code = SHA204_BAD_PARAM;
+		return SHA204_BAD_PARAM;
+	}
+
+	start_us = micros();
+	session_ms = millis();
+	ret_code = device->sha204c_wakeup(response);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = read(SHA204_ZONE_CONFIG, ADDRESS_LOCKVALUE & ~3, response);
+	if (ret_code == SHA204_SUCCESS) {
+		memcpy(lock_word, &response[SHA204_BUFFER_POS_DATA], sizeof(lock_word));
+		config_locked = lock_word[ADDRESS_LOCKCONFIG & 3] == 0x00;
+		data_locked = lock_word[ADDRESS_LOCKVALUE & 3] == 0x00;
+		if (image->config)
+			ret_code = configure(image, config_head, config_locked);
+	}
+
+	// The summary covers the serial number and the lock word as read and the
+	// rest of the zone as the image has it.
+	if (ret_code == SHA204_SUCCESS && (image->lock & SHA204_PROVISION_LOCK_CONFIG) && !config_locked) {
+		if (image->lock & SHA204_PROVISION_SUMMARIES)
+			crc = image->config_summary;
+		else {
+			crc = atsha204Class::sha204c_update_crc(sizeof(config_head), config_head, 0);
+			crc = atsha204Class::sha204c_update_crc(SHA204_PROVISION_CONFIG_SIZE, image->config, crc);
+			crc = atsha204Class::sha204c_update_crc(sizeof(lock_word), lock_word, crc);
+		}
+		ret_code = lock(SHA204_ZONE_CONFIG, crc);
+	}
+
+	if (!data_locked) {
+		for (slot = 0; slot < SHA204_PROVISION_SLOT_COUNT && ret_code == SHA204_SUCCESS; slot++)
+			if (image->slots & (1 << slot))
+				ret_code = write(SHA204_ZONE_DATA | SHA204_ZONE_COUNT_FLAG, slot * SHA204_ZONE_ACCESS_32,
+						&image->data[slot * SHA204_ZONE_ACCESS_32]);
+		for (address = 0; image->otp && address < SHA204_PROVISION_OTP_SIZE && ret_code == SHA204_SUCCESS;
+				address += SHA204_ZONE_ACCESS_32)
+			ret_code = write(SHA204_ZONE_OTP | SHA204_ZONE_COUNT_FLAG, address, &image->otp[address]);
+
+		// The summary of the data zone is the CRC of all slots followed by the OTP zone.
+		if (ret_code == SHA204_SUCCESS && (image->lock & SHA204_PROVISION_LOCK_DATA)) {
+			if (image->lock & SHA204_PROVISION_SUMMARIES)
+				crc = image->data_summary;
+			else {
+				crc = 0;
+				for (slot = 0; slot < SHA204_PROVISION_SLOT_COUNT; slot++)
+					crc = atsha204Class::sha204c_update_crc(SHA204_ZONE_ACCESS_32, &image->data[slot * SHA204_ZONE_ACCESS_32], crc);
+				for (address = 0; address < SHA204_PROVISION_OTP_SIZE; address += SHA204_ZONE_ACCESS_32)
+					crc = atsha204Class::sha204c_update_crc(SHA204_ZONE_ACCESS_32, &image->otp[address], crc);
+			}
+			ret_code = lock(LOCK_ZONE_NO_CONFIG, crc);
+		}
+	}
+
+	result->total_us = micros() - start_us;
+	device->sha204p_sleep();
+	result->ret_code = ret_code;
+	return ret_code;
+}
+
+void sha204Provisioner::printResult(Print &out, const sha204_provision_result_t *result)
+{
+	if (result->ret_code == SHA204_SUCCESS)
+		out.print("provisioned in ");
+	else {
+		out.print("error 0x");
+		out.print(result->ret_code, HEX);
+		out.print(" after ");
+	}
+	out.print(result->total_us / 1000);
+	out.print(" ms: reads ");     out.print(result->reads);
+	out.print(", writes ");       out.print(result->writes);
+	out.print(", unchanged ");    out.print(result->unchanged);
+	out.print(" words, locks ");  out.println(result->locks);
+}
+
+// Compares the configuration with the image and writes what differs: words of
+// blocks 0 and 2 one by one, the slot configurations in block 1 as a whole.
+// Bytes 0 to 15 are copied to config_head for the lock summary.
+uint8_t sha204Provisioner::configure(const sha204_image_t *image, uint8_t *config_head, uint8_t config_locked)
+{
+	uint8_t response[READ_32_RSP_SIZE];
+	const uint8_t *target, *current;
+	uint8_t address, size, ret_code = SHA204_SUCCESS;
+
+	for (address = 0; address < SHA204_PROVISION_CONFIG_END && ret_code == SHA204_SUCCESS; ) {
+		size = (address < 2 * SHA204_ZONE_ACCESS_32) ? SHA204_ZONE_ACCESS_32 : SHA204_ZONE_ACCESS_4;
+		ret_code = read(size == SHA204_ZONE_ACCESS_32 ? (SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG) : SHA204_ZONE_CONFIG,
+				address, response);
+		if (ret_code != SHA204_SUCCESS)
+			break;
+
+		if (address == 0) {
+			memcpy(config_head, &response[SHA204_BUFFER_POS_DATA], SHA204_PROVISION_CONFIG_START);
+			current = &response[SHA204_BUFFER_POS_DATA + SHA204_PROVISION_CONFIG_START];
+			target = image->config;
+			// Bytes 0 to 15 cannot be written, so the rest of block 0 goes word by word.
+			for (address = SHA204_PROVISION_CONFIG_START; address < SHA204_ZONE_ACCESS_32 && ret_code == SHA204_SUCCESS;
+					address += SHA204_ZONE_ACCESS_4, current += SHA204_ZONE_ACCESS_4, target += SHA204_ZONE_ACCESS_4) {
+				if (!memcmp(current, target, SHA204_ZONE_ACCESS_4))
+					result->unchanged++;
+				else
+					ret_code = config_locked ? SHA204_FUNC_FAIL : write(SHA204_ZONE_CONFIG, address, target);
+			}
+			continue;
+		}
+
+		current = &response[SHA204_BUFFER_POS_DATA];
+		target = &image->config[address - SHA204_PROVISION_CONFIG_START];
+		if (!memcmp(current, target, size))
+			result->unchanged += size / SHA204_ZONE_ACCESS_4;
+		else if (config_locked)
+			ret_code = SHA204_FUNC_FAIL;
+		else
+			ret_code = write(size == SHA204_ZONE_ACCESS_32 ? (SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG) : SHA204_ZONE_CONFIG,
+					address, target);
+		address += size;
+	}
+	return ret_code;
+}
+
+// Puts the device to sleep and wakes it again before its watchdog would.
+uint8_t sha204Provisioner::renew()
+{
+	uint8_t response[SHA204_RSP_SIZE_MIN];
+
+	if (millis() - session_ms < SHA204_STREAM_SESSION_MAX)
+		return SHA204_SUCCESS;
+	device->sha204p_sleep();
+	session_ms = millis();
+	return device->sha204c_wakeup(response);
+}
+
+uint8_t sha204Provisioner::read(uint8_t zone, uint16_t address, uint8_t *response)
+{
+	uint8_t command[READ_COUNT];
+	uint8_t ret_code = renew();
+
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	result->reads++;
+	return device->sha204m_read(command, response, zone, address);
+}
+
+uint8_t sha204Provisioner::write(uint8_t zone, uint16_t address, const uint8_t *data)
+{
+	uint8_t command[WRITE_COUNT_LONG];
+	uint8_t response[WRITE_RSP_SIZE];
+	uint8_t ret_code = renew();
+
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	result->writes++;
+	return device->sha204m_write(command, response, zone, address, (uint8_t *) data, NULL);
+}
+
+uint8_t sha204Provisioner::lock(uint8_t zone, uint16_t summary)
+{
+	uint8_t command[LOCK_COUNT];
+	uint8_t response[LOCK_RSP_SIZE];
+	uint8_t ret_code = renew();
+
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	result->locks++;
+	return device->sha204m_lock(command, response, zone, summary);
+}
@@ -0,0 +1,230 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+// Returns 1 if a step of the job uses TempKey before a Nonce of the job has loaded
+// it, so that the job depends on the TempKey an earlier job of its owner kept.
+static uint8_t sha204_sched_needs_tempkey(const sha204_job_t *job)
+{
+	uint8_t i;
+
+	for (i = 0; i < job->step_count; i++)
+	{
+		const sha204_auth_step_t *step = &job->steps[i];
+
+		switch (step->op_code)
+		{
+		case SHA204_NONCE:
+			return 0;
+		case SHA204_GENDIG:
+		case SHA204_DERIVE_KEY:
+		case SHA204_HMAC:
+			return 1;
+		case SHA204_MAC:
+			if (step->param1 & (MAC_MODE_BLOCK1_TEMPKEY | MAC_MODE_BLOCK2_TEMPKEY))
+				return 1;
+			break;
+		case SHA204_CHECKMAC:
+			if (step->param1 & (CHECKMAC_MODE_BLOCK1_TEMPKEY | CHECKMAC_MODE_BLOCK2_TEMPKEY))
+				return 1;
+			break;
+		case SHA204_WRITE:
+			if (step->param1 & WRITE_ZONE_WITH_MAC)
+				return 1;
+			break;
+		}
+	}
+	return 0;
+}
+
+sha204Scheduler::sha204Scheduler(atsha204Class &device)
+{
+	this->device = &device;
+	queued = 0;
+	holder = SHA204_SCHED_NONE;
+	held_at = 0;
+	resetStats();
+}
+
+/** \brief Queues a job.
+ *
+ * \param[in] job the job; it must stay valid and unchanged until it is done or cancelled
+ * \return SHA204_SUCCESS, SHA204_BAD_PARAM, or SHA204_FUNC_FAIL if the queue is full
+ */
+uint8_t sha204Scheduler::submit(sha204_job_t *job)
+{
+	if (!job || !job->steps || !job->step_count || job->step_count > SHA204_AUTH_STEPS_MAX
+			|| job->priority >= SHA204_SCHED_CLASSES || job->owner == SHA204_SCHED_NONE
+			|| job->state == SHA204_JOB_QUEUED)
+		return SHA204_BAD_PARAM;
+	if (queued == SHA204_SCHED_QUEUE)
+		return SHA204_FUNC_FAIL;
+
+	job->state = SHA204_JOB_QUEUED;
+	job->submitted = millis();
+	job->result.ret_code = SHA204_FUNC_FAIL;
+	job->result.steps_done = 0;
+	job->result.status = 0;
+	queue[queued++] = job;
+	return SHA204_SUCCESS;
+}
+
+/** \brief Removes a job that has not run yet. Its done callback is not called.
+ *
+ * \return SHA204_SUCCESS, or SHA204_FUNC_FAIL if the job is not queued
+ */
+uint8_t sha204Scheduler::cancel(sha204_job_t *job)
+{
+	uint8_t i;
+
+	for (i = 0; i < queued; i++)
+	{
+		if (queue[i] == job)
+		{
+			take(i);
+			return SHA204_SUCCESS;
+		}
+	}
+	return SHA204_FUNC_FAIL;
+}
+
+/** \brief Drops jobs that missed their deadline, then runs the next job.
+ *
+ * Call it from loop(). It blocks for one transaction at most, so a job of high
+ * priority waits for at most one job that is already running, or for the TempKey
+ * of another owner to be released or to time out.
+ *
+ * \return SHA204_SUCCESS if no job ran, otherwise the return code of the job
+ */
+uint8_t sha204Scheduler::poll()
+{
+	unsigned long now = millis();
+	sha204_job_t *job;
+	uint16_t wait;
+	uint8_t i, ret_code;
+
+	if (holder != SHA204_SCHED_NONE && now - held_at > SHA204_SCHED_HOLD_TIMEOUT)
+		holder = SHA204_SCHED_NONE;
+
+	for (i = 0; i < queued; )
+	{
+		job = queue[i];
+		if (job->deadline && now - job->submitted > job->deadline)
+		{
+			take(i);
+			stats[job->priority].expired++;
+			job->result.ret_code = SHA204_DEADLINE;
+			finish(job);
+		}
+		else
+			i++;
+	}
+
+	i = next();
+	if (i == SHA204_SCHED_NONE)
+		return SHA204_SUCCESS;
+	job = take(i);
+
+	wait = now - job->submitted > 0xFFFF ? 0xFFFF : (uint16_t) (now - job->submitted);
+	stats[job->priority].runs++;
+	stats[job->priority].wait_total += wait;
+	if (wait > stats[job->priority].wait_max)
+		stats[job->priority].wait_max = wait;
+
+	if (holder != job->owner && sha204_sched_needs_tempkey(job))
+	{
+		// The TempKey this job builds on has been lost or belongs to someone else.
+		ret_code = job->result.ret_code = SHA204_FUNC_FAIL;
+	}
+	else
+	{
+		ret_code = device->authenticate(job->steps, job->step_count, &job->result, job->flags & SHA204_JOB_KEEP_TEMPKEY);
+		holder = SHA204_SCHED_NONE;
+		if (ret_code == SHA204_SUCCESS && (job->flags & SHA204_JOB_KEEP_TEMPKEY))
+		{
+			holder = job->owner;
+			held_at = millis();
+		}
+	}
+	if (ret_code != SHA204_SUCCESS)
+		stats[job->priority].failed++;
+	finish(job);
+	return ret_code;
+}
+
+// Returns the number of queued jobs.
+uint8_t sha204Scheduler::pending()
+{
+	return queued;
+}
+
+// Returns the index of the job to run next, or SHA204_SCHED_NONE.
+uint8_t sha204Scheduler::next()
+{
+	unsigned long now = millis();
+	unsigned long left, best_left = 0;
+	uint8_t i, best = SHA204_SCHED_NONE;
+
+	for (i = 0; i < queued; i++)
+	{
+		sha204_job_t *job = queue[i];
+
+		if (holder != SHA204_SCHED_NONE && job->owner != holder)
+			continue;
+		left = job->deadline ? job->deadline - (now - job->submitted) : (unsigned long) -1;
+		if (best == SHA204_SCHED_NONE || job->priority < queue[best]->priority
+				|| (job->priority == queue[best]->priority && left < best_left))
+		{
+			best = i;
+			best_left = left;
+		}
+	}
+	return best;
+}
+
+// Removes a job from the queue.
+sha204_job_t *sha204Scheduler::take(uint8_t index)
+{
+	sha204_job_t *job = queue[index];
+
+	queued--;
+	for (; index < queued; index++)
+		queue[index] = queue[index + 1];
+	job->state = SHA204_JOB_FREE;
+	return job;
+}
+
+void sha204Scheduler::finish(sha204_job_t *job)
+{
+	if (job->done)
+		job->done(job, job->context);
+}
+
+const sha204_sched_stats_t *sha204Scheduler::getStats(uint8_t priority)
+{
+	return priority < SHA204_SCHED_CLASSES ? &stats[priority] : NULL;
+}
+
+void sha204Scheduler::resetStats()
+{
+	memset(stats, 0, sizeof(stats));
+}
+
+/** \brief Prints the counters and the queueing delay of every priority class.
+ */
+void sha204Scheduler::printStats(Print &out)
+{
+	uint8_t priority;
+
+	for (priority = 0; priority < SHA204_SCHED_CLASSES; priority++) {
+		const sha204_sched_stats_t *s = &stats[priority];
+
+		out.print("priority ");       out.print(priority);
+		out.print(": runs ");         out.print(s->runs);
+		out.print(", failed ");       out.print(s->failed);
+		out.print(", expired ");      out.print(s->expired);
+		out.print(", wait avg ");     out.print(s->runs ? s->wait_total / s->runs : 0);
+		out.print(" ms, max ");       out.print(s->wait_max);
+		out.println(" ms");
+	}
+}
@@ -0,0 +1,131 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+/* SHA-256 in software, for digests the device signs or compares
+
+   The message schedule is kept as a ring of 16 words, so the hash takes
+   about 170 bytes of RAM. On AVR the round constants stay in flash. */
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define SHA256_K(i)  pgm_read_dword(&sha204_sha256_k[i])
+#else
+#if !defined(PROGMEM)
+#define PROGMEM
+#endif
+#define SHA256_K(i)  (sha204_sha256_k[i])
+#endif
+
+#define ROTR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t sha204_sha256_k[64] PROGMEM = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+sha204Sha256::sha204Sha256()
+{
+	init();
+}
+
+// Starts a new digest.
+void sha204Sha256::init()
+{
+	state[0] = 0x6a09e667;
+	state[1] = 0xbb67ae85;
+	state[2] = 0x3c6ef372;
+	state[3] = 0xa54ff53a;
+	state[4] = 0x510e527f;
+	state[5] = 0x9b05688c;
+	state[6] = 0x1f83d9ab;
+	state[7] = 0x5be0cd19;
+	length = 0;
+}
+
+// Hashes the 64 bytes in block.
+void sha204Sha256::compress()
+{
+	uint32_t w[16];
+	uint32_t a, b, c, d, e, f, g, h, t1, t2;
+	uint8_t i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = (uint32_t) block[4 * i] << 24 | (uint32_t) block[4 * i + 1] << 16
+				| (uint32_t) block[4 * i + 2] << 8 | block[4 * i + 3];
+
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+	for (i = 0; i < 64; i++)
+	{
+		if (i >= 16)
+		{
+			uint32_t w15 = w[(i + 1) & 15], w2 = w[(i + 14) & 15];
+
+			w[i & 15] += (ROTR(w15, 7) ^ ROTR(w15, 18) ^ (w15 >> 3)) + w[(i + 9) & 15]
+					+ (ROTR(w2, 17) ^ ROTR(w2, 19) ^ (w2 >> 10));
+		}
+		t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K(i) + w[i & 15];
+		t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+// Adds bytes to the message.
+void sha204Sha256::update(const uint8_t *data, uint16_t count)
+{
+	uint8_t used = length & 63;
+
+	length += count;
+	while (count)
+	{
+		uint8_t n = 64 - used;
+
+		if (count < n)
+			n = count;
+		memcpy(&block[used], data, n);
+		data += n;
+		count -= n;
+		used += n;
+		if (used == 64)
+		{
+			compress();
+			used = 0;
+		}
+	}
+}
+
+// Pads the message and writes the 32-byte digest. Call init() before hashing again.
+void sha204Sha256::finish(uint8_t *digest)
+{
+	uint8_t used = length & 63;
+	uint32_t bits_high = length >> 29, bits_low = length << 3;
+	uint8_t i;
+
+	block[used++] = 0x80;
+	if (used > 56)
+	{
+		memset(&block[used], 0, 64 - used);
+		compress();
+		used = 0;
+	}
+	memset(&block[used], 0, 56 - used);
+	for (i = 0; i < 4; i++)
+	{
+		block[56 + i] = (uint8_t) (bits_high >> (24 - 8 * i));
+		block[60 + i] = (uint8_t) (bits_low >> (24 - 8 * i));
+	}
+	compress();
+
+	for (i = 0; i < 32; i++)
+		digest[i] = (uint8_t) (state[i >> 2] >> (24 - 8 * (i & 3)));
+}
@@ -0,0 +1,140 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#if defined(SHA204_STATS)
+
+// Op-codes in the order of their latency histograms. Unknown op-codes use the last histogram.
+static const uint8_t sha204_stats_opcodes[SHA204_STATS_OPCODES - 1] =
+{
+	SHA204_CHECKMAC, SHA204_DERIVE_KEY, SHA204_DEVREV, SHA204_GENDIG, SHA204_HMAC,
+	SHA204_LOCK, SHA204_MAC, SHA204_NONCE, SHA204_PAUSE, SHA204_RANDOM,
+	SHA204_READ, SHA204_UPDATE_EXTRA, SHA204_WRITE
+};
+
+static uint8_t sha204_stats_opcode_index(uint8_t op_code)
+{
+	uint8_t i;
+
+	for (i = 0; i < sizeof(sha204_stats_opcodes); i++)
+		if (sha204_stats_opcodes[i] == op_code)
+			break;
+	return i;
+}
+
+static void sha204_stats_write_u16(Print &out, uint16_t value)
+{
+	out.write((uint8_t) (value & 0xFF));
+	out.write((uint8_t) (value >> 8));
+}
+
+/** \brief Adds the duration of one sha204c_send_and_receive call to the histogram of its op-code.
+ *
+ * \param[in] op_code  op-code of the command
+ * \param[in] start_us micros() when the call started
+ * \param[in] ret_code return code of the call, passed through
+ * \return ret_code
+ */
+uint8_t atsha204Class::sha204c_stats_record(uint8_t op_code, unsigned long start_us, uint8_t ret_code)
+{
+	// Shifting by 10 divides by 1024, close enough to milliseconds for a log scale.
+	unsigned long elapsed_ms = (micros() - start_us) >> 10;
+	uint8_t bucket = 0;
+
+	while (elapsed_ms && bucket < SHA204_STATS_BUCKETS - 1) {
+		elapsed_ms >>= 1;
+		bucket++;
+	}
+	stats.latency[sha204_stats_opcode_index(op_code)][bucket]++;
+
+	return ret_code;
+}
+
+const sha204_stats_t *atsha204Class::getStats()
+{
+	return &stats;
+}
+
+void atsha204Class::resetStats()
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+/** \brief Writes the statistics in a compact binary format.
+ *
+ * Layout, all values little-endian:
+ * version (1 byte), sends, retries, resyncs, wakeups, bad_crc, no_response,
+ * status_errors (2 bytes each), number of histograms that follow (1 byte),
+ * then for every op-code with at least one sample: op-code (1 byte, 0xFF for
+ * unknown op-codes) and SHA204_STATS_BUCKETS counts (2 bytes each).
+ */
+void atsha204Class::dumpStats(Print &out)
+{
+	uint8_t op, bucket, used = 0;
+	uint16_t any_sample[SHA204_STATS_OPCODES];
+
+	for (op = 0; op < SHA204_STATS_OPCODES; op++) {
+		any_sample[op] = 0;
+		for (bucket = 0; bucket < SHA204_STATS_BUCKETS; bucket++)
+			any_sample[op] |= stats.latency[op][bucket];
+		if (any_sample[op])
+			used++;
+	}
+
+	out.write(SHA204_STATS_DUMP_VERSION);
+	sha204_stats_write_u16(out, stats.sends);
+	sha204_stats_write_u16(out, stats.retries);
+	sha204_stats_write_u16(out, stats.resyncs);
+	sha204_stats_write_u16(out, stats.wakeups);
+	sha204_stats_write_u16(out, stats.bad_crc);
+	sha204_stats_write_u16(out, stats.no_response);
+	sha204_stats_write_u16(out, stats.status_errors);
+	out.write(used);
+
+	for (op = 0; op < SHA204_STATS_OPCODES; op++) {
+		if (!any_sample[op])
+			continue;
+		out.write(op < sizeof(sha204_stats_opcodes) ? sha204_stats_opcodes[op] : (uint8_t) 0xFF);
+		for (bucket = 0; bucket < SHA204_STATS_BUCKETS; bucket++)
+			sha204_stats_write_u16(out, stats.latency[op][bucket]);
+	}
+}
+
+/** \brief Prints the statistics as text, one histogram line per op-code that was used.
+ */
+void atsha204Class::printStats(Print &out)
+{
+	uint8_t op, bucket;
+
+	out.print("sends: ");          out.println(stats.sends);
+	out.print("retries: ");        out.println(stats.retries);
+	out.print("resyncs: ");        out.println(stats.resyncs);
+	out.print("wakeups: ");        out.println(stats.wakeups);
+	out.print("bad CRC: ");        out.println(stats.bad_crc);
+	out.print("no response: ");    out.println(stats.no_response);
+	out.print("status errors: ");  out.println(stats.status_errors);
+
+	for (op = 0; op < SHA204_STATS_OPCODES; op++) {
+		uint16_t any_sample = 0;
+		for (bucket = 0; bucket < SHA204_STATS_BUCKETS; bucket++)
+			any_sample |= stats.latency[op][bucket];
+		if (!any_sample)
+			continue;
+
+		out.print("op-code ");
+		if (op < sizeof(sha204_stats_opcodes))
+			out.print(sha204_stats_opcodes[op], HEX);
+		else
+			out.print("other");
+		out.print(':');
+		for (bucket = 0; bucket < SHA204_STATS_BUCKETS; bucket++) {
+			out.print(bucket ? " >=" : " <");
+			out.print(bucket ? (1U << (bucket - 1)) : 1U);
+			out.print("ms:");
+			out.print(stats.latency[op][bucket]);
+		}
+		out.println();
+	}
+}
+
+#endif
@@ -0,0 +1,92 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+/** \brief Reads a range of a zone and hands it to a sink one response at a time.
+ *
+ * The device is woken, read with 32-byte reads where the range covers whole
+ * blocks and with 4-byte reads elsewhere, and put to sleep at the end. A
+ * session that takes longer than SHA204_STREAM_SESSION_MAX ms, for example
+ * because the sink writes to a slow file, is renewed with a sleep and a wake-up
+ * between two reads. The data and OTP zones can be read only once they are locked.
+ *
+ * \param[in] zone    SHA204_ZONE_CONFIG, SHA204_ZONE_OTP or SHA204_ZONE_DATA
+ * \param[in] address byte address of the first word, a multiple of 4
+ * \param[in] length  number of bytes, a multiple of 4
+ * \param[in] sink    called with the data of every response; returns non-zero to stop
+ * \param[in] context passed to the sink
+ * \param[out] result counters and throughput; may be NULL
+ * \return status of the operation; SHA204_SUCCESS also if the sink stopped the read
+ */
+uint8_t atsha204Class::readZone(uint8_t zone, uint16_t address, uint16_t length, sha204_zone_sink_t sink, void *context,
+		sha204_stream_result_t *result)
+{
+	sha204_stream_result_t local_result;
+	uint8_t command[READ_COUNT];
+	uint8_t response[READ_32_RSP_SIZE];
+	uint32_t end = (uint32_t) address + length;
+	uint16_t size;
+	uint8_t chunk, ret_code;
+	unsigned long start_us, session_ms;
+
+	if (!result)
+		result = &local_result;
+	memset(result, 0, sizeof(*result));
+
+	if (zone == SHA204_ZONE_CONFIG)
+		size = SHA204_CONFIG_SIZE;
+	else if (zone == SHA204_ZONE_OTP)
+		size = (SHA204_OTP_BLOCK_MAX + 1) * SHA204_ZONE_ACCESS_32;
+	else if (zone == SHA204_ZONE_DATA)
+		size = (SHA204_KEY_ID_MAX + 1) * SHA204_ZONE_ACCESS_32;
+	else
+		size = 0;
+	if (!sink || !size || address % SHA204_ZONE_ACCESS_4 || length % SHA204_ZONE_ACCESS_4 || end > size) {
+		result->ret_code = SHA204_BAD_PARAM;
+		return SHA204_BAD_PARAM;
+	}
+	if (!length)
+		return SHA204_SUCCESS;
+
+	// Only zone and address change from one read to the next.
+	command[SHA204_COUNT_IDX] = READ_COUNT;
+	command[SHA204_OPCODE_IDX] = SHA204_READ;
+	command[READ_ADDR_IDX + 1] = 0;
+
+	start_us = micros();
+	session_ms = millis();
+	ret_code = sha204c_wakeup(response);
+	while (ret_code == SHA204_SUCCESS && address < end) {
+		if (millis() - session_ms >= SHA204_STREAM_SESSION_MAX) {
+			sha204p_sleep();
+			ret_code = sha204c_wakeup(response);
+			session_ms = millis();
+			if (ret_code != SHA204_SUCCESS)
+				break;
+		}
+
+		chunk = (address % SHA204_ZONE_ACCESS_32 == 0 && end - address >= SHA204_ZONE_ACCESS_32)
+				? SHA204_ZONE_ACCESS_32 : SHA204_ZONE_ACCESS_4;
+		command[READ_ZONE_IDX] = (chunk == SHA204_ZONE_ACCESS_32) ? (zone | SHA204_ZONE_COUNT_FLAG) : zone;
+		command[READ_ADDR_IDX] = (uint8_t) (address >> 2);
+		ret_code = sha204c_send_and_receive(command, (chunk == SHA204_ZONE_ACCESS_32) ? READ_32_RSP_SIZE : READ_4_RSP_SIZE,
+				response, READ_DELAY, READ_EXEC_MAX - READ_DELAY);
+		result->reads++;
+		if (ret_code != SHA204_SUCCESS)
+			break;
+
+		result->bytes += chunk;
+		if (sink(context, address, &response[SHA204_BUFFER_POS_DATA], chunk)) {
+			result->stopped = 1;
+			break;
+		}
+		address += chunk;
+	}
+	result->total_us = micros() - start_us;
+	sha204p_sleep();
+
+	if (result->total_us)
+		result->bytes_per_s = (uint16_t) ((uint32_t) result->bytes * 1000000UL / result->total_us);
+	result->ret_code = ret_code;
+	return ret_code;
+}
@@ -0,0 +1,258 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#if defined(SHA204_SWI_ARM)
+
+#if defined(SHA204_SWI_ICP) || defined(SHA204_SWI_SPI_TX)
+#error "SHA204_SWI_ICP and SHA204_SWI_SPI_TX are AVR only."
+#endif
+#if !defined(DWT) || !defined(CoreDebug)
+#error "The ARM SWI backend needs the DWT cycle counter of a Cortex-M3 or above."
+#endif
+
+/* SWI bit bang functions for 32-bit ARM cores
+
+   The pin is driven through set and clear registers, so no read-modify-write
+   cycle is ever needed. Pulse widths and timeouts are absolute deadlines on
+   the DWT cycle counter, which keeps the timing independent of CPU clock and
+   code generation. */
+
+#define SWI_PIN_HIGH()    (*device_port_SET = device_pin)
+#define SWI_PIN_LOW()     (*device_port_CLR = device_pin_clear)
+#define SWI_PIN_IS_HIGH() ((*device_port_IN & device_pin) != 0)
+#define SWI_PIN_OUTPUT()  do { if (device_port_DIRSET) *device_port_DIRSET = device_pin; } while (0)
+#define SWI_PIN_INPUT()   do { if (device_port_DIRCLR) *device_port_DIRCLR = device_pin; } while (0)
+
+#define SWI_CYCLES()                 (DWT->CYCCNT)
+#define SWI_EXPIRED(deadline)        ((int32_t) (SWI_CYCLES() - (deadline)) >= 0)
+
+static inline void swi_wait_until(uint32_t deadline)
+{
+  while (!SWI_EXPIRED(deadline))
+    ;
+}
+
+// atsha204Class Constructor
+// Feed this function the Arduino-ized pin number you want to assign to the ATSHA204's SDA pin
+// This will find the set, clear, input and direction registers it'll need to control that pin
+atsha204Class::atsha204Class(uint8_t pin)
+{
+	device_pin_number = pin;
+	device_pin_ready = 0;
+	device_port_DIRSET = device_port_DIRCLR = NULL;
+
+#if defined(ARDUINO_ARCH_SAM)
+	Pio *port = g_APinDescription[pin].pPort;
+	device_pin = device_pin_clear = g_APinDescription[pin].ulPin;
+	device_port_SET = &port->PIO_SODR;
+	device_port_CLR = &port->PIO_CODR;
+	device_port_IN = &port->PIO_PDSR;
+	device_port_DIRSET = &port->PIO_OER;
+	device_port_DIRCLR = &port->PIO_ODR;
+#elif defined(ARDUINO_ARCH_SAMD)
+	PortGroup *port = &PORT->Group[g_APinDescription[pin].ulPort];
+	device_pin = device_pin_clear = 1ul << g_APinDescription[pin].ulPin;
+	device_port_SET = &port->OUTSET.reg;
+	device_port_CLR = &port->OUTCLR.reg;
+	device_port_IN = &port->IN.reg;
+	device_port_DIRSET = &port->DIRSET.reg;
+	device_port_DIRCLR = &port->DIRCLR.reg;
+#elif defined(ARDUINO_ARCH_STM32)
+	// The pin is used in open-drain mode, so BSRR alone drives and releases it.
+	PinName pin_name = digitalPinToPinName(pin);
+	GPIO_TypeDef *port = get_GPIO_Port(STM_PORT(pin_name));
+	device_pin = STM_GPIO_PIN(pin_name);
+	device_pin_clear = device_pin << 16;
+	device_port_SET = &port->BSRR;
+	device_port_CLR = &port->BSRR;
+	device_port_IN = &port->IDR;
+#else
+#error "The ARM SWI backend does not support this core."
+#endif
+
+	init();
+}
+
+// Pin modes and the cycle counter are set up on first use because
+// global constructors run before the core has initialized the hardware.
+void atsha204Class::swi_init_pin()
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+#if defined(ARDUINO_ARCH_STM32)
+	pinMode(device_pin_number, OUTPUT_OPEN_DRAIN);
+	SWI_PIN_HIGH();
+#else
+	pinMode(device_pin_number, INPUT);
+#endif
+	device_pin_ready = 1;
+}
+
+void atsha204Class::swi_set_signal_pin(uint8_t is_high)
+{
+  if (!device_pin_ready)
+    swi_init_pin();
+
+  if (is_high)
+    SWI_PIN_HIGH();
+  else
+    SWI_PIN_LOW();
+  SWI_PIN_OUTPUT();
+}
+
+uint8_t atsha204Class::swi_send_bytes(uint8_t count, uint8_t *buffer)
+{
+  uint8_t i, bit_mask;
+  uint32_t deadline;
+
+  if (!device_pin_ready)
+    swi_init_pin();
+
+  // Disable interrupts while sending.
+  noInterrupts();
+  SHA204_TRACE_BEGIN(SHA204_TRACE_MASK);
+
+  // Set signal pin as output.
+  SWI_PIN_HIGH();
+  SWI_PIN_OUTPUT();
+
+  // Wait turn around time.
+  SHA204_TRACE_BEGIN(SHA204_TRACE_TURNAROUND);
+  deadline = SWI_CYCLES() + RX_TX_DELAY * SWI_ARM_CYCLES_PER_US;
+  swi_wait_until(deadline);
+  SHA204_TRACE_FINISH(SHA204_TRACE_TURNAROUND);
+  deadline = SWI_CYCLES();
+
+  for (i = 0; i < count; i++)
+  {
+    for (bit_mask = 1; bit_mask > 0; bit_mask <<= 1)
+    {
+      SWI_PIN_LOW();
+      deadline += SWI_ARM_PULSE_CYCLES;
+      swi_wait_until(deadline);
+      SWI_PIN_HIGH();
+      if (bit_mask & buffer[i])
+      {
+        deadline += 7 * SWI_ARM_PULSE_CYCLES;
+        swi_wait_until(deadline);
+      }
+      else
+      {
+        // Send a zero bit.
+        deadline += SWI_ARM_PULSE_CYCLES;
+        swi_wait_until(deadline);
+        SWI_PIN_LOW();
+        deadline += SWI_ARM_PULSE_CYCLES;
+        swi_wait_until(deadline);
+        SWI_PIN_HIGH();
+        deadline += 5 * SWI_ARM_PULSE_CYCLES;
+        swi_wait_until(deadline);
+      }
+    }
+  }
+  SHA204_TRACE_FINISH(SHA204_TRACE_MASK);
+  interrupts();
+  return SWI_FUNCTION_RETCODE_SUCCESS;
+}
+
+uint8_t atsha204Class::swi_receive_bytes(uint8_t count, uint8_t *buffer)
+{
+  uint8_t status = SWI_FUNCTION_RETCODE_SUCCESS;
+  uint8_t i;
+  uint8_t bit_mask;
+  uint8_t is_zero;
+  uint32_t start;
+  uint32_t deadline;
+
+  if (!device_pin_ready)
+    swi_init_pin();
+
+  // Disable interrupts while receiving.
+  noInterrupts();
+  SHA204_TRACE_BEGIN(SHA204_TRACE_MASK);
+
+  // Configure signal pin as input. An open-drain pin was left released by the sender.
+  SWI_PIN_INPUT();
+
+  // Receive bits and store in buffer.
+  for (i = 0; i < count; i++)
+  {
+    for (bit_mask = 1; bit_mask > 0; bit_mask <<= 1)
+    {
+      // Detect start bit.
+      deadline = SWI_CYCLES() + SWI_ARM_START_TIMEOUT;
+      while (SWI_PIN_IS_HIGH())
+      {
+        if (SWI_EXPIRED(deadline))
+        {
+          status = SWI_FUNCTION_RETCODE_TIMEOUT;
+          break;
+        }
+      }
+      if (status != SWI_FUNCTION_RETCODE_SUCCESS)
+        break;
+      start = SWI_CYCLES();
+
+      // Wait for rising edge.
+      while (!SWI_PIN_IS_HIGH())
+      {
+        if (SWI_EXPIRED(deadline))
+        {
+          status = SWI_FUNCTION_RETCODE_TIMEOUT;
+          break;
+        }
+      }
+      if (status != SWI_FUNCTION_RETCODE_SUCCESS)
+        break;
+
+      // Detect possible edge indicating zero bit.
+      is_zero = 0;
+      deadline = start + SWI_ARM_ZERO_WINDOW;
+      while (!SWI_EXPIRED(deadline))
+      {
+        if (!SWI_PIN_IS_HIGH())
+        {
+          is_zero = 1;
+          break;
+        }
+      }
+
+      // Wait for rising edge of zero pulse before returning. Otherwise we might interpret
+      // its rising edge as the next start pulse.
+      if (is_zero)
+      {
+        deadline += 2 * SWI_ARM_PULSE_CYCLES;
+        while (!SWI_PIN_IS_HIGH() && !SWI_EXPIRED(deadline))
+          ;
+      }
+
+      // Update byte at current buffer index.
+      else
+        buffer[i] |= bit_mask;  // received "one" bit
+    }
+
+    if (status != SWI_FUNCTION_RETCODE_SUCCESS)
+      break;
+
+    // The count byte tells how long the response is. Stop right after its
+    // last byte instead of waiting for a start pulse that never comes.
+#if !defined(SHA204_RX_FULL_SIZE)
+    if (i == SHA204_BUFFER_POS_COUNT && buffer[i] >= SHA204_RSP_SIZE_MIN && buffer[i] < count)
+      count = buffer[i];
+#endif
+  }
+  SHA204_TRACE_FINISH(SHA204_TRACE_MASK);
+  interrupts();
+
+  if (status == SWI_FUNCTION_RETCODE_TIMEOUT)
+  {
+    if (i > 0)
+    // Indicate that we timed out after having received at least one byte.
+    status = SWI_FUNCTION_RETCODE_RX_FAIL;
+  }
+  return status;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#if defined(SHA204_SWI_HOST)
+
+/* SWI functions for desktop host builds
+
+   Instead of toggling a pin, the bytes are handed to a sha204HostDevice.
+   The time the transfer would take on the wire is added to the clock of the
+   host Arduino shim, so latencies measured with micros() stay realistic. */
+
+// atsha204Class Constructor
+// The pin number is ignored. Attach a device stand-in with setHostDevice().
+atsha204Class::atsha204Class(uint8_t pin)
+{
+	(void) pin;
+	host_device = NULL;
+	host_pin_low = 0;
+	init();
+}
+
+void atsha204Class::setHostDevice(sha204HostDevice *device)
+{
+	host_device = device;
+}
+
+// Target CPU time of the CRC per byte and the part of a us not charged yet
+static uint16_t host_crc_ns_per_byte = 0;
+static unsigned long host_crc_ns = 0;
+
+/** \brief Charges the CRC to the virtual clock as if it ran on the target.
+ *
+ * The host computes CRCs in no virtual time, so work that authenticate() does
+ * while the device executes would save nothing. With a cost set, every byte
+ * the CRC covers advances the clock by ns_per_byte.
+ *
+ * \param[in] ns_per_byte CPU time of one byte on the target; 0, the default, for none
+ */
+void atsha204Class::setHostCrcCost(uint16_t ns_per_byte)
+{
+	host_crc_ns_per_byte = ns_per_byte;
+	host_crc_ns = 0;
+}
+
+void atsha204Class::host_charge_crc(uint8_t length)
+{
+	host_crc_ns += (unsigned long) length * host_crc_ns_per_byte;
+	delayMicroseconds(host_crc_ns / 1000);
+	host_crc_ns %= 1000;
+}
+
+void atsha204Class::swi_set_signal_pin(uint8_t is_high)
+{
+  // A wake pulse is the pin going low and then high again.
+  if (!is_high)
+    host_pin_low = 1;
+  else if (host_pin_low)
+  {
+    host_pin_low = 0;
+    if (host_device)
+      host_device->wake();
+  }
+}
+
+uint8_t atsha204Class::swi_send_bytes(uint8_t count, uint8_t *buffer)
+{
+  delayMicroseconds(RX_TX_DELAY + count * SWI_US_PER_BYTE);
+  if (!host_device)
+    return SWI_FUNCTION_RETCODE_SUCCESS;
+  return host_device->send(count, buffer);
+}
+
+uint8_t atsha204Class::swi_receive_bytes(uint8_t count, uint8_t *buffer)
+{
+  uint8_t status = host_device ? host_device->receive(count, buffer) : SWI_FUNCTION_RETCODE_TIMEOUT;
+
+  if (status == SWI_FUNCTION_RETCODE_SUCCESS)
+  {
+    uint8_t count_byte = buffer[SHA204_BUFFER_POS_COUNT];
+    if (count_byte >= SHA204_RSP_SIZE_MIN && count_byte < count)
+    {
+      delayMicroseconds(count_byte * SWI_US_PER_BYTE);
+#if defined(SHA204_RX_FULL_SIZE)
+      // the start pulse timeout after the last byte of a short response
+      delayMicroseconds(SWI_RECEIVE_TIME_OUT);
+#endif
+    }
+    else
+      delayMicroseconds(count * SWI_US_PER_BYTE);
+  }
+  else
+    delayMicroseconds(SWI_RECEIVE_TIME_OUT);
+  return status;
+}
+
+#endif
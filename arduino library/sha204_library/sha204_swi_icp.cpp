@@ -0,0 +1,203 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#if defined(SHA204_SWI_ICP)
+
+#if !defined(TIMER1_CAPT_vect)
+#error "SHA204_SWI_ICP requires an AVR with a Timer1 input capture unit."
+#endif
+
+/* SWI receiver based on the Timer1 input capture unit
+
+   Every falling edge on ICP1 is timestamped by the hardware. A falling edge
+   that arrives within SWI_ICP_ZERO_WINDOW of the previous start pulse is the
+   second pulse of a zero bit. If the window passes without one, the output
+   compare A interrupt commits a one bit. The same compare interrupt detects
+   the end of a transmission when no further start pulse arrives within
+   SWI_ICP_START_TIMEOUT. Interrupts stay enabled for the whole response. */
+
+static struct
+{
+  uint8_t *buffer;
+  uint8_t count;
+  uint8_t index;
+  uint8_t bit_mask;
+  uint8_t bit_open;
+  uint16_t bit_start;
+  uint8_t status;
+  uint8_t saved_TCCR1A, saved_TCCR1B, saved_TIMSK1;
+  uint16_t saved_OCR1A, saved_TCNT1;
+  sha204_swi_callback_t callback;
+  volatile uint8_t busy;
+} swi_icp;
+
+static void swi_icp_finish(uint8_t status)
+{
+  // Give Timer1 back to its previous owner. The counter is stopped while its
+  // registers are restored, and the flags raised by the receiver are cleared
+  // so that they do not fire the owner's interrupts.
+  TIMSK1 = 0;
+  TCCR1B = 0;
+  TCCR1A = swi_icp.saved_TCCR1A;
+  OCR1A = swi_icp.saved_OCR1A;
+  TCNT1 = swi_icp.saved_TCNT1;
+  TIFR1 = _BV(ICF1) | _BV(OCF1A);
+  TCCR1B = swi_icp.saved_TCCR1B;
+  TIMSK1 = swi_icp.saved_TIMSK1;
+
+  if (status == SWI_FUNCTION_RETCODE_TIMEOUT && swi_icp.index > 0)
+    // Indicate that we timed out after having received at least one byte.
+    status = SWI_FUNCTION_RETCODE_RX_FAIL;
+
+  swi_icp.status = status;
+  swi_icp.busy = 0;
+  if (swi_icp.callback)
+    swi_icp.callback(status);
+}
+
+static void swi_icp_commit(uint8_t is_one)
+{
+  if (swi_icp.bit_mask == 1)
+    swi_icp.buffer[swi_icp.index] = 0;
+  if (is_one)
+    swi_icp.buffer[swi_icp.index] |= swi_icp.bit_mask;
+
+  swi_icp.bit_mask <<= 1;
+  if (swi_icp.bit_mask == 0)
+  {
+    swi_icp.bit_mask = 1;
+    swi_icp.index++;
+#if !defined(SHA204_RX_FULL_SIZE)
+    if (swi_icp.index == SHA204_BUFFER_POS_COUNT + 1)
+    {
+      // The count byte tells how long the response is. Stop right after its
+      // last byte instead of waiting for a start pulse that never comes.
+      uint8_t count_byte = swi_icp.buffer[SHA204_BUFFER_POS_COUNT];
+      if (count_byte >= SHA204_RSP_SIZE_MIN && count_byte < swi_icp.count)
+        swi_icp.count = count_byte;
+    }
+#endif
+    if (swi_icp.index == swi_icp.count)
+      swi_icp_finish(SWI_FUNCTION_RETCODE_SUCCESS);
+  }
+}
+
+ISR(TIMER1_CAPT_vect)
+{
+  uint16_t edge = ICR1;
+
+  if (swi_icp.bit_open && (uint16_t) (edge - swi_icp.bit_start) < SWI_ICP_ZERO_WINDOW)
+  {
+    // Second low pulse of a zero bit.
+    swi_icp.bit_open = 0;
+    swi_icp_commit(0);
+    if (!swi_icp.busy)
+      return;
+    OCR1A = edge + SWI_ICP_START_TIMEOUT;
+  }
+  else
+  {
+    // Start pulse of a new bit. A still open bit can only be a one whose
+    // compare interrupt has not been serviced yet.
+    if (swi_icp.bit_open)
+      swi_icp_commit(1);
+    if (!swi_icp.busy)
+      return;
+    swi_icp.bit_start = edge;
+    swi_icp.bit_open = 1;
+    OCR1A = edge + SWI_ICP_ZERO_WINDOW;
+  }
+  TIFR1 = _BV(OCF1A);
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+  if (swi_icp.bit_open)
+  {
+    // No second pulse within the window: received a one bit.
+    swi_icp.bit_open = 0;
+    swi_icp_commit(1);
+    if (swi_icp.busy)
+      OCR1A = swi_icp.bit_start + SWI_ICP_START_TIMEOUT;
+  }
+  else
+    swi_icp_finish(SWI_FUNCTION_RETCODE_TIMEOUT);
+}
+
+/** \brief Starts receiving bytes in the background.
+ *
+ * \param[in]  count    number of bytes to receive
+ * \param[out] buffer   receive buffer; must stay valid until the transfer completes
+ * \param[in]  callback called from interrupt context on completion (can be NULL)
+ * \return SWI_FUNCTION_RETCODE_SUCCESS if the receiver was armed
+ */
+uint8_t atsha204Class::swi_receive_bytes_async(uint8_t count, uint8_t *buffer, sha204_swi_callback_t callback)
+{
+  if (swi_icp.busy)
+    return SWI_FUNCTION_RETCODE_BUSY;
+
+  swi_icp.buffer = buffer;
+  swi_icp.count = count;
+  swi_icp.index = 0;
+  swi_icp.bit_mask = 1;
+  swi_icp.bit_open = 0;
+  swi_icp.status = SWI_FUNCTION_RETCODE_SUCCESS;
+  swi_icp.callback = callback;
+  if (count == 0)
+    return SWI_FUNCTION_RETCODE_SUCCESS;
+  swi_icp.busy = 1;
+
+  // Configure signal pin as input.
+  *device_port_DDR &= ~device_pin;
+
+  noInterrupts();
+  swi_icp.saved_TCCR1A = TCCR1A;
+  swi_icp.saved_TCCR1B = TCCR1B;
+  swi_icp.saved_TIMSK1 = TIMSK1;
+  swi_icp.saved_OCR1A = OCR1A;
+  swi_icp.saved_TCNT1 = TCNT1;
+
+  // Normal mode, no prescaler, noise canceler on, capture on falling edge.
+  TCCR1A = 0;
+  TCCR1B = _BV(ICNC1) | _BV(CS10);
+  OCR1A = TCNT1 + SWI_ICP_START_TIMEOUT;
+  TIFR1 = _BV(ICF1) | _BV(OCF1A);
+  TIMSK1 = _BV(ICIE1) | _BV(OCIE1A);
+  interrupts();
+
+  return SWI_FUNCTION_RETCODE_SUCCESS;
+}
+
+uint8_t atsha204Class::swi_receive_busy()
+{
+  return swi_icp.busy;
+}
+
+uint8_t atsha204Class::swi_receive_bytes(uint8_t count, uint8_t *buffer)
+{
+  uint8_t status = swi_receive_bytes_async(count, buffer, NULL);
+  if (status != SWI_FUNCTION_RETCODE_SUCCESS)
+    return status;
+
+  // Interrupts stay enabled while we wait.
+  while (swi_icp.busy)
+    ;
+  return swi_icp.status;
+}
+
+/** \brief Requests a response and receives it in the background.
+ *
+ * The callback receives the SWI return code. The caller has to validate the
+ * count byte and CRC of the response once the transfer has completed.
+ */
+uint8_t atsha204Class::sha204p_receive_response_async(uint8_t size, uint8_t *response, sha204_swi_callback_t callback)
+{
+  if (swi_icp.busy)
+    return SWI_FUNCTION_RETCODE_BUSY;
+
+  (void) swi_send_byte(SHA204_SWI_FLAG_TX);
+  return swi_receive_bytes_async(size, response, callback);
+}
+
+#endif
@@ -0,0 +1,112 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#if defined(SHA204_SWI_SPI_TX)
+
+#if !defined(SPI_STC_vect)
+#error "SHA204_SWI_SPI_TX requires an AVR with an SPI peripheral."
+#endif
+#if !defined(SWI_SPI_SPCR_CLOCK)
+#error "SHA204_SWI_SPI_TX supports F_CPU of 8 MHz and 16 MHz only."
+#endif
+
+/* SWI transmitter based on the SPI peripheral
+
+   Each SWI bit is a fixed waveform of eight pulse widths, so it can be
+   shifted out as one SPI byte when SCK runs at one bit per BIT_DELAY.
+   The packet is expanded bit by bit through a two-entry pattern table in
+   the transfer complete interrupt, so no expanded copy of the packet is
+   kept in RAM. Both patterns end high, which leaves MOSI at the idle level
+   between SPI bytes. */
+
+static const uint8_t swi_spi_pattern[2] = {SWI_SPI_PATTERN_ZERO, SWI_SPI_PATTERN_ONE};
+
+static struct
+{
+  const uint8_t *buffer;
+  uint8_t count;
+  uint8_t index;
+  uint8_t bit_mask;
+  sha204_swi_callback_t callback;
+  volatile uint8_t busy;
+} swi_spi;
+
+ISR(SPI_STC_vect)
+{
+  swi_spi.bit_mask <<= 1;
+  if (swi_spi.bit_mask == 0)
+  {
+    swi_spi.bit_mask = 1;
+    if (++swi_spi.index == swi_spi.count)
+    {
+      // Hand MOSI back to the port register, which holds it high.
+      SPCR = 0;
+      swi_spi.busy = 0;
+      if (swi_spi.callback)
+        swi_spi.callback(SWI_FUNCTION_RETCODE_SUCCESS);
+      return;
+    }
+  }
+  SPDR = swi_spi_pattern[(swi_spi.buffer[swi_spi.index] & swi_spi.bit_mask) ? 1 : 0];
+}
+
+/** \brief Starts sending bytes in the background.
+ *
+ * \param[in] count    number of bytes to send
+ * \param[in] buffer   bytes to send; must stay valid until the transfer completes
+ * \param[in] callback called from interrupt context on completion (can be NULL)
+ * \return SWI_FUNCTION_RETCODE_SUCCESS if the transfer was started
+ */
+uint8_t atsha204Class::swi_send_bytes_async(uint8_t count, uint8_t *buffer, sha204_swi_callback_t callback)
+{
+  if (swi_spi.busy)
+    return SWI_FUNCTION_RETCODE_BUSY;
+
+  swi_spi.buffer = buffer;
+  swi_spi.count = count;
+  swi_spi.index = 0;
+  swi_spi.bit_mask = 1;
+  swi_spi.callback = callback;
+
+  // Set signal pin as output. SS has to be an output to stay SPI master.
+  *device_port_OUT |= device_pin;
+  *device_port_DDR |= device_pin;
+  pinMode(SS, OUTPUT);
+
+  // Wait turn around time.
+  delayMicroseconds(RX_TX_DELAY);
+
+  if (count == 0)
+  {
+    if (callback)
+      callback(SWI_FUNCTION_RETCODE_SUCCESS);
+    return SWI_FUNCTION_RETCODE_SUCCESS;
+  }
+
+  swi_spi.busy = 1;
+  SPSR = SWI_SPI_SPSR_CLOCK;
+  SPCR = _BV(SPIE) | _BV(SPE) | _BV(MSTR) | SWI_SPI_SPCR_CLOCK;
+  SPDR = swi_spi_pattern[(buffer[0] & 1) ? 1 : 0];
+
+  return SWI_FUNCTION_RETCODE_SUCCESS;
+}
+
+uint8_t atsha204Class::swi_send_busy()
+{
+  return swi_spi.busy;
+}
+
+uint8_t atsha204Class::swi_send_bytes(uint8_t count, uint8_t *buffer)
+{
+  uint8_t status = swi_send_bytes_async(count, buffer, NULL);
+  if (status != SWI_FUNCTION_RETCODE_SUCCESS)
+    return status;
+
+  // Interrupts stay enabled while we wait.
+  while (swi_spi.busy)
+    ;
+  return SWI_FUNCTION_RETCODE_SUCCESS;
+}
+
+#endif
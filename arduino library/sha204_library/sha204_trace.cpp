@@ -0,0 +1,169 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#if defined(SHA204_TRACE)
+
+static sha204_trace_entry_t sha204_trace_ring[SHA204_TRACE_SIZE];
+static uint8_t sha204_trace_head;     // index of the next entry to write
+static uint8_t sha204_trace_count;    // number of valid entries
+
+static const char *const sha204_trace_names[SHA204_TRACE_PHASES] =
+{
+	"masked", "wake", "flag", "command", "turnaround",
+	"execution", "poll", "receive", "resync", "transaction"
+};
+
+#if defined(SHA204_SWI_ARM)
+
+static inline uint32_t sha204_trace_clock()
+{
+	return DWT->CYCCNT;
+}
+
+void sha204_trace_tick()
+{
+}
+
+#elif defined(SHA204_SWI_HOST)
+
+static inline uint32_t sha204_trace_clock()
+{
+	return micros();
+}
+
+void sha204_trace_tick()
+{
+}
+
+#else
+
+// Timer0 overflow period in microseconds.
+#define SHA204_TRACE_OVERFLOW_US   (16384000UL / (F_CPU / 1000UL))
+
+static uint32_t sha204_trace_last_raw;
+static uint32_t sha204_trace_offset;
+
+// micros() cannot count more than one Timer0 overflow while interrupts are
+// disabled, so it steps back by one overflow period for every further one.
+// The SWI loops call sha204_trace_tick() at least once per overflow period,
+// which lets us detect those steps and keep the trace clock monotonic.
+static uint32_t sha204_trace_clock()
+{
+	uint32_t raw = micros();
+
+	if ((int32_t) (raw - sha204_trace_last_raw) < 0)
+		sha204_trace_offset += SHA204_TRACE_OVERFLOW_US;
+	sha204_trace_last_raw = raw;
+	return raw + sha204_trace_offset;
+}
+
+void sha204_trace_tick()
+{
+	(void) sha204_trace_clock();
+}
+
+#endif
+
+/** \brief Records a trace event.
+ *
+ * \param[in] event phase, ORed with SHA204_TRACE_END for the end of a phase
+ */
+void sha204_trace(uint8_t event)
+{
+	sha204_trace_entry_t *entry = &sha204_trace_ring[sha204_trace_head];
+
+	entry->time = sha204_trace_clock();
+	entry->event = event;
+	if (++sha204_trace_head == SHA204_TRACE_SIZE)
+		sha204_trace_head = 0;
+	if (sha204_trace_count < SHA204_TRACE_SIZE)
+		sha204_trace_count++;
+}
+
+/** \brief Copies the recorded events, oldest first.
+ *
+ * \param[out] entries     destination
+ * \param[in]  max_entries size of destination in entries
+ * \return number of entries copied
+ */
+uint8_t sha204_trace_read(sha204_trace_entry_t *entries, uint8_t max_entries)
+{
+	uint8_t i;
+	uint8_t n = sha204_trace_count < max_entries ? sha204_trace_count : max_entries;
+	uint8_t index = (sha204_trace_head + SHA204_TRACE_SIZE - sha204_trace_count) % SHA204_TRACE_SIZE;
+
+	for (i = 0; i < n; i++) {
+		entries[i] = sha204_trace_ring[index];
+		if (++index == SHA204_TRACE_SIZE)
+			index = 0;
+	}
+	return n;
+}
+
+void sha204_trace_clear()
+{
+	sha204_trace_head = sha204_trace_count = 0;
+}
+
+/** \brief Prints count, total and maximum duration of every phase in the ring buffer.
+ *
+ * End events whose begin event was already overwritten are skipped. The
+ * maximum of the "masked" phase is the worst-case time the SWI layer kept
+ * interrupts disabled.
+ */
+void sha204_trace_report(Print &out)
+{
+	uint32_t begin[SHA204_TRACE_PHASES];
+	uint32_t total[SHA204_TRACE_PHASES];
+	uint32_t longest[SHA204_TRACE_PHASES];
+	uint8_t count[SHA204_TRACE_PHASES];
+	uint8_t open[SHA204_TRACE_PHASES];
+	uint8_t i, phase;
+	uint8_t index = (sha204_trace_head + SHA204_TRACE_SIZE - sha204_trace_count) % SHA204_TRACE_SIZE;
+
+	memset(total, 0, sizeof(total));
+	memset(longest, 0, sizeof(longest));
+	memset(count, 0, sizeof(count));
+	memset(open, 0, sizeof(open));
+
+	for (i = 0; i < sha204_trace_count; i++) {
+		sha204_trace_entry_t *entry = &sha204_trace_ring[index];
+		if (++index == SHA204_TRACE_SIZE)
+			index = 0;
+
+		phase = entry->event & ~SHA204_TRACE_END;
+		if (phase >= SHA204_TRACE_PHASES)
+			continue;
+		if (!(entry->event & SHA204_TRACE_END)) {
+			begin[phase] = entry->time;
+			open[phase] = 1;
+		}
+		else if (open[phase]) {
+			uint32_t duration = entry->time - begin[phase];
+			open[phase] = 0;
+			total[phase] += duration;
+			if (duration > longest[phase])
+				longest[phase] = duration;
+			count[phase]++;
+		}
+	}
+
+	out.println("phase,count,total_us,max_us");
+	for (phase = 0; phase < SHA204_TRACE_PHASES; phase++) {
+		if (!count[phase])
+			continue;
+		out.print(sha204_trace_names[phase]);
+		out.print(',');
+		out.print(count[phase]);
+		out.print(',');
+		out.print(total[phase] / SHA204_TRACE_TICKS_PER_US);
+		out.print(',');
+		out.println(longest[phase] / SHA204_TRACE_TICKS_PER_US);
+	}
+	out.print("worst-case masked time: ");
+	out.print(longest[SHA204_TRACE_MASK] / SHA204_TRACE_TICKS_PER_US);
+	out.println(" us");
+}
+
+#endif
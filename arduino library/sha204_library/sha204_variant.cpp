@@ -0,0 +1,97 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+static const sha204_timing_t sha204_timing_atsha204 =
+{
+	CHECKMAC_DELAY, DERIVE_KEY_DELAY, DEVREV_DELAY, GENDIG_DELAY, HMAC_DELAY, LOCK_DELAY, MAC_DELAY,
+	NONCE_DELAY, PAUSE_DELAY, RANDOM_DELAY, READ_DELAY, UPDATE_DELAY, WRITE_DELAY
+};
+
+static const sha204_timing_t sha204_timing_atsha204a =
+{
+	CHECKMAC_DELAY_A, DERIVE_KEY_DELAY_A, DEVREV_DELAY, GENDIG_DELAY_A, HMAC_DELAY_A, LOCK_DELAY, MAC_DELAY_A,
+	NONCE_DELAY_A, PAUSE_DELAY, RANDOM_DELAY_A, READ_DELAY, UPDATE_DELAY, WRITE_DELAY
+};
+
+/** \brief Finds out which part is attached and selects its execution times.
+ *
+ * Sends DevRev and reads the RevNum word of the configuration zone. The
+ * device has to be awake. Call it once after the first wake-up; the
+ * variant stays selected until setVariant() is called.
+ *
+ * \return status of the commands; the variant is left as it was if one fails
+ */
+uint8_t atsha204Class::detectVariant()
+{
+	uint8_t command[READ_COUNT];
+	uint8_t response[READ_4_RSP_SIZE];
+	uint8_t dev_revision, ret_code;
+
+	ret_code = sha204m_dev_rev(command, response);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	dev_revision = response[SHA204_BUFFER_POS_DATA + ADDRESS_REVISION - ADDRESS_RevNum];
+
+	ret_code = sha204m_read(command, response, SHA204_ZONE_CONFIG, ADDRESS_RevNum);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	if (dev_revision >= SHA204_REVISION_ATSHA204A
+			|| response[SHA204_BUFFER_POS_DATA + ADDRESS_REVISION - ADDRESS_RevNum] >= SHA204_REVISION_ATSHA204A)
+		setVariant(SHA204_VARIANT_ATSHA204A);
+	else
+		setVariant(SHA204_VARIANT_ATSHA204);
+	return SHA204_SUCCESS;
+}
+
+/** \brief Selects the execution times of a part without asking the device.
+ *
+ * \param[in] variant SHA204_VARIANT_ATSHA204A, SHA204_VARIANT_ATSHA204, or
+ *                    SHA204_VARIANT_UNKNOWN for the *_DELAY values
+ */
+void atsha204Class::setVariant(uint8_t variant)
+{
+	this->variant = variant;
+	if (variant == SHA204_VARIANT_ATSHA204A)
+		timing = &sha204_timing_atsha204a;
+	else if (variant == SHA204_VARIANT_ATSHA204)
+		timing = &sha204_timing_atsha204;
+	else {
+		this->variant = SHA204_VARIANT_UNKNOWN;
+		timing = NULL;
+	}
+}
+
+uint8_t atsha204Class::getVariant()
+{
+	return variant;
+}
+
+// Replaces the delay before the first poll with the one of the variant. The time
+// polling ends at stays the same, so the timeout grows by what the delay shrinks.
+void atsha204Class::sha204c_variant_delay(uint8_t op_code, uint8_t *execution_delay, uint8_t *execution_timeout)
+{
+	uint8_t delay_ms;
+
+	switch (op_code) {
+	case SHA204_CHECKMAC:     delay_ms = timing->checkmac; break;
+	case SHA204_DERIVE_KEY:   delay_ms = timing->derive_key; break;
+	case SHA204_DEVREV:       delay_ms = timing->devrev; break;
+	case SHA204_GENDIG:       delay_ms = timing->gendig; break;
+	case SHA204_HMAC:         delay_ms = timing->hmac; break;
+	case SHA204_LOCK:         delay_ms = timing->lock; break;
+	case SHA204_MAC:          delay_ms = timing->mac; break;
+	case SHA204_NONCE:        delay_ms = timing->nonce; break;
+	case SHA204_PAUSE:        delay_ms = timing->pause; break;
+	case SHA204_RANDOM:       delay_ms = timing->random; break;
+	case SHA204_READ:         delay_ms = timing->read; break;
+	case SHA204_UPDATE_EXTRA: delay_ms = timing->update_extra; break;
+	case SHA204_WRITE:        delay_ms = timing->write; break;
+	default:                  return;
+	}
+	if (delay_ms < *execution_delay) {
+		*execution_timeout += *execution_delay - delay_ms;
+		*execution_delay = delay_ms;
+	}
+}
@@ -0,0 +1,199 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#if defined(__AVR__)
+#include <avr/eeprom.h>
+
+void sha204_eeprom_read(void *context, uint16_t address, uint8_t *data, uint8_t count)
+{
+	(void) context;
+	eeprom_read_block(data, (const void *) address, count);
+}
+
+void sha204_eeprom_write(void *context, uint16_t address, const uint8_t *data, uint8_t count)
+{
+	(void) context;
+	eeprom_update_block(data, (void *) address, count);
+}
+#endif
+
+/** \brief Keeps the boot metadata of a device in non-volatile memory.
+ *
+ * \param[in] device  device the record is about
+ * \param[in] read    reads the non-volatile memory, for example sha204_eeprom_read
+ * \param[in] write   writes it, for example sha204_eeprom_write
+ * \param[in] context passed to read and write
+ * \param[in] address where the sizeof(sha204_warm_record_t) bytes of the record go
+ */
+sha204WarmStart::sha204WarmStart(atsha204Class &device, sha204_nvm_read_t read, sha204_nvm_write_t write,
+		void *context, uint16_t address)
+{
+	this->device = &device;
+	nvm_read = read;
+	nvm_write = write;
+	this->context = context;
+	this->address = address;
+	valid = 0;
+}
+
+/** \brief Loads the stored record and checks it against the attached device.
+ *
+ * The device is woken, SN[4:7] is read and compared with the record, and
+ * the device is put to sleep again. If there is no record, the record was
+ * stored before both the configuration and the data zone were locked, or
+ * another device is attached, the device is read as by refresh().
+ *
+ * \param[out] result whether the record was used, commands and time; may be NULL
+ * \return status of the operation
+ */
+uint8_t sha204WarmStart::begin(sha204_warm_result_t *result)
+{
+	sha204_warm_result_t local_result;
+	uint8_t command[READ_COUNT];
+	uint8_t response[READ_4_RSP_SIZE];
+	uint8_t ret_code;
+	uint16_t crc;
+	unsigned long start_us;
+
+	if (!result)
+		result = &local_result;
+	memset(result, 0, sizeof(*result));
+
+	valid = 0;
+	nvm_read(context, address, (uint8_t *) &record, sizeof(record));
+	crc = record.crc[0] | (record.crc[1] << 8);
+	if (record.magic != SHA204_WARM_MAGIC || crc != recordCrc()
+			|| record.lock_word[ADDRESS_LOCKVALUE & 3] != 0x00 || record.lock_word[ADDRESS_LOCKCONFIG & 3] != 0x00)
+		return load(result);
+
+	start_us = micros();
+	ret_code = device->sha204c_wakeup(response);
+	if (ret_code == SHA204_SUCCESS) {
+		result->commands++;
+		ret_code = device->sha204m_read(command, response, SHA204_ZONE_CONFIG, ADDRESS_SN47);
+	}
+	result->total_us = micros() - start_us;
+	device->sha204p_sleep();
+
+	if (ret_code != SHA204_SUCCESS) {
+		result->ret_code = ret_code;
+		return ret_code;
+	}
+	if (memcmp(&response[SHA204_BUFFER_POS_DATA], &record.serial[4], 4))
+		return load(result);
+
+	valid = 1;
+	result->warm = 1;
+	result->ret_code = SHA204_SUCCESS;
+	return SHA204_SUCCESS;
+}
+
+/** \brief Reads the device and stores a new record.
+ *
+ * Sends DevRev, two 32-byte and six 4-byte reads of the configuration zone
+ * in one wake session. Call it after locking a zone or changing the
+ * configuration, so that the record holds the current lock word and hash.
+ *
+ * \param[out] result commands and time; may be NULL
+ * \return status of the operation; the stored record is left as it was if a command fails
+ */
+uint8_t sha204WarmStart::refresh(sha204_warm_result_t *result)
+{
+	sha204_warm_result_t local_result;
+
+	if (!result)
+		result = &local_result;
+	memset(result, 0, sizeof(*result));
+	return load(result);
+}
+
+// Drops the stored record, so that the next begin() reads the device.
+void sha204WarmStart::invalidate()
+{
+	valid = 0;
+	record.magic = 0;
+	nvm_write(context, address, &record.magic, sizeof(record.magic));
+}
+
+// Returns the record of the attached device, or NULL until begin() or refresh() succeeded.
+const sha204_warm_record_t *sha204WarmStart::getRecord()
+{
+	return valid ? &record : NULL;
+}
+
+void sha204WarmStart::printResult(Print &out, const sha204_warm_result_t *result)
+{
+	if (result->ret_code != SHA204_SUCCESS) {
+		out.print("error 0x");
+		out.print(result->ret_code, HEX);
+		out.print(" after ");
+	}
+	else
+		out.print(result->warm ? "warm start in " : "cold start in ");
+	out.print(result->total_us / 1000);
+	out.print(" ms, commands ");
+	out.println(result->commands);
+}
+
+uint16_t sha204WarmStart::recordCrc()
+{
+	return atsha204Class::sha204c_update_crc(sizeof(record) - SHA204_CRC_SIZE, (const uint8_t *) &record, 0);
+}
+
+// Reads DevRev and the configuration zone into the record and stores it. The counters
+// add to those of begin(), which may have found another device.
+uint8_t sha204WarmStart::load(sha204_warm_result_t *result)
+{
+	uint8_t command[READ_COUNT];
+	uint8_t response[READ_32_RSP_SIZE];
+	sha204Sha256 hash;
+	uint8_t offset, size, ret_code;
+	uint16_t crc;
+	unsigned long start_us;
+
+	valid = 0;
+	start_us = micros();
+	ret_code = device->sha204c_wakeup(response);
+	if (ret_code == SHA204_SUCCESS) {
+		result->commands++;
+		ret_code = device->sha204m_dev_rev(command, response);
+		memcpy(record.dev_rev, &response[SHA204_BUFFER_POS_DATA], sizeof(record.dev_rev));
+	}
+
+	// The zone ends with 24 bytes that take 4-byte reads.
+	for (offset = 0; offset < SHA204_CONFIG_SIZE && ret_code == SHA204_SUCCESS; offset += size) {
+		size = (SHA204_CONFIG_SIZE - offset >= SHA204_ZONE_ACCESS_32) ? SHA204_ZONE_ACCESS_32 : SHA204_ZONE_ACCESS_4;
+		result->commands++;
+		ret_code = device->sha204m_read(command, response,
+				size == SHA204_ZONE_ACCESS_32 ? (SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG) : SHA204_ZONE_CONFIG, offset);
+		if (ret_code != SHA204_SUCCESS)
+			break;
+		// UserExtra and Selector are left out; UpdateExtra can change them at any time.
+		if (offset == (ADDRESS_LOCKVALUE & ~3))
+			hash.update(&response[SHA204_BUFFER_POS_DATA + (ADDRESS_LOCKVALUE & 3)], 2);
+		else
+			hash.update(&response[SHA204_BUFFER_POS_DATA], size);
+		if (offset == 0) {
+			memcpy(record.serial, &response[SHA204_BUFFER_POS_DATA + ADDRESS_SN03], 4);
+			memcpy(&record.serial[4], &response[SHA204_BUFFER_POS_DATA + ADDRESS_SN47], 5);
+		}
+		else if (offset == (ADDRESS_LOCKVALUE & ~3))
+			memcpy(record.lock_word, &response[SHA204_BUFFER_POS_DATA], sizeof(record.lock_word));
+	}
+	result->total_us += micros() - start_us;
+	device->sha204p_sleep();
+
+	result->ret_code = ret_code;
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	hash.finish(record.config_hash);
+	record.magic = SHA204_WARM_MAGIC;
+	crc = recordCrc();
+	record.crc[0] = (uint8_t) crc;
+	record.crc[1] = (uint8_t) (crc >> 8);
+	nvm_write(context, address, (const uint8_t *) &record, sizeof(record));
+	valid = 1;
+	return SHA204_SUCCESS;
+}
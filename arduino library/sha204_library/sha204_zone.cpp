@@ -0,0 +1,347 @@
+#include "Arduino.h"
+#include "sha204_library.h"
+#include "sha204_includes/sha204_lib_return_codes.h"
+
+#define SHA204_ZONE_LOCK_UNKNOWN     ((uint8_t) 0xFF)
+#define SHA204_ZONE_LOCKED           ((uint8_t) 0x00)
+
+// Returns the mask of the words covered by an access within its block.
+static uint8_t sha204_zone_words(uint16_t address, uint8_t length)
+{
+	if (length == SHA204_ZONE_ACCESS_32)
+		return SHA204_ZONE_CACHE_ALL;
+	return 1 << ((address % SHA204_ZONE_ACCESS_32) / SHA204_ZONE_ACCESS_4);
+}
+
+// Checks zone, alignment and range of an access.
+static uint8_t sha204_zone_check(uint8_t zone, uint16_t address, const uint8_t *data, uint8_t length)
+{
+	uint16_t size;
+
+	if (zone == SHA204_ZONE_DATA)
+		size = (SHA204_KEY_ID_MAX + 1) * SHA204_ZONE_ACCESS_32;
+	else if (zone == SHA204_ZONE_OTP)
+		size = (SHA204_OTP_BLOCK_MAX + 1) * SHA204_ZONE_ACCESS_32;
+	else
+		return SHA204_BAD_PARAM;
+
+	if (!data || (length != SHA204_ZONE_ACCESS_4 && length != SHA204_ZONE_ACCESS_32)
+			|| address % length || address + length > size)
+		return SHA204_BAD_PARAM;
+	return SHA204_SUCCESS;
+}
+
+// Returns the average time in us of the commands of one size. Without a sample of
+// that size it is derived from the other one, which puts 28 bytes more or less on the wire.
+static uint32_t sha204_zone_average(const uint16_t *count, const uint32_t *us, uint8_t size)
+{
+	uint32_t wire_us = (uint32_t) (SHA204_ZONE_ACCESS_32 - SHA204_ZONE_ACCESS_4) * SWI_US_PER_BYTE;
+	uint32_t average;
+
+	if (count[size])
+		return us[size] / count[size];
+	if (!count[!size])
+		return 0;
+	average = us[!size] / count[!size];
+	if (size == SHA204_ZONE_LONG)
+		return average + wire_us;
+	return average > wire_us ? average - wire_us : 0;
+}
+
+sha204ZoneCache::sha204ZoneCache(atsha204Class &device)
+{
+	this->device = &device;
+	invalidate();
+	resetStats();
+}
+
+/** \brief Reads 4 or 32 bytes of the data or OTP zone.
+ *
+ * Words the cache holds are returned without a command. Otherwise the whole
+ * block is read with one 32-byte Read, which the device accepts only once
+ * the data zone is locked. The device has to be awake.
+ *
+ * \param[in] zone    SHA204_ZONE_DATA or SHA204_ZONE_OTP
+ * \param[in] address byte address, a multiple of length
+ * \param[in] length  SHA204_ZONE_ACCESS_4 or SHA204_ZONE_ACCESS_32
+ * \return status of the operation
+ */
+uint8_t sha204ZoneCache::read(uint8_t zone, uint16_t address, uint8_t *data, uint8_t length)
+{
+	uint8_t words = sha204_zone_words(address, length);
+	uint8_t index, ret_code;
+
+	ret_code = sha204_zone_check(zone, address, data, length);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	stats.reads[length == SHA204_ZONE_ACCESS_32]++;
+
+	ret_code = block(zone << 6 | address / SHA204_ZONE_ACCESS_32, &index);
+	if (ret_code == SHA204_SUCCESS && (blocks[index].valid & words) != words)
+		ret_code = fill(index);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	memcpy(data, &blocks[index].bytes[address % SHA204_ZONE_ACCESS_32], length);
+	return SHA204_SUCCESS;
+}
+
+/** \brief Writes 4 or 32 bytes of the data or OTP zone into the cache.
+ *
+ * Nothing is sent until flush() or sleep(), or until the block is needed
+ * for another one. Only then does the device report errors such as a
+ * locked zone.
+ *
+ * \param[in] zone    SHA204_ZONE_DATA or SHA204_ZONE_OTP
+ * \param[in] address byte address, a multiple of length
+ * \param[in] length  SHA204_ZONE_ACCESS_4 or SHA204_ZONE_ACCESS_32
+ * \return status of the operation; an error of flushing the block that made room
+ */
+uint8_t sha204ZoneCache::write(uint8_t zone, uint16_t address, const uint8_t *data, uint8_t length)
+{
+	uint8_t words = sha204_zone_words(address, length);
+	uint8_t index, ret_code;
+
+	ret_code = sha204_zone_check(zone, address, data, length);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	stats.writes[length == SHA204_ZONE_ACCESS_32]++;
+
+	ret_code = block(zone << 6 | address / SHA204_ZONE_ACCESS_32, &index);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	memcpy(&blocks[index].bytes[address % SHA204_ZONE_ACCESS_32], data, length);
+	blocks[index].valid |= words;
+	blocks[index].dirty |= words;
+	return SHA204_SUCCESS;
+}
+
+/** \brief Writes all blocks that hold words not written yet.
+ *
+ * The device has to be awake. A block that fails keeps its words, so
+ * flush() can be called again.
+ *
+ * \return SHA204_SUCCESS, or the error of the first block that failed
+ */
+uint8_t sha204ZoneCache::flush()
+{
+	uint8_t i, ret_code, first_error = SHA204_SUCCESS;
+
+	for (i = 0; i < SHA204_ZONE_CACHE_BLOCKS; i++) {
+		ret_code = flushBlock(i);
+		if (first_error == SHA204_SUCCESS)
+			first_error = ret_code;
+	}
+	return first_error;
+}
+
+// Flushes the cache and puts the device to sleep, which it does even if flushing failed.
+uint8_t sha204ZoneCache::sleep()
+{
+	uint8_t ret_code = flush();
+
+	device->sha204p_sleep();
+	return ret_code;
+}
+
+// Drops all blocks, including words not written yet, and forgets the lock state.
+// Call it when another device may have been attached or after locking the data zone.
+void sha204ZoneCache::invalidate()
+{
+	uint8_t i;
+
+	for (i = 0; i < SHA204_ZONE_CACHE_BLOCKS; i++) {
+		blocks[i].tag = SHA204_ZONE_CACHE_NONE;
+		blocks[i].valid = blocks[i].dirty = 0;
+		blocks[i].used = 0;
+	}
+	clock = 0;
+	lock_value = SHA204_ZONE_LOCK_UNKNOWN;
+}
+
+// Returns how many commands the cache saved: read() and write() calls minus the
+// Read and Write commands it sent, including the reads of the lock state.
+int16_t sha204ZoneCache::savedTransactions()
+{
+	int16_t saved = 0;
+	uint8_t size;
+
+	for (size = SHA204_ZONE_SHORT; size <= SHA204_ZONE_LONG; size++)
+		saved += stats.reads[size] + stats.writes[size] - stats.device_reads[size] - stats.device_writes[size];
+	return saved;
+}
+
+// Estimates the bus time the cache saved. Every read() and write() call is taken
+// to cost what the Read or Write commands of its size that were sent cost on average.
+int32_t sha204ZoneCache::savedMs()
+{
+	uint32_t uncached_ms = 0, spent_ms = 0;
+	uint8_t size;
+
+	for (size = SHA204_ZONE_SHORT; size <= SHA204_ZONE_LONG; size++) {
+		uncached_ms += stats.reads[size] * sha204_zone_average(stats.device_reads, stats.read_us, size) / 1000;
+		uncached_ms += stats.writes[size] * sha204_zone_average(stats.device_writes, stats.write_us, size) / 1000;
+		spent_ms += (stats.read_us[size] + stats.write_us[size]) / 1000;
+	}
+	return (int32_t) uncached_ms - (int32_t) spent_ms;
+}
+
+const sha204_zone_stats_t *sha204ZoneCache::getStats()
+{
+	return &stats;
+}
+
+void sha204ZoneCache::resetStats()
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void sha204ZoneCache::printStats(Print &out)
+{
+	out.print("reads ");          out.print(stats.reads[0] + stats.reads[1]);
+	out.print(" (");              out.print(stats.device_reads[0] + stats.device_reads[1]);
+	out.print(" sent), writes "); out.print(stats.writes[0] + stats.writes[1]);
+	out.print(" (");              out.print(stats.device_writes[0] + stats.device_writes[1]);
+	out.print(" sent), saved ");  out.print(savedTransactions());
+	out.print(" transactions, "); out.print(savedMs());
+	out.println(" ms");
+}
+
+// Reads LockValue. Writes the OTP mode forbids are left to the device to reject.
+uint8_t sha204ZoneCache::readLockState()
+{
+	uint8_t response[READ_4_RSP_SIZE];
+	uint8_t ret_code;
+
+	ret_code = deviceRead(SHA204_ZONE_CONFIG, ADDRESS_LOCKVALUE & ~3, response);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	lock_value = response[SHA204_BUFFER_POS_DATA + (ADDRESS_LOCKVALUE & 3)];
+	return SHA204_SUCCESS;
+}
+
+// Finds the block with tag, or makes room for it in the least recently used block.
+uint8_t sha204ZoneCache::block(uint8_t tag, uint8_t *index)
+{
+	uint8_t i, victim = 0, age, oldest = 0;
+	uint8_t ret_code;
+
+	clock++;
+	for (i = 0; i < SHA204_ZONE_CACHE_BLOCKS; i++) {
+		if (blocks[i].tag == tag) {
+			blocks[i].used = clock;
+			*index = i;
+			return SHA204_SUCCESS;
+		}
+		age = blocks[i].tag == SHA204_ZONE_CACHE_NONE ? 0xFF : (uint8_t) (clock - blocks[i].used);
+		if (age >= oldest) {
+			oldest = age;
+			victim = i;
+		}
+	}
+
+	ret_code = flushBlock(victim);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	blocks[victim].tag = tag;
+	blocks[victim].valid = blocks[victim].dirty = 0;
+	blocks[victim].used = clock;
+	*index = victim;
+	return SHA204_SUCCESS;
+}
+
+// Reads a block and keeps the words written to the cache.
+uint8_t sha204ZoneCache::fill(uint8_t index)
+{
+	uint8_t response[READ_32_RSP_SIZE];
+	uint8_t i, ret_code;
+
+	if (blocks[index].valid == SHA204_ZONE_CACHE_ALL)
+		return SHA204_SUCCESS;
+
+	ret_code = deviceRead((blocks[index].tag >> 6) | SHA204_ZONE_COUNT_FLAG,
+			(blocks[index].tag & 0x3F) * SHA204_ZONE_ACCESS_32, response);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	for (i = 0; i < SHA204_ZONE_CACHE_WORDS; i++)
+		if (!(blocks[index].valid & (1 << i)))
+			memcpy(&blocks[index].bytes[i * SHA204_ZONE_ACCESS_4],
+					&response[SHA204_BUFFER_POS_DATA + i * SHA204_ZONE_ACCESS_4], SHA204_ZONE_ACCESS_4);
+	blocks[index].valid = SHA204_ZONE_CACHE_ALL;
+	return SHA204_SUCCESS;
+}
+
+// Writes the words of a block that are not written yet, as one 32-byte write
+// where the zone allows it and that saves commands, else word by word.
+uint8_t sha204ZoneCache::flushBlock(uint8_t index)
+{
+	uint8_t zone = blocks[index].tag >> 6;
+	uint16_t address = (blocks[index].tag & 0x3F) * SHA204_ZONE_ACCESS_32;
+	uint8_t dirty = blocks[index].dirty;
+	uint8_t locked, words, i, ret_code;
+
+	if (!dirty)
+		return SHA204_SUCCESS;
+
+	if (lock_value == SHA204_ZONE_LOCK_UNKNOWN) {
+		ret_code = readLockState();
+		if (ret_code != SHA204_SUCCESS)
+			return ret_code;
+	}
+	locked = lock_value == SHA204_ZONE_LOCKED;
+
+	// A locked data zone takes 32-byte writes only.
+	if (zone == SHA204_ZONE_DATA && locked) {
+		ret_code = fill(index);
+		if (ret_code != SHA204_SUCCESS)
+			return ret_code;
+	}
+
+	for (words = 0, i = dirty; i; i >>= 1)
+		words += i & 1;
+
+	// A locked OTP zone takes 4-byte writes only.
+	if (blocks[index].valid == SHA204_ZONE_CACHE_ALL && !(zone == SHA204_ZONE_OTP && locked)
+			&& (words > 1 || (zone == SHA204_ZONE_DATA && locked))) {
+		ret_code = deviceWrite(zone | SHA204_ZONE_COUNT_FLAG, address, blocks[index].bytes);
+		if (ret_code != SHA204_SUCCESS)
+			return ret_code;
+		blocks[index].dirty = 0;
+		return SHA204_SUCCESS;
+	}
+
+	for (i = 0; i < SHA204_ZONE_CACHE_WORDS; i++) {
+		if (!(dirty & (1 << i)))
+			continue;
+		ret_code = deviceWrite(zone, address + i * SHA204_ZONE_ACCESS_4, &blocks[index].bytes[i * SHA204_ZONE_ACCESS_4]);
+		if (ret_code != SHA204_SUCCESS)
+			return ret_code;
+		blocks[index].dirty &= ~(1 << i);
+	}
+	return SHA204_SUCCESS;
+}
+
+uint8_t sha204ZoneCache::deviceRead(uint8_t zone, uint16_t address, uint8_t *response)
+{
+	uint8_t command[READ_COUNT];
+	unsigned long start_us = micros();
+	uint8_t ret_code = device->sha204m_read(command, response, zone, address);
+
+	stats.read_us[(zone & SHA204_ZONE_COUNT_FLAG) != 0] += micros() - start_us;
+	stats.device_reads[(zone & SHA204_ZONE_COUNT_FLAG) != 0]++;
+	return ret_code;
+}
+
+uint8_t sha204ZoneCache::deviceWrite(uint8_t zone, uint16_t address, uint8_t *data)
+{
+	uint8_t command[WRITE_COUNT_LONG];
+	uint8_t response[WRITE_RSP_SIZE];
+	unsigned long start_us = micros();
+	uint8_t ret_code = device->sha204m_write(command, response, zone, address, data, NULL);
+
+	stats.write_us[(zone & SHA204_ZONE_COUNT_FLAG) != 0] += micros() - start_us;
+	stats.device_writes[(zone & SHA204_ZONE_COUNT_FLAG) != 0]++;
+	return ret_code;
+}
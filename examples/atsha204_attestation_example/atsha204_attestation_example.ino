@@ -0,0 +1,79 @@
+/* ATSHA204 Library Attestation Example
+
+   This code has the device vouch for the flash memory of the Arduino, in
+   regions of 4 KiB. For each region the SHA-256 digest is computed in
+   software and the device signs it with key 0:
+
+   MAC = SHA-256(key 0 || digest || 08 05 00 00 || 11 zero bytes || SN[8] ||
+                 4 zero bytes || SN[0:1] || 2 zero bytes)
+
+   A verifier that knows key 0 and the expected flash contents computes the
+   same MACs. The next region is added before the current one is attested,
+   so it is hashed while the device executes Nonce and MAC.
+
+   The data zone of the device must be locked. AVR only, since the regions
+   are read with pgm_read_byte().
+
+   The SDA pin of the device is attached to pin 7.
+*/
+#include <sha204_library.h>
+#include <sha204_includes/sha204_lib_return_codes.h>
+
+#if !defined(__AVR__)
+#error "This example reads the flash memory of an AVR."
+#endif
+
+#define REGION_SIZE 4096UL
+
+atsha204Class sha204(7);
+sha204Attestor attestor(sha204, 0);
+
+// Reads the flash memory of the Arduino. context is the start of the region.
+uint16_t readFlash(void *context, uint32_t offset, uint8_t *buffer, uint16_t length)
+{
+  uint16_t address = (uint16_t) (uintptr_t) context + offset;
+
+  for (uint16_t i=0; i<length; i++)
+    buffer[i] = pgm_read_byte(address + i);
+  return length;
+}
+
+void setup()
+{
+  const uint16_t regions = (FLASHEND + 1UL) / REGION_SIZE;
+  uint8_t mac[32];
+
+  Serial.begin(9600);
+
+  attestor.add(readFlash, (void *) 0, REGION_SIZE);
+  for (uint16_t region=0; region<regions; region++)
+  {
+    if (region + 1 < regions)
+      attestor.add(readFlash, (void *) (uintptr_t) ((region + 1) * REGION_SIZE), REGION_SIZE);
+
+    unsigned long start = millis();
+    uint8_t ret_code = attestor.attest(NULL, mac);
+
+    Serial.print("Region ");
+    Serial.print(region);
+    Serial.print(" (");
+    Serial.print(millis() - start);
+    Serial.print(" ms): ");
+    if (ret_code != SHA204_SUCCESS)
+    {
+      Serial.print("error 0x");
+      Serial.println(ret_code, HEX);
+      continue;
+    }
+    for (int i=0; i<32; i++)
+    {
+      Serial.print(mac[i], HEX);
+      Serial.print(' ');
+    }
+    Serial.println();
+  }
+}
+
+void loop()
+{
+}
@@ -0,0 +1,282 @@
+/* ATSHA204 Library Benchmark Example
+
+   This code measures command latency and throughput on a real device.
+
+   rx_size:   Every command is timed twice: once with the exact response
+              size and once with the maximum response size
+              (SHA204_RSP_SIZE_MAX) that a caller would use when it does
+              not know the response size in advance. Since the receiver
+              stops after the number of bytes announced in the count byte,
+              both rows should be the same. Define SHA204_RX_FULL_SIZE in
+              sha204_library.h for a baseline with the receiver that waits
+              for the start pulse timeout after a short response.
+   opcode:    Latency of each command from sending it to a checked
+              response, and the resulting commands per second.
+   wake:      Time from the start of the wake pulse to the first command
+              response, starting from sleep.
+   sequence:  A Nonce, Random and Read session from wake to the last
+              response, once as separate calls and once as one
+              authenticate() transaction, which assembles every packet
+              while the device executes the previous command.
+   hash:      Software SHA-256 of 1 KiB from RAM, the hashing stage of
+              sha204Attestor. rx_size is 0 and per_second is KiB/s.
+              Divide average_us by 16 for the chunk_us argument of
+              extras/host/sha204_attest.cpp.
+   crc:       CRC of 64 bytes as the library computes it for every
+              command and response. rx_size is 0 and per_second is CRCs
+              per second. Multiply average_us by 1000 / 64 for the crc_ns
+              argument of extras/host/sha204_benchmark.cpp, whose sequence
+              rows charge it to show what authenticate() saves.
+
+   Results are printed as comma separated lines:
+   benchmark,command,rx_size,iterations,average_us,p50_us,p99_us,per_second
+
+   The pure software costs of the library are measured on a desktop host
+   by extras/host/sha204_benchmark.cpp in the library folder.
+
+   The ATSHA204's SDA pin can be connected to any of the Arduino's digital pins.
+   In this example we'll attach SDA to pin 7.
+*/
+#include <sha204_library.h>
+
+const int sha204Pin = 7;
+const int iterations = 50;
+
+atsha204Class sha204(sha204Pin);
+unsigned long samples[iterations];
+
+void setup()
+{
+  Serial.begin(9600);
+  Serial.println("benchmark,command,rx_size,iterations,average_us,p50_us,p99_us,per_second");
+
+  benchmarkCommand("rx_size", "devrev", DEVREV_RSP_SIZE);
+  benchmarkCommand("rx_size", "devrev", SHA204_RSP_SIZE_MAX);
+  benchmarkCommand("rx_size", "nonce_passthrough", NONCE_RSP_SIZE_SHORT);
+  benchmarkCommand("rx_size", "nonce_passthrough", SHA204_RSP_SIZE_MAX);
+  benchmarkCommand("rx_size", "parse_error", SHA204_RSP_SIZE_MIN);
+  benchmarkCommand("rx_size", "parse_error", SHA204_RSP_SIZE_MAX);
+
+  benchmarkCommand("opcode", "devrev", DEVREV_RSP_SIZE);
+  benchmarkCommand("opcode", "read_4", READ_4_RSP_SIZE);
+  benchmarkCommand("opcode", "read_32", READ_32_RSP_SIZE);
+  benchmarkCommand("opcode", "random", RANDOM_RSP_SIZE);
+  benchmarkCommand("opcode", "nonce_passthrough", NONCE_RSP_SIZE_SHORT);
+  benchmarkCommand("opcode", "nonce_random", NONCE_RSP_SIZE_LONG);
+  benchmarkCommand("opcode", "pause", PAUSE_RSP_SIZE);
+
+  benchmarkWake();
+  benchmarkSequence();
+  benchmarkHash();
+  benchmarkCrc();
+}
+
+void loop()
+{
+}
+
+// Fills command with the packet for name and returns its minimum and maximum execution times.
+// The CRC is appended by sha204c_send_and_receive.
+// None of these commands change the device, so they are safe on any device.
+void buildCommand(const char *name, uint8_t *command, uint8_t *delay_ms, uint8_t *timeout_ms)
+{
+  memset(command, 0, NONCE_COUNT_LONG);
+  if (!strcmp(name, "devrev"))
+  {
+    command[SHA204_COUNT_IDX] = DEVREV_COUNT;
+    command[SHA204_OPCODE_IDX] = SHA204_DEVREV;
+    *delay_ms = DEVREV_DELAY;
+    *timeout_ms = DEVREV_EXEC_MAX - DEVREV_DELAY;
+  }
+  else if (!strcmp(name, "read_4") || !strcmp(name, "read_32"))
+  {
+    // First word or block of the configuration zone, which is always readable.
+    command[SHA204_COUNT_IDX] = READ_COUNT;
+    command[SHA204_OPCODE_IDX] = SHA204_READ;
+    command[READ_ZONE_IDX] = SHA204_ZONE_CONFIG | (name[5] == '3' ? SHA204_ZONE_COUNT_FLAG : 0);
+    *delay_ms = READ_DELAY;
+    *timeout_ms = READ_EXEC_MAX - READ_DELAY;
+  }
+  else if (!strcmp(name, "random"))
+  {
+    command[SHA204_COUNT_IDX] = RANDOM_COUNT;
+    command[SHA204_OPCODE_IDX] = SHA204_RANDOM;
+    command[RANDOM_MODE_IDX] = RANDOM_NO_SEED_UPDATE;
+    *delay_ms = RANDOM_DELAY;
+    *timeout_ms = RANDOM_EXEC_MAX - RANDOM_DELAY;
+  }
+  else if (!strcmp(name, "nonce_passthrough"))
+  {
+    command[SHA204_COUNT_IDX] = NONCE_COUNT_LONG;
+    command[SHA204_OPCODE_IDX] = SHA204_NONCE;
+    command[NONCE_MODE_IDX] = NONCE_MODE_PASSTHROUGH;
+    *delay_ms = NONCE_DELAY;
+    *timeout_ms = NONCE_EXEC_MAX - NONCE_DELAY;
+  }
+  else if (!strcmp(name, "nonce_random"))
+  {
+    command[SHA204_COUNT_IDX] = NONCE_COUNT_SHORT;
+    command[SHA204_OPCODE_IDX] = SHA204_NONCE;
+    command[NONCE_MODE_IDX] = NONCE_MODE_NO_SEED_UPDATE;
+    *delay_ms = NONCE_DELAY;
+    *timeout_ms = NONCE_EXEC_MAX - NONCE_DELAY;
+  }
+  else if (!strcmp(name, "pause"))
+  {
+    // Devices whose selector differs go idle. Selector 0 is the shipped value
+    // and keeps this device active.
+    command[SHA204_COUNT_IDX] = PAUSE_COUNT;
+    command[SHA204_OPCODE_IDX] = SHA204_PAUSE;
+    command[PAUSE_SELECT_IDX] = 0x00;
+    *delay_ms = PAUSE_DELAY;
+    *timeout_ms = PAUSE_EXEC_MAX - PAUSE_DELAY;
+  }
+  else
+  {
+    // Op-code 0 does not exist. The device answers with a parse error status.
+    command[SHA204_COUNT_IDX] = SHA204_CMD_SIZE_MIN;
+    *delay_ms = 0;
+    *timeout_ms = PAUSE_EXEC_MAX;
+  }
+}
+
+void benchmarkCommand(const char *benchmark, const char *name, uint8_t rx_size)
+{
+  uint8_t command[NONCE_COUNT_LONG];
+  uint8_t response[SHA204_RSP_SIZE_MAX];
+  uint8_t delay_ms, timeout_ms;
+
+  for (int i=0; i<iterations; i++)
+  {
+    // Start every command in a fresh session so the watchdog never expires in the middle.
+    if (i % 10 == 0)
+    {
+      sha204.sha204p_sleep();
+      sha204.sha204c_wakeup(response);
+    }
+    buildCommand(name, command, &delay_ms, &timeout_ms);
+    unsigned long start = micros();
+    sha204.sha204c_send_and_receive(command, rx_size, response, delay_ms, timeout_ms);
+    samples[i] = micros() - start;
+  }
+  printResult(benchmark, name, rx_size);
+}
+
+void benchmarkWake()
+{
+  uint8_t command[NONCE_COUNT_LONG];
+  uint8_t response[SHA204_RSP_SIZE_MAX];
+  uint8_t delay_ms, timeout_ms;
+
+  for (int i=0; i<iterations; i++)
+  {
+    sha204.sha204p_sleep();
+    buildCommand("devrev", command, &delay_ms, &timeout_ms);
+    unsigned long start = micros();
+    sha204.sha204c_wakeup(response);
+    sha204.sha204c_send_and_receive(command, DEVREV_RSP_SIZE, response, delay_ms, timeout_ms);
+    samples[i] = micros() - start;
+  }
+  printResult("wake", "devrev", DEVREV_RSP_SIZE);
+}
+
+void benchmarkSequence()
+{
+  uint8_t command[NONCE_COUNT_LONG];
+  uint8_t response[SHA204_RSP_SIZE_MAX];
+  uint8_t challenge[NONCE_NUMIN_SIZE_PASSTHROUGH];
+  const sha204_auth_step_t steps[] = {
+    {SHA204_NONCE, NONCE_MODE_PASSTHROUGH, 0, NONCE_NUMIN_SIZE_PASSTHROUGH, challenge, 0, NULL, 0, NULL, NULL},
+    {SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, 0, 0, NULL, 0, NULL, 0, NULL, NULL},
+    {SHA204_READ, SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG, 0, 0, NULL, 0, NULL, 0, NULL, response},
+  };
+  sha204_auth_result_t result;
+
+  memset(challenge, 0x3C, sizeof(challenge));
+  for (int i=0; i<iterations; i++)
+  {
+    unsigned long start = micros();
+    sha204.sha204c_wakeup(response);
+    for (unsigned int j=0; j<sizeof(steps) / sizeof(steps[0]); j++)
+      sha204.sha204m_execute(steps[j].op_code, steps[j].param1, steps[j].param2,
+          steps[j].datalen1, steps[j].data1, 0, NULL, 0, NULL,
+          sizeof(command), command, sizeof(response), response);
+    samples[i] = micros() - start;
+    sha204.sha204p_sleep();
+  }
+  printResult("sequence", "separate", SHA204_RSP_SIZE_MAX);
+
+  for (int i=0; i<iterations; i++)
+  {
+    sha204.authenticate(steps, sizeof(steps) / sizeof(steps[0]), &result);
+    samples[i] = result.total_us;
+  }
+  printResult("sequence", "authenticate", SHA204_RSP_SIZE_MAX);
+}
+
+void benchmarkHash()
+{
+  uint8_t data[256];
+  uint8_t digest[32];
+  sha204Sha256 hash;
+
+  memset(data, 0xA5, sizeof(data));
+  for (int i=0; i<iterations; i++)
+  {
+    unsigned long start = micros();
+    hash.init();
+    for (int j=0; j<4; j++)
+      hash.update(data, sizeof(data));
+    hash.finish(digest);
+    samples[i] = micros() - start;
+  }
+  printResult("hash", "sha256_1k", 0);
+}
+
+void benchmarkCrc()
+{
+  uint8_t data[64];
+  uint8_t crc[SHA204_CRC_SIZE];
+
+  memset(data, 0xA5, sizeof(data));
+  for (int i=0; i<iterations; i++)
+  {
+    unsigned long start = micros();
+    sha204.sha204c_calculate_crc(sizeof(data), data, crc);
+    samples[i] = micros() - start;
+  }
+  printResult("crc", "crc_64", 0);
+}
+
+// Sorts the samples and prints one result line.
+void printResult(const char *benchmark, const char *name, uint8_t rx_size)
+{
+  unsigned long total = 0;
+
+  for (int i=1; i<iterations; i++)
+  {
+    unsigned long sample = samples[i];
+    int j = i;
+    for (; j > 0 && samples[j - 1] > sample; j--)
+      samples[j] = samples[j - 1];
+    samples[j] = sample;
+  }
+  for (int i=0; i<iterations; i++)
+    total += samples[i];
+
+  Serial.print(benchmark);
+  Serial.print(',');
+  Serial.print(name);
+  Serial.print(',');
+  Serial.print(rx_size);
+  Serial.print(',');
+  Serial.print(iterations);
+  Serial.print(',');
+  Serial.print(total / iterations);
+  Serial.print(',');
+  Serial.print(samples[(iterations - 1) * 50 / 100]);
+  Serial.print(',');
+  Serial.print(samples[(iterations - 1) * 99 / 100]);
+  Serial.print(',');
+  Serial.println(1000000.0 * iterations / total);
+}
@@ -14,6 +14,7 @@
  The ATSHA204 can be powered between 3.3V and 5V.
  */
 #include <sha204_library.h>
+#include <sha204_includes/sha204_lib_return_codes.h>
 
 #define SHA204_KEY_CHILD 10
 #define SHA204_KEY_PARENT 13
@@ -23,10 +24,18 @@ const int sha204Pin = 7;
 
 atsha204Class sha204(sha204Pin);
 atsha204Class sha204_1(9);
+sha204Link link(Serial);
+
+#define CLIENT_CHANNEL 0
+#define RETRY_INTERVAL 3000
+
+uint8_t serial_padded[NONCE_NUMIN_SIZE_PASSTHROUGH];
+unsigned long serial_sent_at;
 
 void setup()
 {
-  Serial.begin(9600);
+  Serial.begin(57600);
+  pinMode(LED_BUILTIN, OUTPUT);
    //Serial1.begin(19200);
   //Serial.println("Sending a Wakup Command. Response should be:\r\n4 11 33 43:");
   //Serial.println("Response is:");
@@ -41,11 +50,35 @@ void setup()
   //Serial.println("23 6 67 0 4F 28 4D 6E 98 62 4 F4 60 A3 E8 75 8A 59 85 A6 79 96 C4 8A 88 46 43 4E B3 DB 58 A4 FB E5 73");
   //Serial.println("Response is:");
   macChallengeExample();
- 
+  sendSerial();
 }
 
 void loop()
 {
+  sha204_link_frame_t frame;
+
+  if (link.poll(&frame) == SHA204_SUCCESS)
+  {
+    if (frame.type == SHA204_LINK_CHALLENGE && frame.length == NONCE_NUMIN_SIZE_PASSTHROUGH)
+      macResponseExample(frame.seq, frame.payload);
+    else if (frame.type == SHA204_LINK_RESULT && frame.length == 1)
+    {
+      // frame.payload[0] is SHA204_SUCCESS if the host accepted the MAC.
+      digitalWrite(LED_BUILTIN, frame.payload[0] == SHA204_SUCCESS ? HIGH : LOW);
+      delay(1000);
+      sendSerial();
+    }
+  }
+
+  // Start over if the host did not answer.
+  if (millis() - serial_sent_at > RETRY_INTERVAL)
+    sendSerial();
+}
+
+void sendSerial()
+{
+  link.send(CLIENT_CHANNEL, SHA204_LINK_SERIAL, 0, serial_padded, NONCE_NUMIN_SIZE_PASSTHROUGH);
+  serial_sent_at = millis();
 }
 
 byte wakeupExample()
@@ -182,92 +215,30 @@ byte macChallengeExample()
   //  Send DeriveKey command.
   ret_code_t = sha204_1.sha204m_derive_key(command, response_status, DERIVE_KEY_RANDOM_FLAG, SHA204_KEY_CHILD, NULL);
   
-  // --------------------------------------------------------------------- //
-  // Send the serial number ---------------------------------------------- //
-  // --------------------------------------------------------------------- //
-  
-  
-  //send serial number over serial
- // for(int i = 0; i < NONCE_NUMIN_SIZE_PASSTHROUGH; i++)
- // {
- //   Serial.write(temp[i]);
- // }
-  int bytes_sent = Serial.write(temp, NONCE_NUMIN_SIZE_PASSTHROUGH);
-  
-  if(bytes_sent != NONCE_NUMIN_SIZE_PASSTHROUGH)
-  {
-    Serial.println("Error sending random number");
-    return -1;
-  }
-  //----------------------------------------------------------------------// 
-  // Lock Config Zone : Danger make sure you configure everything before--// 
-  // uint8_t ret_code_lock =  sha204.sha204e_lock_config_zone();----------//
-  //----------------------------------------------------------------------// 
+  // The serial number is sent by sendSerial().
+  memcpy(serial_padded, temp, sizeof(serial_padded));
+  return ret_code_t;
+}
+
+// Answers a challenge of the host with the MAC of the diversified key.
+byte macResponseExample(uint8_t seq, uint8_t *randomnumber)
+{
+  uint8_t command[MAC_COUNT_LONG];
+  uint8_t response_mac[SHA204_RSP_SIZE_MAX];
 
-  // --------------------------------------------------------------------- //
-  // Recieve Random Number ----------------------------------------------- //
-  // generated a random number on the host ------------------------------- //
-  // --------------------------------------------------------------------- //
-  // loop and wait untill serial data is available
- // Serial.println("Waiting to recieve random number");
-  while(!Serial.available()){} 
-  Serial.flush();
-  while(!Serial.available()){} 
-  memset(randomnumber, 0, sizeof(randomnumber));
-  int bytes_read = Serial.readBytes((char *)randomnumber, NONCE_NUMIN_SIZE_PASSTHROUGH);
-  
-  if(bytes_read != NONCE_NUMIN_SIZE_PASSTHROUGH)
-  {
-    Serial.println("Error Receiving Serial");
-    return -1;
-  }
-  
-  //uint8_t temp_key[NONCE_NUMIN_SIZE_PASSTHROUGH];
-  
-  /*
-  Serial.println("Random Number Recieved:");
-  for (int i=0; i<NONCE_NUMIN_SIZE_PASSTHROUGH; i++)
-  {
-    Serial.print(randomnumber[i], HEX);
-    Serial.print(" ");
-  }
-  Serial.println(); 
-  */
-  
   // -------------------------------------------------------------- //
   // ------------------- MAC -------------------------------------- //
   // ----- issue a mac command on the client ---------------------- //
   // -------------------------------------------------------------- //
   
-  memset(command, 0, sizeof(command));
   memset(response_mac, 0, sizeof(response_mac));
+  sha204_1.sha204c_wakeup(response_mac);
   uint8_t ret_code_mac = sha204_1.sha204m_mac(command, response_mac, MAC_MODE_CHALLENGE, SHA204_KEY_CHILD, randomnumber);
+  sha204_1.sha204p_sleep();
   if (ret_code_mac != SHA204_SUCCESS) {
-  	//sha204e_sleep();
   	return ret_code_mac;
   }
   
-  
-  
-  // send the mac to host
-   bytes_sent = Serial.write(&response_mac[SHA204_BUFFER_POS_DATA], SHA204_RSP_SIZE_MAX - SHA204_BUFFER_POS_DATA);
-  
-  if(bytes_sent != SHA204_RSP_SIZE_MAX - SHA204_BUFFER_POS_DATA)
-  {
-    Serial.println("Error sending response mac");
-    return -1;
-  }
-
-   //output
-  Serial.println("MAC");
-  for (int i=SHA204_BUFFER_POS_DATA; i<SHA204_RSP_SIZE_MAX; i++)
-  {
-    Serial.print(response_mac[i], HEX);
-    Serial.print(' ');
-  }
-  Serial.println(); 
-  
-
-  delay(1000);
-  return 0;
+  // send the mac to host, with the sequence number of the challenge
+  return link.send(CLIENT_CHANNEL, SHA204_LINK_RESPONSE, seq, &response_mac[SHA204_BUFFER_POS_DATA], MAC_CHALLENGE_SIZE);
 }
@@ -7,6 +7,16 @@
  connected and operational. And how to obtain an SHA204's unique serial
  number, and send it a MAC challenge.
  
+ The client example sends its padded serial number in a SHA204_LINK_SERIAL
+ frame. The host answers with a random challenge, checks the MAC that comes
+ back with Nonce, GenDig and CheckMac, and returns the result. All messages
+ are sha204Link frames with a CRC, so a lost or garbled message times out
+ instead of stalling the sketch. Both sketches run at 57600 baud.
+ 
+ sha204AuthEngine does the device work. It generates the next challenge
+ before a serial number arrives and runs Nonce and GenDig for a challenged
+ client while its MAC is on the way, so several clients are served at once.
+ 
  The ATSHA204's SDA pin can be connected to any of the Arduino's digital pins.
  When constructing your atsha204Class, pass the constructor the pin you want to use.
  In this example we'll attach SDA to pin 7.
@@ -14,15 +24,25 @@
  The ATSHA204 can be powered between 3.3V and 5V.
  */
 #include <sha204_library.h>
+#include <sha204_includes/sha204_lib_return_codes.h>
 
 #define SHA204_KEY_CHILD 10
 #define SHA204_KEY_PARENT 13
-#define MAC_MODE_CHALLENGE              ((uint8_t) 0x00)
 
 const int sha204Pin = 7;
 
 atsha204Class sha204(sha204Pin);
 atsha204Class sha204_1(9);
+sha204Link link(Serial);
+
+// TempKey: client serial -> diversified client key, which its MAC is checked against.
+const sha204_engine_scheme_t scheme = {
+  SHA204_KEY_PARENT,
+  {0x1C, 0x04, SHA204_KEY_CHILD, 0x00},
+  CHECKMAC_MODE_BLOCK1_TEMPKEY | CHECKMAC_MODE_SOURCE_FLAG_MATCH,
+  {0x8, 0x0, SHA204_KEY_CHILD, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
+};
+sha204AuthEngine engine(sha204, link, &scheme);
 
 void setup()
 {
@@ -46,15 +66,8 @@ void setup()
 
 void loop()
 {
-  if(Serial.available())
-  {
-    char input = Serial.read();
-    if(input == '1')
-    {
-     // Serial.println("Start");
-      macChallengeExample();
-    }
-  } 
+  // Never blocks for longer than one transaction with the device.
+  engine.poll();
 }
 
 byte wakeupExample()
@@ -108,306 +121,6 @@ byte serialNumberExample()
   return returnValue;
 }
 
-byte macChallengeExample()
-{
-  uint8_t command[MAC_COUNT_LONG];
-  //uint8_t response[35];
-  uint8_t response_status[SHA204_RSP_SIZE_MIN];
-//  uint8_t randomnumber[35];
-  uint8_t response_random[RANDOM_RSP_SIZE];
-  
-  memset(response_random, 0, sizeof(response_random));
-  uint8_t *randomnumber = &response_random[SHA204_BUFFER_POS_DATA];
-
-  uint8_t command_derive_key[GENDIG_OTHER_DATA_SIZE];
-  uint8_t command_mac[CHECKMAC_CLIENT_COMMAND_SIZE];
-  // MAC response buffer
-  uint8_t response_mac[SHA204_RSP_SIZE_MAX];
-  
-  //check mac
-  uint8_t checkmac_other_data[CHECKMAC_OTHER_DATA_SIZE]= {0x8, 0x0 , 0xA, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; 
-
-  //serial number
-  uint8_t serial_numb[9];
-  
-  //buffer for serial
-  uint8_t buffer[32];
-//uint8_t ret_code = sha204.sha204e_configure_key();
-  //ret_code = sha204_1.sha204e_configure_diversify_key();
-  //Serial.println(ret_code);
-  /*for (int i=0; i<SHA204_RSP_SIZE_MAX; i++)
-  {
-    Serial.print(response[i], HEX);
-    Serial.print(' ');
-  }
-  Serial.println();
-    */
-    
-    
-   //Read Config Zone
-   uint8_t config_data[88];
-   //Serial.println("Config Zone: Host");  
-   sha204.sha204e_read_config_zone(config_data);
-  /* for (int i=0; i<88; i++)
-   {
-     Serial.print(config_data[i], HEX);
-     Serial.print(' ');
-   }
-   Serial.println();
-*/
-   
-   uint8_t derive_key_command[] = {0x1C, 0x04, 0x0A, 0x00};
-   //----------------------------------------------------------------------//
-   //-------------------------SERIAL NUMBER--------------------------------//
-   //------------get the serial number from UART --------------------------//
-   //----------------------------------------------------------------------//
-  
-  //sha204_1.getSerialNumber(serial_numb);
-  //uint8_t *temp = (uint8_t *)realloc(serial_numb, 32*sizeof(uint8_t));
- 
-  // loop and wait untill serial data is available
-  int  bufferpos = 0;
-  //Serial.print("Waiting");
-  while(!Serial.available()){} 
-  Serial.flush();
-  while(!Serial.available()){} 
-  //delay(10);
-  //Serial.print("Done Waiting");
-  memset(buffer,0, sizeof(buffer));
-  /*while(bufferpos < NONCE_NUMIN_SIZE_PASSTHROUGH)
-  {
-    buffer[bufferpos++] = Serial.read();
-  }
-   */
-  int bytes_read = Serial.readBytes((char *)buffer, NONCE_NUMIN_SIZE_PASSTHROUGH);
-  
-  if(bytes_read != NONCE_NUMIN_SIZE_PASSTHROUGH)
-  {
-    //Serial.println("Error Receiving Serial");
-    return -1;
-  }
-  
-  uint8_t temp_key[NONCE_NUMIN_SIZE_PASSTHROUGH];
-  memcpy(temp_key, buffer, sizeof(temp_key)); 
-  /*
-  Serial.println("Serial Number:");
-  for (int i=0; i<NONCE_NUMIN_SIZE_PASSTHROUGH; i++)
-  {
-    Serial.print(temp_key[i], HEX);
-    Serial.print(" ");
-  }
-  Serial.println(); 
-*/
-  //----------------------------------------------------------------------// 
-  // Lock Config Zone : Danger make sure you configure everything before--// 
-  // uint8_t ret_code_lock =  sha204.sha204e_lock_config_zone();----------//
-  //----------------------------------------------------------------------// 
-
-  // --------------------------------------------------------------------- //
-  // Generate Random Number ---------------------------------------------- //
-  // generate a random number on the host -------------------------------- //
-  // --------------------------------------------------------------------- //
-  memset(command, 0, sizeof(command));
-  uint8_t ret_code_random_number = sha204.sha204m_random(command, response_random, RANDOM_NO_SEED_UPDATE);
-
-  // output
-  /*Serial.println("Generating Random Number");
-  for (int i=0; i<NONCE_NUMIN_SIZE_PASSTHROUGH; i++)
-  {
-    Serial.print(randomnumber[i], HEX);
-    Serial.print(' ');
-    //randomnumber[i-1] = response[i];
-  }
-  Serial.println();
-  */
-  // ---------------------------------------------------------------- //
-  // --------------------- Generate Digest -------------------------- //
-  // ---------------------------------------------------------------- //
-  memset(command, 0, sizeof(command));
-  memset(response_status, 0, sizeof(response_status)); 
-  uint8_t ret_code_nonce = sha204.sha204m_nonce(command, response_status, NONCE_MODE_PASSTHROUGH, temp_key);
-  if (ret_code_nonce != SHA204_SUCCESS) {
-    //sha204p_sleep();
-    return ret_code_nonce;
-  }
-
-  memset(command, 0, sizeof(command));
-  memset(response_status, 0, sizeof(response_status));
-  uint8_t ret_code_gen_dig = sha204.sha204m_gen_dig(command, response_status, GENDIG_ZONE_DATA, SHA204_KEY_PARENT, derive_key_command);
-  if (ret_code_gen_dig != SHA204_SUCCESS) {
-    //sha204p_sleep();
-    return ret_code_gen_dig;
-  }
-  
-  // --------------------------------------------------------------------- //
-  // Send random number -------------------------------------------------- //
-  // --------------------------------------------------------------------- // 
-  int byte_sent = Serial.write(randomnumber, NONCE_NUMIN_SIZE_PASSTHROUGH);
-  
-  if(byte_sent != NONCE_NUMIN_SIZE_PASSTHROUGH)
-  {
-    //Serial.println("Error sending random number");
-    //return -1;
-  } 
-  
-  // -------------------------------------------------------------- //
-  // ------------------- MAC -------------------------------------- //
-  // ----- Wait for client mac response --------------------------- //
-  // -------------------------------------------------------------- //
-  
-  memset(buffer, 0, sizeof(buffer));
-  memset(response_mac, 0, sizeof(response_mac));
- 
-  while(!Serial.available()){} 
-   
-  bytes_read = Serial.readBytes((char *)&response_mac[SHA204_BUFFER_POS_DATA], SHA204_RSP_SIZE_MAX - SHA204_BUFFER_POS_DATA);
-  
-  if(bytes_read != SHA204_RSP_SIZE_MAX - SHA204_BUFFER_POS_DATA)
-  {
-    //Serial.println("Error Receiving Serial");
-    //Serial.println(bytes_read);
-        
-    return -1;
-  }
- 
- /*  
-  
-   //output
-  Serial.println("MAC");
-  for (int i=SHA204_BUFFER_POS_DATA; i<SHA204_RSP_SIZE_MAX; i++)
-  {
-    Serial.print(response_mac[i], HEX);
-    Serial.print(' ');
-  }
-  Serial.println(); 
-  */
-  // -------------------------------------------------------------- //
-  // ------------------- Check MAC -------------------------------- //
-  // -------------------------------------------------------------- //
-  // Serial.println("MAC");
- /*
-  for (int i=0; i<SHA204_RSP_SIZE_MIN; i++)
-  {
-    Serial.print(response_status[i], HEX);
-    Serial.print(' ');
-  }
-  Serial.println(); 
-*/
- // memset(command, 0, sizeof(command));
-  memset(response_status, 0, sizeof(response_status));
-  //memset(checkmac_other_data, 0, sizeof(checkmac_other_data));
-  //memcpy(checkmac_other_data, &command[SHA204_OPCODE_IDX], CHECKMAC_CLIENT_COMMAND_SIZE);
-  //Serial.println(ret_code_mac);
- /* 
-  Serial.println("checkmac_other_data");
-  for (int i=0; i<CHECKMAC_OTHER_DATA_SIZE; i++)
-  {
-    Serial.print(checkmac_other_data[i], HEX);
-    Serial.print(' ');
-  }
-  Serial.println();
-  */
-  int ret_code_mac = sha204.sha204m_check_mac(command, response_status, CHECKMAC_MODE_BLOCK1_TEMPKEY | CHECKMAC_MODE_SOURCE_FLAG_MATCH, 
-				        0, randomnumber, &response_mac[SHA204_BUFFER_POS_DATA], checkmac_other_data);
-
-
-  ///ret_code_mac = response_status[SHA204_BUFFER_POS_STATUS];  
-/*
-  Serial.println(ret_code_mac);
-  
-  Serial.println("MAC");
-  for (int i=0; i<SHA204_RSP_SIZE_MIN; i++)
-  {
-    Serial.print(response_status[i], HEX);
-    Serial.print(' ');
-  }
-  Serial.println(); 
-  
-  Serial.println("Generating Random Number");
-  for (int i=0; i<NONCE_NUMIN_SIZE_PASSTHROUGH; i++)
-  {
-    Serial.print(randomnumber[i], HEX);
-    Serial.print(' ');
-    //randomnumber[i-1] = response[i];
-  }
-  Serial.println();
-*/
- // ret_code = sha204e_check_response_status(ret_code, response_status)
-  /*
-  for (int i=0; i<SHA204_RSP_SIZE_MAX; i++)
-   {
-   Serial.print(response[i], HEX);
-   Serial.print(' ');
-   }
-   Serial.println();
-   //not using this because it creates a small random number for some reason (need to
-   //investigate that)
-   //sha204.sha204m_execute(SHA204_RANDOM, RANDOM_SEED_UPDATE, 0, 0, 
-   //   NULL, 0, NULL, 0, NULL, sizeof(command), &command[0], 
-   //  32*sizeof(uint8_t), &response[0]);
-   
-   
-   // generate the gendig
-   
-   
-   // get the mac
-   uint8_t ret_code = sha204.sha204m_execute(SHA204_MAC, 0x01, 0x0000, 0, 
-   NULL, 0, NULL, 0, NULL, sizeof(command), &command[0], 
-   sizeof(response), &response[0]);
-   
-   //
-   Serial.print(ret_code);
-   Serial.print(' ');
-   for (int i=0; i<SHA204_RSP_SIZE_MAX; i++)
-   {
-   Serial.print(response[i], HEX);
-   Serial.print(' ');
-   }
-   Serial.println("Data zone");
-   
-   
-   //uint8_t returnCode1 = sha204.sha204e_configure_derive_key();
-   //try a read
-   uint8_t readCommand[READ_COUNT];
-   uint8_t readResponse[READ_32_RSP_SIZE];	
-   
-   memset(readResponse, 0, sizeof(readResponse));
-   uint8_t returnCode = sha204.sha204m_read(readCommand, readResponse, SHA204_ZONE_COUNT_FLAG | SHA204_ZONE_DATA , 1);
-   Serial.println();
-   for (int i=0; i<READ_32_RSP_SIZE; i++)
-   {
-   Serial.print(readResponse[i], HEX);
-   Serial.print(' ');
-   }
-   Serial.println();
-   
-   uint8_t config_data[88];
-   sha204.sha204e_read_config_zone(config_data);
-   for (int i=0; i<88; i++)
-   {
-   Serial.print(config_data[i], HEX);
-   Serial.print(' ');
-   }
-   Serial.println();
-   
-  /*
-   uint8_t derivecommand[96] = { 0x1C, 0x4, 0x1 , 0x0 , 0x80 , 0x4F , 0x4D , 0x12 , 0xA3 , 0x4C , 0x2B , 0xDF , 0x8C , 0x70 , 0x30 , 0x23 , 0x96 , 0xB1 , 0x4A , 0x7C , 0x3D , 0x1B , 0x47 , 0xC7 , 0x2 , 0x15 , 0x0 , 0x0 , 0x0 , 0x80 , 0x2,
-   0x1C, 0x04, 0x01, 0x00, 
-   0xEE,
-   0x01, 0x23, 
-   0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
-   0x1, 0x23 , 0x39 , 0x66 , 0xAB , 0x5B , 0xA5 , 0xCE , 0xEE, 
-   0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05};  
-   */
-  //uint8_t
- 
-
-  delay(1000);
-  return 0;
-}
-
-
-
 /* read from bytes 0->3 of config zone 
  //uint8_t returnCode = sha204.sha204m_read(readCommand, readResponse, SHA204_ZONE_COUNT_FLAG | SHA204_ZONE_DATA , 0x0140);
  //Serial.println();
@@ -0,0 +1,104 @@
+/* ATSHA204 Library Health Example
+
+   This code spreads random number requests over two devices and skips a
+   device whose circuit breaker is open.
+
+   A device that fails SHA204_HEALTH_MAX_FAILURES calls in a row, or whose
+   error rate climbs above SHA204_HEALTH_MAX_ERROR_RATE, is taken out of
+   service. Calls to it return SHA204_CIRCUIT_OPEN right away instead of
+   spending the full retry time on the bus. After the probe interval one
+   call is let through again, and a successful call puts the device back
+   into service.
+
+   Uncomment #define SHA204_HEALTH in sha204_library.h to use this example.
+
+   The SDA pins of the two devices are attached to pins 7 and 8.
+*/
+#include <sha204_library.h>
+#include <sha204_includes/sha204_lib_return_codes.h>
+
+#if !defined(SHA204_HEALTH)
+#error "Uncomment #define SHA204_HEALTH in sha204_library.h to use this example."
+#endif
+
+const int devices = 2;
+
+atsha204Class sha204[devices] = { atsha204Class(7), atsha204Class(8) };
+int next_device = 0;
+
+void setup()
+{
+  Serial.begin(9600);
+}
+
+void loop()
+{
+  uint8_t command[RANDOM_COUNT];
+  uint8_t response[RANDOM_RSP_SIZE];
+  int device = pickDevice();
+
+  if (device < 0)
+  {
+    Serial.println("No device available.");
+    delay(SHA204_HEALTH_PROBE_INTERVAL);
+    return;
+  }
+
+  sha204[device].sha204c_wakeup(response);
+  uint8_t ret_code = sha204[device].sha204m_random(command, response, RANDOM_NO_SEED_UPDATE);
+  sha204[device].sha204p_sleep();
+
+  Serial.print("Device ");
+  Serial.print(device);
+  Serial.print(": ");
+  if (ret_code == SHA204_SUCCESS)
+  {
+    for (int i=SHA204_BUFFER_POS_DATA; i<SHA204_RSP_SIZE_MAX - SHA204_CRC_SIZE; i++)
+    {
+      Serial.print(response[i], HEX);
+      Serial.print(' ');
+    }
+    Serial.println();
+  }
+  else
+  {
+    Serial.print("error 0x");
+    Serial.println(ret_code, HEX);
+  }
+  printHealth(device);
+  delay(500);
+}
+
+// Round robin over the devices that are in service.
+int pickDevice()
+{
+  for (int i=0; i<devices; i++)
+  {
+    int device = (next_device + i) % devices;
+    if (sha204[device].isAvailable())
+    {
+      next_device = (device + 1) % devices;
+      return device;
+    }
+  }
+  return -1;
+}
+
+void printHealth(int device)
+{
+  const sha204_health_t *health = sha204[device].getHealth();
+  static const char *states[] = { "closed", "open", "half open" };
+
+  Serial.print("  state ");
+  Serial.print(states[health->state]);
+  Serial.print(", error rate ");
+  Serial.print(health->error_rate * 100 / 255);
+  Serial.print("%, failures ");
+  Serial.print(health->failures);
+  Serial.print('/');
+  Serial.print(health->calls);
+  Serial.print(", rejected ");
+  Serial.print(health->rejected);
+  Serial.print(", opened ");
+  Serial.println(health->opens);
+}
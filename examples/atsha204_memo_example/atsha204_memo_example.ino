@@ -0,0 +1,92 @@
+/* ATSHA204 Library Response Cache Example
+
+   This code reads the serial number and the device revision over and over
+   and shows how many of the commands the response cache answered.
+
+   Once a zone is locked, reads of parts of it can never return anything
+   else. memoRefresh() reads the lock bytes and the slot configurations, and
+   from then on such reads are answered from a small cache in RAM instead of
+   the bus. The serial number and DevRev are cached even on a blank device.
+
+   Uncomment #define SHA204_MEMO in sha204_library.h to use this example.
+
+   The SDA pin of the device is attached to pin 7.
+*/
+#include <sha204_library.h>
+#include <sha204_includes/sha204_lib_return_codes.h>
+
+#if !defined(SHA204_MEMO)
+#error "Uncomment #define SHA204_MEMO in sha204_library.h to use this example."
+#endif
+
+atsha204Class sha204(7);
+
+void setup()
+{
+  uint8_t response[SHA204_RSP_SIZE_MIN];
+
+  Serial.begin(9600);
+
+  sha204.sha204c_wakeup(response);
+  uint8_t ret_code = sha204.memoRefresh();
+  sha204.sha204p_sleep();
+  if (ret_code != SHA204_SUCCESS)
+  {
+    Serial.print("Lock state not read, error 0x");
+    Serial.println(ret_code, HEX);
+  }
+  printMemo();
+}
+
+void loop()
+{
+  uint8_t serial_number[9];
+  uint8_t command[DEVREV_COUNT];
+  uint8_t response[DEVREV_RSP_SIZE];
+
+  unsigned long start = micros();
+  sha204.sha204c_wakeup(response);
+  uint8_t ret_code = sha204.getSerialNumber(serial_number);
+  if (ret_code == SHA204_SUCCESS)
+    ret_code = sha204.sha204m_dev_rev(command, response);
+  sha204.sha204p_sleep();
+  unsigned long elapsed = micros() - start;
+
+  if (ret_code == SHA204_SUCCESS)
+  {
+    Serial.print("Serial number ");
+    for (int i=0; i<9; i++)
+    {
+      Serial.print(serial_number[i], HEX);
+      Serial.print(' ');
+    }
+    Serial.print("in ");
+    Serial.print(elapsed);
+    Serial.println(" us");
+  }
+  else
+  {
+    Serial.print("error 0x");
+    Serial.println(ret_code, HEX);
+  }
+  printMemo();
+  delay(1000);
+}
+
+void printMemo()
+{
+  const sha204_memo_t *memo = sha204.getMemo();
+
+  Serial.print("  config ");
+  Serial.print(memo->state & SHA204_MEMO_CONFIG_LOCKED ? "locked" : "unlocked");
+  Serial.print(", data ");
+  Serial.print(memo->state & SHA204_MEMO_DATA_LOCKED ? "locked" : "unlocked");
+  Serial.print(", fixed slots 0x");
+  Serial.print(memo->fixed_slots, HEX);
+  Serial.print(", hits ");
+  Serial.print(memo->hits);
+  Serial.print(", misses ");
+  Serial.print(memo->misses);
+  Serial.print(", evictions ");
+  Serial.println(memo->evictions);
+}
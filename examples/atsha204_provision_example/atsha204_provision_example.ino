@@ -0,0 +1,50 @@
+/* ATSHA204 Library Provision Example
+
+   This code brings the configuration zone of a device into the state
+   described by an image and prints how many commands that took.
+
+   Only the words that differ from the image are written, so running the
+   sketch a second time reads the configuration and writes nothing. The
+   image below leaves both zones unlocked. Add SHA204_PROVISION_LOCK_CONFIG
+   and SHA204_PROVISION_LOCK_DATA, together with the slot and OTP contents,
+   only once the image is final: a lock cannot be undone.
+
+   The SDA pin of the device is attached to pin 7.
+*/
+#include <sha204_library.h>
+#include <sha204_includes/sha204_lib_return_codes.h>
+
+// Bytes 16 to 83 of the configuration zone: I2C address, OTP mode and
+// selector mode, the configuration of the 16 slots, the use flags and the
+// last key use bytes. Slots 0 to 7 hold secret keys, slots 8 to 15 data.
+uint8_t config[SHA204_PROVISION_CONFIG_SIZE] =
+{
+  0xC8, 0x00, 0xAA, 0x00,
+  0x8F, 0x80, 0x8F, 0x80, 0x8F, 0x80, 0x8F, 0x80,
+  0x8F, 0x80, 0x8F, 0x80, 0x8F, 0x80, 0x8F, 0x80,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00,
+  0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+sha204_image_t image = { config, NULL, 0, NULL, 0, 0, 0 };
+
+atsha204Class sha204(7);
+sha204Provisioner provisioner(sha204);
+
+void setup()
+{
+  sha204_provision_result_t result;
+
+  Serial.begin(9600);
+
+  provisioner.provision(&image, &result);
+  sha204Provisioner::printResult(Serial, &result);
+}
+
+void loop()
+{
+}
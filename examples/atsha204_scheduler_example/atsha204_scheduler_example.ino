@@ -0,0 +1,123 @@
+/* ATSHA204 Library Scheduler Example
+
+   This code shares one device between three kinds of work:
+
+   - a MAC over a challenge that arrives on the serial port, which must be
+     answered quickly (high priority, 50 ms deadline)
+   - a read of the serial number every five seconds (normal priority)
+   - keeping a pool of random numbers full (low priority)
+
+   The scheduler runs one transaction at a time, so a challenge waits for
+   at most the one transaction that is already running, never for the whole
+   pool refill. Every ten seconds the queueing delay of each priority is
+   printed.
+
+   Send 32 bytes to get their MAC with key 0. The data zone must be locked.
+
+   The SDA pin of the device is attached to pin 7.
+*/
+#include <sha204_library.h>
+#include <sha204_includes/sha204_lib_return_codes.h>
+
+#define POOL_SIZE 4
+
+void macDone(sha204_job_t *job, void *context);
+void randomDone(sha204_job_t *job, void *context);
+
+atsha204Class sha204(7);
+sha204Scheduler scheduler(sha204);
+
+// High priority: Nonce loads the challenge into TempKey, MAC hashes key 0 with it.
+uint8_t challenge[NONCE_NUMIN_SIZE_PASSTHROUGH];
+uint8_t challenge_length = 0;
+uint8_t mac_response[MAC_RSP_SIZE];
+const sha204_auth_step_t mac_steps[] = {
+  {SHA204_NONCE, NONCE_MODE_PASSTHROUGH, 0, NONCE_NUMIN_SIZE_PASSTHROUGH, challenge, 0, NULL, 0, NULL, NULL},
+  {SHA204_MAC, MAC_MODE_BLOCK2_TEMPKEY | MAC_MODE_SOURCE_FLAG_MATCH, 0, 0, NULL, 0, NULL, 0, NULL, mac_response},
+};
+sha204_job_t mac_job = {mac_steps, 2, SHA204_PRIORITY_HIGH, 1, 0, 50, macDone, NULL};
+
+// Normal priority: serial number bytes 0 to 3 of the configuration zone.
+uint8_t read_response[READ_4_RSP_SIZE];
+const sha204_auth_step_t read_step = {SHA204_READ, SHA204_ZONE_CONFIG, ADDRESS_SN03 / 4, 0, NULL, 0, NULL, 0, NULL, read_response};
+sha204_job_t read_job = {&read_step, 1, SHA204_PRIORITY_NORMAL, 2, 0, 0, NULL, NULL};
+unsigned long last_read = 0;
+
+// Low priority: one job per random number of the pool.
+uint8_t pool[POOL_SIZE][RANDOM_RSP_SIZE];
+uint8_t pool_full[POOL_SIZE];
+sha204_auth_step_t random_steps[POOL_SIZE];
+sha204_job_t random_jobs[POOL_SIZE];
+
+unsigned long last_print = 0;
+
+void setup()
+{
+  Serial.begin(9600);
+
+  for (int i=0; i<POOL_SIZE; i++)
+  {
+    sha204_auth_step_t step = {SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, 0, 0, NULL, 0, NULL, 0, NULL, pool[i]};
+    sha204_job_t job = {&random_steps[i], 1, SHA204_PRIORITY_LOW, 3, 0, 0, randomDone, &pool_full[i]};
+
+    random_steps[i] = step;
+    random_jobs[i] = job;
+    pool_full[i] = 0;
+  }
+}
+
+void loop()
+{
+  // Challenge bytes arrive while other jobs run.
+  while (Serial.available() > 0 && challenge_length < sizeof(challenge) && mac_job.state != SHA204_JOB_QUEUED)
+  {
+    challenge[challenge_length++] = Serial.read();
+    if (challenge_length == sizeof(challenge))
+      scheduler.submit(&mac_job);
+  }
+
+  if (millis() - last_read >= 5000 && read_job.state != SHA204_JOB_QUEUED)
+  {
+    scheduler.submit(&read_job);
+    last_read = millis();
+  }
+
+  // Refill the pool. Here the numbers are used up as soon as they arrive,
+  // so the device always has background work.
+  for (int i=0; i<POOL_SIZE; i++)
+  {
+    if (!pool_full[i] && random_jobs[i].state != SHA204_JOB_QUEUED)
+      scheduler.submit(&random_jobs[i]);
+    pool_full[i] = 0;
+  }
+
+  scheduler.poll();
+
+  if (millis() - last_print >= 10000)
+  {
+    scheduler.printStats(Serial);
+    last_print = millis();
+  }
+}
+
+void macDone(sha204_job_t *job, void *context)
+{
+  challenge_length = 0;
+  if (job->result.ret_code != SHA204_SUCCESS)
+  {
+    Serial.print("MAC error 0x");
+    Serial.println(job->result.ret_code, HEX);
+    return;
+  }
+  for (int i=SHA204_BUFFER_POS_DATA; i<MAC_RSP_SIZE - SHA204_CRC_SIZE; i++)
+  {
+    Serial.print(mac_response[i], HEX);
+    Serial.print(' ');
+  }
+  Serial.println();
+}
+
+void randomDone(sha204_job_t *job, void *context)
+{
+  *(uint8_t *) context = job->result.ret_code == SHA204_SUCCESS;
+}
@@ -0,0 +1,67 @@
+/* ATSHA204 Library Zone Streaming Example
+
+   This code reads the whole data zone with readZone() and hashes it with
+   SHA-256 on the way, without a 512-byte buffer for the zone. Each 32-byte
+   response is handed to the hash straight from the receive buffer. The
+   digest can be compared with the one of the provisioning image to check
+   that a device holds the expected public data.
+
+   The data zone can be read only after it has been locked, and secret
+   slots cannot be read at all. Reading stops at the first slot that fails.
+
+   The SDA pin of the device is attached to pin 7.
+*/
+#include <sha204_library.h>
+#include <sha204_includes/sha204_lib_return_codes.h>
+
+atsha204Class sha204(7);
+sha204Sha256 hash;
+
+uint8_t hashBlock(void *context, uint16_t address, const uint8_t *data, uint8_t length);
+
+void setup()
+{
+  sha204_stream_result_t result;
+  uint8_t digest[32];
+
+  Serial.begin(9600);
+
+  hash.init();
+  sha204.readZone(SHA204_ZONE_DATA, 0, 16 * 32, hashBlock, NULL, &result);
+  hash.finish(digest);
+
+  if (result.ret_code != SHA204_SUCCESS)
+  {
+    Serial.print("Read failed after ");
+    Serial.print(result.bytes);
+    Serial.print(" bytes, error 0x");
+    Serial.println(result.ret_code, HEX);
+    return;
+  }
+
+  Serial.print("SHA-256 of the data zone: ");
+  for (int i=0; i<32; i++)
+  {
+    if (digest[i] < 0x10)
+      Serial.print('0');
+    Serial.print(digest[i], HEX);
+  }
+  Serial.println();
+  Serial.print(result.reads);
+  Serial.print(" reads, ");
+  Serial.print(result.total_us / 1000);
+  Serial.print(" ms, ");
+  Serial.print(result.bytes_per_s);
+  Serial.println(" bytes/s");
+}
+
+void loop()
+{
+}
+
+// Returns 0 to go on reading.
+uint8_t hashBlock(void *context, uint16_t address, const uint8_t *data, uint8_t length)
+{
+  hash.update(data, length);
+  return 0;
+}
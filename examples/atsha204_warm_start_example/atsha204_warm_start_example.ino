@@ -0,0 +1,47 @@
+/* ATSHA204 Library Warm Start Example
+
+   This code keeps the serial number, revision, lock state and a hash of
+   the configuration zone of the device in the EEPROM of the AVR. The first
+   boot reads the device and stores the record; every boot after that
+   checks it with a single 4-byte read and prints the stored serial number.
+
+   The record is used only once the configuration and data zones are both
+   locked. Until then every boot reads the device again.
+
+   The SDA pin of the device is attached to pin 7.
+*/
+#include <sha204_library.h>
+#include <sha204_includes/sha204_lib_return_codes.h>
+
+const uint16_t eeprom_address = 0;
+
+atsha204Class sha204(7);
+sha204WarmStart warm(sha204, sha204_eeprom_read, sha204_eeprom_write, NULL, eeprom_address);
+
+void setup()
+{
+  sha204_warm_result_t result;
+  const sha204_warm_record_t *record;
+
+  Serial.begin(9600);
+
+  warm.begin(&result);
+  sha204WarmStart::printResult(Serial, &result);
+
+  record = warm.getRecord();
+  if (record)
+  {
+    Serial.print("Serial number: ");
+    for (int i=0; i<SHA204_WARM_SERIAL_SIZE; i++)
+    {
+      if (record->serial[i] < 16)
+        Serial.print('0');
+      Serial.print(record->serial[i], HEX);
+    }
+    Serial.println();
+  }
+}
+
+void loop()
+{
+}
@@ -0,0 +1,67 @@
+/* ATSHA204 Library Zone Cache Example
+
+   This code fills a data slot word by word and reads it back through a
+   sha204ZoneCache, then prints how many commands and how much bus time the
+   cache saved.
+
+   The eight 4-byte writes go to the device as one 32-byte write when the
+   cache is flushed, and the read-back is answered from the cache without
+   a command. Once the data zone is locked, only slots that can be written
+   in clear accept the write.
+
+   The SDA pin of the device is attached to pin 7.
+*/
+#include <sha204_library.h>
+#include <sha204_includes/sha204_lib_return_codes.h>
+
+const uint8_t slot = 8;
+
+atsha204Class sha204(7);
+sha204ZoneCache cache(sha204);
+
+void setup()
+{
+  uint8_t response[SHA204_RSP_SIZE_MIN];
+  uint8_t word[4];
+  uint8_t ret_code = SHA204_SUCCESS;
+
+  Serial.begin(9600);
+
+  sha204.sha204c_wakeup(response);
+  for (int i=0; i<8 && ret_code == SHA204_SUCCESS; i++)
+  {
+    for (int j=0; j<4; j++)
+      word[j] = i * 4 + j;
+    ret_code = cache.write(SHA204_ZONE_DATA, slot * 32 + i * 4, word, 4);
+  }
+  if (ret_code == SHA204_SUCCESS)
+    ret_code = cache.flush();
+  report("Write", ret_code);
+
+  for (int i=0; i<8 && ret_code == SHA204_SUCCESS; i++)
+  {
+    ret_code = cache.read(SHA204_ZONE_DATA, slot * 32 + i * 4, word, 4);
+    if (ret_code == SHA204_SUCCESS && word[0] != i * 4)
+      ret_code = SHA204_FUNC_FAIL;
+  }
+  report("Read", ret_code);
+  cache.sleep();
+
+  cache.printStats(Serial);
+}
+
+void loop()
+{
+}
+
+void report(const char *what, uint8_t ret_code)
+{
+  Serial.print(what);
+  if (ret_code == SHA204_SUCCESS)
+    Serial.println(" succeeded.");
+  else
+  {
+    Serial.print(" failed, error 0x");
+    Serial.println(ret_code, HEX);
+  }
+}